@@ -0,0 +1,294 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace cpputils {
+
+enum class WaitStrategy {
+  BusySpin,  // Spin on the sequences, lowest latency, one core per waiter
+  Yield,     // Spin briefly, then std::this_thread::yield() between checks
+  Park,      // Spin briefly, then sleep on a condition variable. Publishers
+             // and consumers only notify while someone sleeps.
+};
+
+// Single-producer ring whose items are seen by every consumer, after the
+// LMAX Disruptor. Items are written once into preallocated slots and read in
+// place, each consumer keeps its own cursor. The producer waits while the
+// slowest consumer is a whole ring behind, a consumer can depend on others
+// and then only sees an item after all of them are done with it.
+// Add all consumers before the first publish, without any consumer items
+// are overwritten unseen. Only one thread may publish, each Consumer is
+// used by one thread at a time.
+template <typename T>
+class BroadcastRing {
+ private:
+  static constexpr size_t cache_line = 64;
+  static constexpr int spin_limit = 100;
+
+  struct alignas(cache_line) Sequence {
+    std::atomic<int64_t> value{-1};
+  };
+
+ public:
+  class Consumer {
+   public:
+    Consumer(const Consumer&) = delete;
+    Consumer& operator=(const Consumer&) = delete;
+
+    // Waits for at least one item, then calls
+    // func(const T& item, int64_t sequence, bool end_of_batch) for up to max
+    // available ones. Returns how many, 0 once the ring is closed and this
+    // consumer has seen everything. An exception from func ends the batch,
+    // the item it was thrown for counts as consumed.
+    template <typename Func>
+    size_t consume(Func&& func, size_t max = SIZE_MAX) {
+      const int64_t next = cursor.value.load(std::memory_order_relaxed) + 1;
+      int64_t last = cached_available;
+      if (last < next) {
+        ring.wait_until([&] {
+          last = available();
+          return last >= next ||
+                 (ring.closed() && ring.last_published() < next);
+        });
+        if (last < next) {
+          return 0;
+        }
+        cached_available = last;
+      }
+      return run(func, next, last, max);
+    }
+
+    // Like consume, without waiting. 0 when nothing is available.
+    template <typename Func>
+    size_t try_consume(Func&& func, size_t max = SIZE_MAX) {
+      const int64_t next = cursor.value.load(std::memory_order_relaxed) + 1;
+      if (cached_available < next) {
+        cached_available = available();
+        if (cached_available < next) {
+          return 0;
+        }
+      }
+      return run(func, next, cached_available, max);
+    }
+
+    // Sequence of the last item consumed, -1 before the first
+    int64_t position() const {
+      return cursor.value.load(std::memory_order_relaxed);
+    }
+
+   private:
+    friend class BroadcastRing;
+
+    BroadcastRing& ring;
+    Sequence cursor;
+    // The published sequence followed by the cursors depended on
+    std::vector<const Sequence*> upstream;
+    int64_t cached_available = -1;
+
+    Consumer(BroadcastRing& owner, std::vector<const Sequence*> Upstream,
+             int64_t start)
+        : ring(owner), upstream(std::move(Upstream)), cached_available(start) {
+      cursor.value.store(start, std::memory_order_relaxed);
+    }
+
+    int64_t available() const {
+      int64_t last = std::numeric_limits<int64_t>::max();
+      for (const Sequence* sequence : upstream) {
+        last = std::min(last, sequence->value.load(std::memory_order_acquire));
+      }
+      return last;
+    }
+
+    template <typename Func>
+    size_t run(Func& func, int64_t next, int64_t last, size_t max) {
+      if (static_cast<uint64_t>(last - next) >= max) {
+        last = next + static_cast<int64_t>(max) - 1;
+      }
+      int64_t sequence = next;
+      try {
+        for (; sequence <= last; ++sequence) {
+          func(std::as_const(ring.slots[sequence & ring.mask]), sequence,
+               sequence == last);
+        }
+      } catch (...) {
+        advance(sequence);
+        throw;
+      }
+      advance(last);
+      return static_cast<size_t>(last - next + 1);
+    }
+
+    void advance(int64_t sequence) {
+      cursor.value.store(sequence, std::memory_order_release);
+      ring.wake();
+    }
+  };
+
+  // Capacity is rounded up to a power of two
+  explicit BroadcastRing(size_t Capacity,
+                         WaitStrategy Wait = WaitStrategy::Park)
+      : wait(Wait) {
+    size_t capacity = 1;
+    while (capacity < Capacity) {
+      capacity <<= 1;
+    }
+    slots.resize(capacity);
+    mask = static_cast<int64_t>(capacity) - 1;
+  }
+
+  BroadcastRing(const BroadcastRing&) = delete;
+  BroadcastRing& operator=(const BroadcastRing&) = delete;
+
+  // New consumer starting after the last published item, which only sees
+  // an item once every consumer in depends_on has consumed it
+  Consumer& add_consumer(
+      std::initializer_list<const Consumer*> depends_on = {}) {
+    std::vector<const Sequence*> upstream{&published};
+    for (const Consumer* dependency : depends_on) {
+      upstream.push_back(&dependency->cursor);
+    }
+    const int64_t start = published.value.load(std::memory_order_acquire);
+    consumers.emplace_back(new Consumer(*this, std::move(upstream), start));
+    gating.push_back(&consumers.back()->cursor);
+    return *consumers.back();
+  }
+
+  bool publish(const T& item) {
+    return publish_batch(1, [&item](T& slot, size_t) { slot = item; }) == 1;
+  }
+
+  bool publish(T&& item) {
+    return publish_batch(1, [&item](T& slot, size_t) {
+             slot = std::move(item);
+           }) == 1;
+  }
+
+  // Claims up to count slots (at most the capacity), calls
+  // fill(T& slot, size_t index) for each and makes them visible at once.
+  // Returns how many were published, 0 once closed.
+  template <typename Fill>
+  size_t publish_batch(size_t count, Fill&& fill) {
+    count = std::min(count, slots.size());
+    if (count == 0 || closed_.load(std::memory_order_relaxed)) {
+      return 0;
+    }
+    const int64_t first = producer.next;
+    const int64_t last = first + static_cast<int64_t>(count) - 1;
+    // The slot of last is free once everyone is past the item it held
+    const int64_t wrap = last - static_cast<int64_t>(slots.size());
+    if (producer.cached_gate < wrap) {
+      wait_until([&] {
+        producer.cached_gate = slowest();
+        return producer.cached_gate >= wrap ||
+               closed_.load(std::memory_order_acquire);
+      });
+      if (producer.cached_gate < wrap) {
+        return 0;
+      }
+    }
+    for (int64_t sequence = first; sequence <= last; ++sequence) {
+      fill(slots[sequence & mask], static_cast<size_t>(sequence - first));
+    }
+    producer.next = last + 1;
+    published.value.store(last, std::memory_order_release);
+    wake();
+    return count;
+  }
+
+  // Consumers finish what was published, then consume returns 0. A
+  // producer waiting for room gives up.
+  void close() {
+    closed_.store(true, std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::lock_guard<std::mutex> lock(park_mtx);
+    park_cv.notify_all();
+  }
+
+  bool closed() const { return closed_.load(std::memory_order_acquire); }
+  size_t capacity() const { return slots.size(); }
+
+  // Sequence of the last published item, -1 before the first
+  int64_t last_published() const {
+    return published.value.load(std::memory_order_acquire);
+  }
+
+ private:
+  std::vector<T> slots;
+  int64_t mask = 0;
+  const WaitStrategy wait;
+  std::vector<std::unique_ptr<Consumer>> consumers;
+  std::vector<const Sequence*> gating;
+
+  Sequence published;
+  // Only touched by the producer
+  struct alignas(cache_line) {
+    int64_t next = 0;
+    int64_t cached_gate = -1;
+  } producer;
+
+  alignas(cache_line) std::atomic<bool> closed_{false};
+  std::atomic<int> parked{0};
+  std::mutex park_mtx;
+  std::condition_variable park_cv;
+
+  int64_t slowest() const {
+    int64_t position = std::numeric_limits<int64_t>::max();
+    for (const Sequence* sequence : gating) {
+      position =
+          std::min(position, sequence->value.load(std::memory_order_acquire));
+    }
+    return position;
+  }
+
+  static void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+  }
+
+  template <typename Ready>
+  void wait_until(Ready ready) {
+    for (int spins = 0; !ready(); ++spins) {
+      if (wait == WaitStrategy::BusySpin || spins < spin_limit) {
+        cpu_relax();
+      } else if (wait == WaitStrategy::Yield) {
+        std::this_thread::yield();
+      } else {
+        std::unique_lock<std::mutex> lock(park_mtx);
+        parked.fetch_add(1, std::memory_order_seq_cst);
+        // Either wake() sees the count, or ready() sees what it published
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        park_cv.wait(lock, ready);
+        parked.fetch_sub(1, std::memory_order_relaxed);
+        return;
+      }
+    }
+  }
+
+  // After moving a sequence, wakes whoever sleeps on it
+  void wake() {
+    if (wait != WaitStrategy::Park) {
+      return;
+    }
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (parked.load(std::memory_order_relaxed) > 0) {
+      std::lock_guard<std::mutex> lock(park_mtx);
+      park_cv.notify_all();
+    }
+  }
+};
+
+}  // namespace cpputils
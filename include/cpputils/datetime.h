@@ -1,10 +1,13 @@
 #pragma once
 
 #include <chrono>
+#include <cstddef>
 #include <cstdint>
-#include <iomanip>
-#include <sstream>
+#include <optional>
 #include <string>
+#include <string_view>
+
+#include "clock.h"
 
 namespace cpputils {
 namespace datetime {
@@ -14,37 +17,81 @@ namespace datetime {
 // "I'd just like to interject for a moment. What you're referring to as ISO-8601,
 // is in fact, RFC-3339, or as I've recently taken to calling it ISO-8601 plus RFC-3339."
 
-inline auto print_iso8601_utc(std::chrono::system_clock::time_point tp)
-    -> std::string {
-  using namespace std::chrono;
+namespace detail {
 
-  time_t t = system_clock::to_time_t(tp);
-  std::tm utc_tm = *std::gmtime(&t);
+// Howard Hinnant's civil calendar algorithms, days relative to 1970-01-01
+constexpr int64_t days_from_civil(int64_t y, unsigned m, unsigned d) {
+  y -= m <= 2;
+  const int64_t era = (y >= 0 ? y : y - 399) / 400;
+  const auto yoe = static_cast<unsigned>(y - era * 400);
+  const unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+  const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
 
-  std::ostringstream oss;
-  oss << std::put_time(&utc_tm, "%Y-%m-%dT%H:%M:%SZ");
-  return oss.str();
+struct civil {
+  int64_t year;
+  unsigned month;
+  unsigned day;
 };
 
-inline auto print_iso8601_local(std::chrono::system_clock::time_point tp)
-    -> std::string {
-  using namespace std::chrono;
-
-  std::time_t time = system_clock::to_time_t(tp);
-  std::tm local_tm = *std::localtime(&time);
-  std::ostringstream oss;
+constexpr civil civil_from_days(int64_t days) {
+  days += 719468;
+  const int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+  const auto doe = static_cast<unsigned>(days - era * 146097);
+  const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  const unsigned mp = (5 * doy + 2) / 153;
+  const unsigned d = doy - (153 * mp + 2) / 5 + 1;
+  const unsigned m = mp < 10 ? mp + 3 : mp - 9;
+  return {static_cast<int64_t>(yoe) + era * 400 + (m <= 2), m, d};
+}
 
-  oss << std::put_time(&local_tm, "%Y-%m-%dT%H:%M:%S");
-  return oss.str();
+constexpr bool is_leap_year(int64_t year) {
+  return year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
 }
 
-inline int64_t now() {
-  using namespace std::chrono;
-  return static_cast<int64_t>(
-      duration_cast<milliseconds>(system_clock::now().time_since_epoch())
-          .count());
+constexpr unsigned days_in_month(int64_t year, unsigned month) {
+  if (month == 2) {
+    return is_leap_year(year) ? 29 : 28;
+  }
+  return month == 4 || month == 6 || month == 9 || month == 11 ? 30 : 31;
 }
 
+}  // namespace detail
+
+enum class precision { seconds, milliseconds, microseconds, nanoseconds };
+
+// "2025-05-18T18:53:46.123456789Z"
+constexpr size_t rfc3339_max_length = 30;
+
+// Writes tp in UTC with precision fractional digits (truncated, not
+// rounded) and returns the length, at most rfc3339_max_length. No
+// terminator. Integer calendar math, the date and time of the last second
+// formatted are cached per thread.
+size_t format_rfc3339(char* buf, std::chrono::system_clock::time_point tp,
+                      precision digits = precision::milliseconds);
+
+// Accepts "YYYY-MM-DDTHH:MM:SS[.fraction](Z|+HH:MM|-HH:MM)", T and Z in
+// either case, or a space for T. Fractions beyond nanoseconds are
+// truncated. nullopt for anything malformed or out of range, including
+// leap seconds.
+std::optional<std::chrono::system_clock::time_point> parse_rfc3339(
+    std::string_view text);
+
+inline auto print_iso8601_utc(std::chrono::system_clock::time_point tp)
+    -> std::string {
+  char buf[rfc3339_max_length];
+  return std::string(buf, format_rfc3339(buf, tp, precision::seconds));
+};
+
+// Local time without offset, the zone comes from local_zone() in
+// timezone.h. format_rfc3339_local there has the offset too.
+std::string print_iso8601_local(std::chrono::system_clock::time_point tp);
+
+// Unix milliseconds, cached_unix_ms() under CPPUTILS_COARSE_CLOCK
+inline int64_t now() { return clocks::unix_ms(); }
+
 inline std::chrono::system_clock::time_point to_time_point(
     int64_t timestamp_ms) {
   using namespace std::chrono;
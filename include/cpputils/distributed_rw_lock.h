@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+namespace cpputils {
+
+// Big-reader lock: every reader only touches its own cache-padded slot, so
+// read-side throughput scales with the number of cores. Writers are the slow
+// path, they revoke the fast path and wait for all slots to drain.
+// Satisfies the SharedMutex requirements (std::shared_lock/std::unique_lock).
+// Like std::shared_mutex, recursive read locking is not supported.
+class DistributedRWLock {
+ private:
+  static constexpr size_t cache_line = 64;
+
+  struct alignas(cache_line) Slot {
+    std::atomic<int64_t> readers{0};
+  };
+
+  std::unique_ptr<Slot[]> slots;
+  size_t slot_mask;
+  alignas(cache_line) std::atomic<bool> writer_active{false};
+  std::mutex writer_mtx;  // Held by the writer, blocked readers park on it
+
+  // Each thread keeps a fixed slot index, so unlock_shared hits the same slot.
+  // Round-robin assignment spreads threads evenly over the slots.
+  static size_t thread_slot() {
+    static std::atomic<size_t> next_slot{0};
+    thread_local const size_t slot =
+        next_slot.fetch_add(1, std::memory_order_relaxed);
+    return slot;
+  }
+
+  void wait_for_writer();
+  void drain_readers() const;
+
+ public:
+  // slot_count is rounded up to a power of two, 0 means hardware_concurrency
+  explicit DistributedRWLock(size_t slot_count = 0);
+  DistributedRWLock(const DistributedRWLock&) = delete;
+  DistributedRWLock& operator=(const DistributedRWLock&) = delete;
+
+  void lock_shared() {
+    auto& readers = slots[thread_slot() & slot_mask].readers;
+    for (;;) {
+      readers.fetch_add(1, std::memory_order_seq_cst);
+      if (!writer_active.load(std::memory_order_seq_cst)) {
+        return;
+      }
+      // A writer revoked the fast path, back off until it is done
+      readers.fetch_sub(1, std::memory_order_release);
+      wait_for_writer();
+    }
+  }
+
+  bool try_lock_shared() {
+    auto& readers = slots[thread_slot() & slot_mask].readers;
+    readers.fetch_add(1, std::memory_order_seq_cst);
+    if (!writer_active.load(std::memory_order_seq_cst)) {
+      return true;
+    }
+    readers.fetch_sub(1, std::memory_order_release);
+    return false;
+  }
+
+  void unlock_shared() {
+    slots[thread_slot() & slot_mask].readers.fetch_sub(
+        1, std::memory_order_release);
+  }
+
+  void lock();
+  bool try_lock();
+  void unlock();
+
+  inline size_t slot_count() const { return slot_mask + 1; }
+};
+
+}  // namespace cpputils
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <chrono>
 #include <condition_variable>
 #include <mutex>
 #include <shared_mutex>
@@ -13,6 +14,17 @@ class FairRWLock {
   mutable int active_readers = 0;
   int active_writers = 0;
   int waiting_writers = 0;
+  bool active_upgrader = false;  // At most one upgradable reader at a time
+
+  bool can_read() const {
+    return active_writers == 0 && waiting_writers == 0;
+  }
+
+  bool can_upgradable() const { return can_read() && !active_upgrader; }
+
+  bool can_write() const {
+    return active_readers == 0 && active_writers == 0 && !active_upgrader;
+  }
 
  public:
   FairRWLock() = default;
@@ -21,5 +33,56 @@ class FairRWLock {
   void release_read() const;
   void acquire_write();
   void release_write();
+
+  // Upgradable read: shares the lock with plain readers but excludes writers
+  // and other upgraders, so upgrade() can switch to write without a gap.
+  // After upgrade() the lock must be released with release_write().
+  void acquire_upgradable();
+  void release_upgradable();
+  void upgrade();
+
+  bool try_acquire_read() const;
+  bool try_acquire_write();
+  bool try_acquire_upgradable();
+
+  template <typename Rep, typename Period>
+  bool acquire_read_for(
+      const std::chrono::duration<Rep, Period>& timeout) const {
+    return acquire_read_until(std::chrono::steady_clock::now() + timeout);
+  }
+
+  template <typename Clock, typename Duration>
+  bool acquire_read_until(
+      const std::chrono::time_point<Clock, Duration>& deadline) const {
+    std::unique_lock<std::mutex> lock(mtx);
+    if (!cv.wait_until(lock, deadline, [this]() { return can_read(); })) {
+      return false;
+    }
+    ++active_readers;
+    rwLock.lock_shared();
+    return true;
+  }
+
+  template <typename Rep, typename Period>
+  bool acquire_write_for(const std::chrono::duration<Rep, Period>& timeout) {
+    return acquire_write_until(std::chrono::steady_clock::now() + timeout);
+  }
+
+  template <typename Clock, typename Duration>
+  bool acquire_write_until(
+      const std::chrono::time_point<Clock, Duration>& deadline) {
+    std::unique_lock<std::mutex> lock(mtx);
+    ++waiting_writers;
+    if (!cv.wait_until(lock, deadline, [this]() { return can_write(); })) {
+      // Readers may be parked behind us
+      --waiting_writers;
+      cv.notify_all();
+      return false;
+    }
+    --waiting_writers;
+    ++active_writers;
+    rwLock.lock();
+    return true;
+  }
 };
 }  // namespace cpputils
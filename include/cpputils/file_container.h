@@ -1,30 +1,258 @@
 #pragma once
 
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <filesystem>
-#include <map>
-#include <mutex>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
 #include <optional>
 #include <string>
 #include <string_view>
+#include <utility>
+#include <vector>
 
 namespace cpputils {
+
+// Version of a file on disk
+struct FileStamp {
+  int64_t mtime_ns = -1;  // -1 when the file does not exist
+  uint64_t size = 0;
+
+  static FileStamp Of(const std::filesystem::path& file_path);
+
+  bool operator==(const FileStamp& other) const {
+    return mtime_ns == other.mtime_ns && size == other.size;
+  }
+  bool operator!=(const FileStamp& other) const { return !(*this == other); }
+};
+
+// Immutable file contents, either owned or memory-mapped
+class FileBuffer {
+ public:
+  // Missing or unreadable files give an empty buffer
+  static std::shared_ptr<const FileBuffer> Read(
+      const std::filesystem::path& file_path);
+  // Falls back to Read for empty files and when mmap fails
+  static std::shared_ptr<const FileBuffer> Map(
+      const std::filesystem::path& file_path);
+  static std::shared_ptr<const FileBuffer> FromString(std::string content);
+
+  FileBuffer(const FileBuffer&) = delete;
+  FileBuffer& operator=(const FileBuffer&) = delete;
+  ~FileBuffer();
+
+  std::string_view view() const { return {data_, size_}; }
+  bool mapped() const { return mapped_; }
+  // The file version read, nullopt for FromString
+  const std::optional<FileStamp>& stamp() const { return stamp_; }
+
+ private:
+  friend class FileContainer;
+
+  FileBuffer(std::string content, std::optional<FileStamp> stamp);
+  FileBuffer(const char* data, size_t size, FileStamp stamp);
+  // Slice of a mapping owned by someone else, e.g. a snapshot
+  FileBuffer(const char* data, size_t size, std::shared_ptr<const void> owner,
+             std::optional<FileStamp> stamp);
+
+  std::string owned_;
+  const char* data_;
+  size_t size_;
+  bool mapped_;
+  std::shared_ptr<const void> owner_;
+  std::optional<FileStamp> stamp_;
+};
+
+// Shared read-only view of a cached file. The contents stay valid while the
+// view exists, even if the cache entry is replaced in the meantime.
+// Mapped files are not copied, truncating one on disk while it is viewed
+// raises SIGBUS on access.
+class FileView {
+ public:
+  FileView() = default;
+  explicit FileView(std::shared_ptr<const FileBuffer> buffer)
+      : buffer_(std::move(buffer)) {}
+
+  std::string_view view() const {
+    return buffer_ ? buffer_->view() : std::string_view{};
+  }
+  operator std::string_view() const { return view(); }
+  const char* data() const { return view().data(); }
+  size_t size() const { return view().size(); }
+  bool empty() const { return view().empty(); }
+  std::string str() const { return std::string(view()); }
+
+  const std::shared_ptr<const FileBuffer>& buffer() const { return buffer_; }
+
+ private:
+  std::shared_ptr<const FileBuffer> buffer_;
+};
+
+enum class FileLoadMode {
+  Read,  // Files are read into owned memory
+  Mmap,  // Files are memory-mapped, hits and misses never copy the contents
+};
+
+enum class EvictionPolicy {
+  LRU,     // Least recently used
+  S3FIFO,  // Scan resistant: new files enter a small FIFO and only the ones
+           // hit again while in there are promoted to the main queue
+};
+
+enum class FileWatchMode {
+  None,     // Contents are served as cached until SetFileContent
+  Inotify,  // Changed files are reloaded in the background, deleted ones
+            // dropped. Falls back to Poll where inotify is unavailable.
+  Poll,     // Hits compare the file mtime and size, at most once per
+            // poll_interval for each entry, and reload in the background
+};
+
+struct FileContainerOptions {
+  FileLoadMode mode = FileLoadMode::Read;
+  EvictionPolicy eviction = EvictionPolicy::LRU;
+  // 0 is unlimited. Budgets are enforced per shard, each of the 16 shards
+  // gets a 16th of the limit rounded down, but at least 1. The cache stays
+  // within limits of 16 or more, smaller ones still allow 1 per shard.
+  // Files larger than the byte budget of a shard are returned but not
+  // cached.
+  // Views handed out keep evicted contents alive outside of the budget.
+  size_t max_bytes = 0;
+  size_t max_entries = 0;
+  // Reloads are swapped in whole, readers keep the old contents until then.
+  // Mapped files must be replaced by rename for that to hold, in-place
+  // writes show through the mapping. Only cached entries are reloaded,
+  // names are paths relative to the folder as written to disk.
+  FileWatchMode watch = FileWatchMode::None;
+  std::chrono::milliseconds poll_interval{1000};
+  // Pack written by SaveSnapshot, served before reading the folder. Files
+  // missing from it, or failing their checksum, come from the folder.
+  std::filesystem::path snapshot;
+  // Check each packed file against its CRC-32 on first use
+  bool verify_snapshot = true;
+  // Pool for Preload and batched reads, started on first use.
+  // 0 is std::thread::hardware_concurrency().
+  size_t io_threads = 0;
+  // Resource for the cache bookkeeping: entries, their names, index and
+  // pending read nodes, e.g. memory::pool_resource(). File contents are not
+  // allocated from it. nullptr is std::pmr::get_default_resource().
+  // It must be thread-safe and outlive the container, shards allocate from
+  // it concurrently under their own mutexes. memory::ArenaResource and
+  // std::pmr::unsynchronized_pool_resource are not thread-safe.
+  std::pmr::memory_resource* memory = nullptr;
+};
+
+struct FileContainerStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t evictions = 0;
+  size_t entries = 0;
+  size_t bytes = 0;
+};
+
+struct PreloadResult {
+  size_t files = 0;
+  uint64_t bytes = 0;
+};
+
+// Path relative to the folder, returns whether to load the file
+using PreloadFilter = std::function<bool(const std::filesystem::path&)>;
+using PreloadProgress =
+    std::function<void(size_t done, size_t total, uint64_t bytes)>;
+
+// Thread-safe file cache. Entries are spread over shards with their own
+// mutex, and disk reads happen outside of every lock, so a slow read never
+// blocks hits on other files. Concurrent misses on one file share a single
+// read.
 class FileContainer {
  private:
-  std::map<std::string, std::string> data;
+  using BufferPtr = std::shared_ptr<const FileBuffer>;
+
+  static constexpr size_t shard_count = 16;
+
+  struct Shard;
+  struct Watcher;
+  struct IoPool;
+  struct Snapshot;
+  std::vector<std::unique_ptr<Shard>> shards;
   const std::filesystem::path abs_path;
-  std::mutex mtx;
+  const FileContainerOptions options;
+  std::unique_ptr<IoPool> io_pool;
+  std::shared_ptr<const Snapshot> snapshot;
+  // Last member, its threads stop before the shards go away
+  std::unique_ptr<Watcher> watcher;
+
+  Shard& shard_for(std::string_view filename) const;
+
+  // Reads the folder, from_snapshot looks in the snapshot first
+  BufferPtr load(std::string_view filename, bool from_snapshot = false) const;
 
-  static std::string read_file(const std::filesystem::path& file_path);
+  // Called by the watcher, only touch entries that are cached. Reads in
+  // progress are told to read again.
+  void reload(const std::string& filename);
+  void invalidate(const std::string& filename);
+  void invalidate_directory(const std::string& directory);
+  void reload_all();
+
+  // Runs job(0) ... job(count - 1) on the I/O pool and the calling thread,
+  // and waits for all of them. Inline when called from a job of the pool.
+  void run_parallel(size_t count, const std::function<void(size_t)>& job);
+  std::vector<FileView> get_views(const std::vector<std::string_view>& names);
 
  public:
-  explicit FileContainer(std::string_view folder)
-      : abs_path(std::filesystem::absolute(folder)) {}
+  explicit FileContainer(std::string_view folder,
+                         FileLoadMode Mode = FileLoadMode::Read);
+  FileContainer(std::string_view folder, const FileContainerOptions& Options);
+  ~FileContainer();
 
   // Returns cache or reads file then returns content
-  std::string GetFileContent(const std::string& filename);
+  std::string GetFileContent(std::string_view filename);
+
+  // Same as GetFileContent without copying the contents
+  FileView GetFileView(std::string_view filename);
+
+  // Looks up all names at once, the misses are read in parallel.
+  // Names is any range of things convertible to std::string_view.
+  template <typename Names>
+  std::vector<FileView> GetFileViews(const Names& names) {
+    return get_views(
+        std::vector<std::string_view>(std::begin(names), std::end(names)));
+  }
+
+  template <typename Names>
+  std::vector<std::string> GetFileContents(const Names& names) {
+    std::vector<std::string> contents;
+    for (const auto& view : GetFileViews(names)) {
+      contents.push_back(view.str());
+    }
+    return contents;
+  }
+
+  // Caches every regular file below directory (relative to the folder) that
+  // passes filter, reading them in parallel. progress is called from the
+  // reading threads after each file, concurrently and not necessarily in
+  // order of done, and may use the container.
+  PreloadResult Preload(std::string_view directory = "",
+                        const PreloadFilter& filter = nullptr,
+                        const PreloadProgress& progress = nullptr);
 
   // Updates cache either to the value of content or by reading the file
   std::string SetFileContent(std::string filename,
                              std::optional<std::string> content = std::nullopt);
+
+  FileContainerStats GetStats() const;
+
+  // Writes every cached file into one pack for FileContainerOptions::snapshot.
+  // Layout, in host byte order: a header, an index sorted by name, the
+  // names, then the contents from a page-aligned offset, each 64-byte
+  // aligned with its CRC-32 in the index. Written to a uniquely named
+  // temporary file, which is fsynced, renamed into place, and followed by
+  // an fsync of the directory. Returns false on I/O errors.
+  bool SaveSnapshot(const std::filesystem::path& pack_path) const;
+
+  // Whether the snapshot from the options was opened and passed validation
+  bool HasSnapshot() const { return snapshot != nullptr; }
 };
 }  // namespace cpputils
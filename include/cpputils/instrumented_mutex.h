@@ -13,9 +13,15 @@ typedef std::condition_variable condition_variable_t;
 #else
 
 #include <atomic>
-#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
 #include <thread>
 
+#include "lock_order.h"
+#include "lock_profiler.h"
+#include "trace_recorder.h"
+
 #ifdef SPDLOG_ACTIVE_LEVEL
 #include <spdlog/spdlog.h>
 #include <sstream>
@@ -41,13 +47,82 @@ namespace cpputils {
 
 typedef std::condition_variable_any condition_variable_t;
 
+#if defined(__GNUC__)
+#define CPPUTILS_MUTEX_INLINE __attribute__((always_inline)) inline
+#define CPPUTILS_MUTEX_NOINLINE __attribute__((noinline))
+#define CPPUTILS_CALLER_FILE __builtin_FILE()
+#define CPPUTILS_CALLER_LINE __builtin_LINE()
+#else
+#define CPPUTILS_MUTEX_INLINE inline
+#define CPPUTILS_MUTEX_NOINLINE
+#define CPPUTILS_CALLER_FILE nullptr
+#define CPPUTILS_CALLER_LINE 0
+#endif
+
+#ifndef MUTEX_SAMPLE_PERIOD
+#define MUTEX_SAMPLE_PERIOD 1
+#endif
+
+#ifndef MUTEX_STACK_SAMPLE_PERIOD
+#define MUTEX_STACK_SAMPLE_PERIOD 64
+#endif
+
+// Every instrumented_mutex reports into the lock_profiler registry under its
+// name, mutexes sharing a name are aggregated as one lock class. With lockdep
+// enabled the lock order between classes is validated as well. Unnamed
+// mutexes are named after the file and line they are constructed from, for
+// a member that is the constructor of the enclosing class (its head when
+// implicit), so members of one class share a class unless named.
+//
+// Only 1 in sample_period() acquisitions per thread is counted and has its
+// hold time measured, the others skip every clock read and shared counter.
+// Sampled acquisitions and hold times are weighted by the period.
+// Contended waits are always counted and timed. Only 1 in
+// stack_sample_period() of them per thread captures its call stack, a
+// backtrace() under the loader lock, weighted by that period in the
+// call-site counts.
+//
+// While trace::start() is active, waits and hold spans also go to the trace
+// timeline, named after the lock class.
 class instrumented_mutex {
  public:
-  instrumented_mutex() = default;
+  // Where a constructor was called from, taken as a default argument
+  struct site {
+    const char* file;
+    int line;
+
+    static constexpr site current(const char* file = CPPUTILS_CALLER_FILE,
+                                  int line = CPPUTILS_CALLER_LINE) {
+      return {file, line};
+    }
+  };
+
+  instrumented_mutex(site where = site::current())
+      : stats_(&lock_profiler::register_lock(site_name(where))) {}
+  explicit instrumented_mutex(std::string_view name)
+      : stats_(&lock_profiler::register_lock(name)) {}
   instrumented_mutex(const instrumented_mutex&) = delete;
   instrumented_mutex& operator=(const instrumented_mutex&) = delete;
 
-  void lock() {
+  // 1 times every acquisition, the default comes from MUTEX_SAMPLE_PERIOD
+  static void set_sample_period(uint32_t period) {
+    sample_period_.store(period == 0 ? 1 : period, std::memory_order_relaxed);
+  }
+
+  static uint32_t sample_period() {
+    return sample_period_.load(std::memory_order_relaxed);
+  }
+
+  // 0 captures no stacks, the default comes from MUTEX_STACK_SAMPLE_PERIOD
+  static void set_stack_sample_period(uint32_t period) {
+    stack_sample_period_.store(period, std::memory_order_relaxed);
+  }
+
+  static uint32_t stack_sample_period() {
+    return stack_sample_period_.load(std::memory_order_relaxed);
+  }
+
+  CPPUTILS_MUTEX_INLINE void lock() {
     const auto self = std::this_thread::get_id();
 
     if (owner_.load(std::memory_order_relaxed) == self) {
@@ -57,13 +132,16 @@ class instrumented_mutex {
 #endif
     }
 
-    if (!mtx_.try_lock()) {
-      log_contention(self);
-      mtx_.lock();
+    const uint32_t weight = next_sample();
+    if (lockdep::enabled()) {
+      lock_validated();
+    } else if (!mtx_.try_lock()) {
+      lock_contended();
     }
 
     owner_.store(self, std::memory_order_relaxed);
-    locked_at_ = now_ms();
+    record_acquired(weight);
+    CPPUTILS_TRACE(begin, stats_->name().c_str(), "lock_held", 0);
   }
 
   bool try_lock() {
@@ -78,8 +156,12 @@ class instrumented_mutex {
     }
 
     if (mtx_.try_lock()) {
+      if (lockdep::enabled()) {
+        lockdep::acquired(*stats_);
+      }
       owner_.store(self, std::memory_order_relaxed);
-      locked_at_ = now_ms();
+      record_acquired(next_sample());
+      CPPUTILS_TRACE(begin, stats_->name().c_str(), "lock_held", 0);
       return true;
     }
 
@@ -105,6 +187,16 @@ class instrumented_mutex {
 #endif
     }
 
+    const int64_t locked_at = locked_at_.load(std::memory_order_relaxed);
+    if (locked_at != 0) {
+      stats_->record_hold(
+          static_cast<uint64_t>(lock_profiler::now_ns() - locked_at),
+          hold_weight_);
+    }
+    if (lockdep::enabled()) {
+      lockdep::released(*stats_);
+    }
+    CPPUTILS_TRACE(end, stats_->name().c_str(), "lock_held", 0);
     owner_.store(std::thread::id{}, std::memory_order_relaxed);
     mtx_.unlock();
   }
@@ -120,12 +212,97 @@ class instrumented_mutex {
  private:
   std::mutex mtx_;
   std::atomic<std::thread::id> owner_{};
-  std::atomic<int64_t> locked_at_{0};
+  std::atomic<int64_t> locked_at_{0};  // 0 when the acquisition is unsampled
+  uint32_t hold_weight_ = 0;  // Weight of the sampled acquisition, owner only
+  lock_profiler::lock_stats* stats_;
+
+  inline static std::atomic<uint32_t> sample_period_{MUTEX_SAMPLE_PERIOD};
+  inline static std::atomic<uint32_t> stack_sample_period_{
+      MUTEX_STACK_SAMPLE_PERIOD};
+
+  // Per-thread countdown shared by all mutexes. Returns the number of
+  // acquisitions a sampled one stands for, 0 when not sampled.
+  static uint32_t next_sample() {
+    thread_local uint32_t countdown = 0;
+    if (countdown != 0) {
+      --countdown;
+      return 0;
+    }
+    const uint32_t period = sample_period_.load(std::memory_order_relaxed);
+    countdown = period - 1;
+    return period;
+  }
 
-  static int64_t now_ms() {
-    return std::chrono::duration_cast<std::chrono::milliseconds>(
-               std::chrono::system_clock::now().time_since_epoch())
-        .count();
+  // Same for stack captures on contended waits, 0 when not captured
+  static uint32_t next_stack_sample() {
+    thread_local uint32_t countdown = 0;
+    if (countdown != 0) {
+      --countdown;
+      return 0;
+    }
+    const uint32_t period =
+        stack_sample_period_.load(std::memory_order_relaxed);
+    countdown = period == 0 ? 0 : period - 1;
+    return period;
+  }
+
+  void record_acquired(uint32_t weight) {
+    if (weight == 0) {
+      locked_at_.store(0, std::memory_order_relaxed);
+      return;
+    }
+    stats_->record_acquire(weight);
+    hold_weight_ = weight;
+    locked_at_.store(lock_profiler::now_ns(), std::memory_order_relaxed);
+  }
+
+  // Slow paths stay out of line to keep the inlined lock() small
+  CPPUTILS_MUTEX_NOINLINE void lock_contended() {
+    // The stack is walked before blocking, not while holding the lock and
+    // not as part of the measured wait
+    const uint32_t stack_weight = next_stack_sample();
+    lock_profiler::call_stack stack{};
+    if (stack_weight != 0) {
+      stack = lock_profiler::capture_stack();
+    }
+    CPPUTILS_TRACE(begin, stats_->name().c_str(), "lock_wait", 0);
+    const int64_t wait_start = lock_profiler::now_ns();
+    mtx_.lock();
+    const auto waited =
+        static_cast<uint64_t>(lock_profiler::now_ns() - wait_start);
+    CPPUTILS_TRACE(end, stats_->name().c_str(), "lock_wait", waited);
+    stats_->record_wait(waited, stack_weight != 0 ? &stack : nullptr,
+                        stack_weight);
+  }
+
+  CPPUTILS_MUTEX_NOINLINE void lock_validated() {
+    // Checked before blocking, so an inversion is reported even when it
+    // does deadlock right away
+    if (!lockdep::check_acquire(*stats_)) {
+      log_lock_order_violation(lockdep::first_report());
+#ifdef MUTEX_TERMINATE
+      std::terminate();
+#endif
+    }
+    if (!mtx_.try_lock()) {
+      lock_contended();
+    }
+    lockdep::acquired(*stats_);
+  }
+
+  static std::string site_name(const site& where) {
+    if (where.file == nullptr) {
+      return "unnamed";
+    }
+    return std::string(where.file) + ":" + std::to_string(where.line);
+  }
+
+  static void log_lock_order_violation(const std::string& report) {
+#ifdef SPDLOG_ACTIVE_LEVEL
+    SPDLOG_LOGGER_ERROR(spdlog::default_logger(), "[Lock Order] {}", report);
+#else
+    std::cerr << "[Lock Order] " << report;
+#endif
   }
 
   static void log_recursive_lock(const std::thread::id& self) {
@@ -150,15 +327,6 @@ class instrumented_mutex {
 #endif
   }
 
-  static void log_contention(const std::thread::id& self) {
-#ifdef SPDLOG_ACTIVE_LEVEL
-    SPDLOG_LOGGER_TRACE(spdlog::default_logger(),
-                        "[Lock Contention] Thread {} waiting for mutex", self);
-#else
-    std::cout << "[Lock Contention] Thread " << self << " waiting for mutex\n";
-#endif
-  }
-
   static void log_unlock_unlocked(const std::thread::id& self) {
 #ifdef SPDLOG_ACTIVE_LEVEL
     SPDLOG_LOGGER_WARN(
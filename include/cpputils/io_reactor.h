@@ -0,0 +1,117 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "task_scheduler.h"
+
+namespace cpputils {
+
+enum class IoEvents : uint32_t {
+  None = 0,
+  Read = 1 << 0,
+  Write = 1 << 1,
+  Hangup = 1 << 2,  // Peer closed its end, reported without asking
+  Error = 1 << 3,   // Reported without asking
+};
+
+constexpr IoEvents operator|(IoEvents a, IoEvents b) {
+  return static_cast<IoEvents>(static_cast<uint32_t>(a) |
+                               static_cast<uint32_t>(b));
+}
+
+constexpr IoEvents operator&(IoEvents a, IoEvents b) {
+  return static_cast<IoEvents>(static_cast<uint32_t>(a) &
+                               static_cast<uint32_t>(b));
+}
+
+constexpr bool has_event(IoEvents events, IoEvents event) {
+  return (events & event) != IoEvents::None;
+}
+
+enum class IoTrigger {
+  Level,  // The callback runs while the fd is ready
+  Edge,   // The callback runs when new data or room arrives, it has to
+          // read or write until EAGAIN or it may not be called again
+};
+
+// Called with the fd and what it is ready for
+using IoCallback = std::function<void(int, IoEvents)>;
+
+// epoll loop on a thread of its own, handing readiness callbacks to a
+// TaskScheduler so its workers never block in read or write. Every fd is
+// armed one-shot and re-armed once its callback returns, so callbacks for
+// one fd never overlap however many workers there are. Up to max_events
+// readiness events are taken per epoll_wait. A full scheduler queue holds
+// up the reactor until a worker frees a place. Linux only.
+class IoReactor {
+ public:
+  // Callbacks and posted tasks run on scheduler, which must outlive the
+  // reactor, or on the reactor thread when it is nullptr.
+  // nullptr when epoll or eventfd cannot be created.
+  static std::unique_ptr<IoReactor> Create(TaskScheduler<void>* scheduler,
+                                           size_t max_events = 256);
+
+  IoReactor(const IoReactor&) = delete;
+  IoReactor& operator=(const IoReactor&) = delete;
+  ~IoReactor();
+
+  // Watches fd, which should be non-blocking. Returns false with errno set
+  // when fd is already watched or epoll rejects it. From any thread,
+  // callbacks included.
+  bool add(int fd, IoEvents events, IoCallback callback,
+           IoTrigger trigger = IoTrigger::Level);
+  // Changes what fd is watched for, taking effect after a running callback
+  bool modify(int fd, IoEvents events);
+  // Stops watching fd without closing it. A running callback finishes, no
+  // other one starts. Remove before closing, epoll forgets closed fds on
+  // its own only once every duplicate is closed.
+  bool remove(int fd);
+
+  // Queues task for the reactor and wakes it through the eventfd, the task
+  // is then dispatched like a callback. From any thread.
+  void post(std::function<void()> task);
+
+  // Stops the loop and waits for it, callbacks already handed to the
+  // scheduler still run. The destructor stops and also waits for those.
+  void stop();
+
+  size_t watched() const;
+
+ private:
+  struct Watch;
+
+  IoReactor(TaskScheduler<void>* scheduler, size_t max_events, int epoll_fd,
+            int wake_fd);
+
+  void loop();
+  void dispatch(std::function<void()> task);
+  void run_callback(const std::shared_ptr<Watch>& watch, uint32_t ready);
+  bool arm(Watch& watch, int op);
+
+  TaskScheduler<void>* const scheduler;
+  const size_t max_events;
+  const int epoll_fd;
+  const int wake_fd;
+
+  mutable std::mutex mtx;
+  std::unordered_map<int, std::shared_ptr<Watch>> watches;
+  uint32_t next_generation = 0;
+  std::vector<std::function<void()>> posted;
+  // Callbacks and tasks handed out but not finished yet
+  size_t in_flight = 0;
+  std::condition_variable idle;
+
+  std::atomic<bool> stopping{false};
+  std::thread thread;
+};
+
+}  // namespace cpputils
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "lock_profiler.h"
+
+namespace cpputils {
+namespace lockdep {
+
+// Lock-order validator: every thread keeps a stack of the lock classes it
+// holds, and every "acquire B while holding A" adds the edge A -> B to a
+// global graph. The first edge closing a cycle is reported, before the
+// threads involved ever deadlock.
+// Edges live in a bit matrix, so checking an already known edge is a
+// lock-free load (and a thread-local cache hit after the first time); only
+// new edges take a global mutex.
+
+// Lock classes with a higher id (lock_stats::id) are not validated
+constexpr uint32_t max_classes = 1024;
+
+// Deeper nesting is not tracked
+constexpr size_t max_held = 32;
+
+namespace detail {
+#ifdef MUTEX_LOCKDEP
+inline std::atomic<bool> enabled{true};
+#else
+inline std::atomic<bool> enabled{false};
+#endif
+}  // namespace detail
+
+// Opt-in at runtime, or at compile time with MUTEX_LOCKDEP
+inline void enable(bool on = true) {
+  detail::enabled.store(on, std::memory_order_relaxed);
+}
+
+inline bool enabled() {
+  return detail::enabled.load(std::memory_order_relaxed);
+}
+
+// Called before blocking on a lock of the given class. Returns false when
+// this acquisition closed the first lock-order cycle, see first_report().
+bool check_acquire(const lock_profiler::lock_stats& lock);
+
+// Track the held-lock stack of the calling thread
+void acquired(const lock_profiler::lock_stats& lock);
+void released(const lock_profiler::lock_stats& lock);
+
+// Description of the first cycle with the call stacks of both acquisition
+// chains, empty when none was found
+std::string first_report();
+
+}  // namespace lockdep
+}  // namespace cpputils
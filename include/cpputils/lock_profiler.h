@@ -0,0 +1,151 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "clock.h"
+
+namespace cpputils {
+namespace lock_profiler {
+
+// Wait and hold times go into log2 nanosecond buckets, bucket i covers
+// [2^i, 2^(i+1)) ns and the last one also collects everything above
+constexpr size_t histogram_buckets = 32;
+
+// Contended waits are attributed to at most this many call stacks per lock
+// class, the rest is counted as "other"
+constexpr size_t max_call_sites = 16;
+
+// Frames kept per call stack, enough to get past the mutex and guard frames
+constexpr size_t site_depth = 8;
+
+using call_stack = std::array<uintptr_t, site_depth>;
+
+// Return addresses from the caller upwards, all zero where unsupported
+call_stack capture_stack();
+
+// One frame per line, symbolized where possible
+std::string format_stack(const call_stack& stack, std::string_view indent);
+
+inline int64_t now_ns() {
+  return clocks::tsc::now_ns();
+}
+
+class histogram {
+ public:
+  static size_t bucket_of(uint64_t ns) {
+    size_t bucket = 63 - static_cast<size_t>(__builtin_clzll(ns | 1));
+    return bucket < histogram_buckets ? bucket : histogram_buckets - 1;
+  }
+
+  void record(uint64_t ns, uint64_t count = 1) {
+    buckets_[bucket_of(ns)].fetch_add(count, std::memory_order_relaxed);
+  }
+
+  // Upper bound (ns) of the bucket holding the given quantile (0..1)
+  uint64_t quantile(double q) const;
+  std::array<uint64_t, histogram_buckets> counts() const;
+  void reset();
+
+ private:
+  std::array<std::atomic<uint64_t>, histogram_buckets> buckets_{};
+};
+
+struct call_site {
+  std::atomic<uint64_t> key{0};
+  std::array<std::atomic<uintptr_t>, site_depth> frames{};
+  std::atomic<uint64_t> waits{0};
+  std::atomic<uint64_t> wait_ns{0};
+};
+
+// Statistics of one lock class, every mutex constructed with the same name
+// shares it. Entries are never removed so references stay valid.
+class lock_stats {
+ public:
+  lock_stats(std::string name, uint32_t id) : name_(std::move(name)), id_(id) {}
+  lock_stats(const lock_stats&) = delete;
+  lock_stats& operator=(const lock_stats&) = delete;
+
+  // weight is the sample period the acquisition stands for
+  void record_acquire(uint64_t weight = 1) {
+    acquisitions_.fetch_add(weight, std::memory_order_relaxed);
+  }
+
+  // Scaled by weight like record_acquire, so hold totals and percentiles
+  // stay comparable to the acquisition count
+  void record_hold(uint64_t ns, uint64_t weight = 1) {
+    total_hold_ns_.fetch_add(ns * weight, std::memory_order_relaxed);
+    hold_.record(ns, weight);
+  }
+
+  // Only called on the contended path, waits without a stack are counted
+  // but not attributed to a call site. weight is the stack sample period
+  // the attributed wait stands for.
+  void record_wait(uint64_t ns, const call_stack* stack, uint64_t weight = 1);
+
+  void reset();
+
+  const std::string& name() const { return name_; }
+  uint32_t id() const { return id_; }
+
+ private:
+  friend struct lock_snapshot;
+
+  const std::string name_;
+  const uint32_t id_;
+  std::atomic<uint64_t> acquisitions_{0};
+  std::atomic<uint64_t> contentions_{0};
+  std::atomic<uint64_t> total_wait_ns_{0};
+  std::atomic<uint64_t> max_wait_ns_{0};
+  std::atomic<uint64_t> total_hold_ns_{0};
+  std::atomic<uint64_t> other_site_waits_{0};
+  histogram wait_;
+  histogram hold_;
+  std::array<call_site, max_call_sites> sites_{};
+};
+
+struct site_snapshot {
+  call_stack stack;
+  uint64_t waits;
+  uint64_t wait_ns;
+};
+
+// Plain copy of a lock_stats for reporting
+struct lock_snapshot {
+  explicit lock_snapshot(const lock_stats& stats);
+
+  std::string name;
+  uint64_t acquisitions;
+  uint64_t contentions;
+  uint64_t total_wait_ns;
+  uint64_t max_wait_ns;
+  uint64_t total_hold_ns;
+  uint64_t other_site_waits;
+  std::array<uint64_t, histogram_buckets> wait_histogram;
+  std::array<uint64_t, histogram_buckets> hold_histogram;
+  uint64_t wait_p50_ns;
+  uint64_t wait_p99_ns;
+  uint64_t hold_p50_ns;
+  uint64_t hold_p99_ns;
+  std::vector<site_snapshot> top_sites;  // Sorted by wait_ns, descending
+};
+
+// Returns the stats of the lock class called name, creating it on first use
+lock_stats& register_lock(std::string_view name);
+
+// All lock classes sorted by total wait time, hottest first
+std::vector<lock_snapshot> snapshot();
+
+// Reports of the top_n hottest locks, 0 means all of them
+std::string dump_text(size_t top_n = 10);
+std::string dump_json(size_t top_n = 10);
+
+void reset();
+
+}  // namespace lock_profiler
+}  // namespace cpputils
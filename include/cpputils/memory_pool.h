@@ -0,0 +1,327 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace cpputils {
+namespace memory {
+
+namespace detail {
+struct free_block {
+  free_block* next;
+};
+
+// Blocks are 16-byte multiples up to 128 bytes, then 128-byte multiples up
+// to max_pooled_size. Larger or over-aligned requests go to operator new.
+constexpr size_t size_class_count = 15;
+constexpr size_t max_pooled_size = 1024;
+constexpr size_t pool_alignment = 16;
+
+constexpr size_t size_class_of(size_t bytes) {
+  return bytes <= 128 ? (std::max<size_t>(bytes, 1) + 15) / 16 - 1
+                      : 6 + (bytes + 127) / 128;
+}
+
+constexpr size_t class_size(size_t size_class) {
+  return size_class < 8 ? (size_class + 1) * 16 : (size_class - 6) * 128;
+}
+
+// Blocks moved between a thread cache and the shared lists at once, the
+// cache holds at most twice as many
+constexpr uint32_t batch_size(size_t size_class) {
+  return static_cast<uint32_t>(
+      std::clamp<size_t>(16384 / class_size(size_class), 8, 64));
+}
+
+struct thread_cache {
+  free_block* head;
+  uint32_t count;
+};
+
+// Trivial so the fast paths need no TLS init check, the thread is flushed
+// at exit by an object registered on its first refill or free
+extern thread_local thread_cache caches[size_class_count];
+extern thread_local bool flush_registered;
+
+void register_flush();
+void* refill(size_t size_class);
+void drain(size_t size_class);
+}  // namespace detail
+
+// Fixed-size blocks in 15 size classes, cached per thread. The fast paths
+// are a push or pop on a thread_local free list, only every batch_size-th
+// call takes the lock of the shared list of its class. Memory freed on
+// another thread than it came from joins that thread's cache. Blocks are
+// carved from 64KiB chunks that are never given back to the system, a
+// thread's cache returns to the shared lists when it exits.
+class ThreadCachingPool {
+ public:
+  static void* allocate(size_t bytes,
+                        size_t alignment = alignof(std::max_align_t)) {
+    if (bytes > detail::max_pooled_size ||
+        alignment > detail::pool_alignment) {
+      return ::operator new(bytes, std::align_val_t(alignment));
+    }
+    const size_t size_class = detail::size_class_of(bytes);
+    detail::thread_cache& cache = detail::caches[size_class];
+    detail::free_block* block = cache.head;
+    if (block == nullptr) {
+      return detail::refill(size_class);
+    }
+    cache.head = block->next;
+    --cache.count;
+    return block;
+  }
+
+  static void deallocate(void* p, size_t bytes,
+                         size_t alignment = alignof(std::max_align_t)) {
+    if (bytes > detail::max_pooled_size ||
+        alignment > detail::pool_alignment) {
+      ::operator delete(p, std::align_val_t(alignment));
+      return;
+    }
+    // A thread that only frees still hands its cache back when it exits
+    if (!detail::flush_registered) {
+      detail::register_flush();
+    }
+    const size_t size_class = detail::size_class_of(bytes);
+    detail::thread_cache& cache = detail::caches[size_class];
+    auto* block = static_cast<detail::free_block*>(p);
+    block->next = cache.head;
+    cache.head = block;
+    if (++cache.count > 2 * detail::batch_size(size_class)) {
+      detail::drain(size_class);
+    }
+  }
+
+  // Returns every block cached by the calling thread to the shared lists
+  static void flush_thread_cache();
+};
+
+// Typed front end of ThreadCachingPool, for objects created and destroyed
+// one at a time
+template <typename T>
+class ObjectPool {
+ public:
+  struct Deleter {
+    void operator()(T* object) const noexcept { destroy(object); }
+  };
+  using Ptr = std::unique_ptr<T, Deleter>;
+
+  template <typename... Args>
+  static T* create(Args&&... args) {
+    void* storage = ThreadCachingPool::allocate(sizeof(T), alignof(T));
+    try {
+      return ::new (storage) T(std::forward<Args>(args)...);
+    } catch (...) {
+      ThreadCachingPool::deallocate(storage, sizeof(T), alignof(T));
+      throw;
+    }
+  }
+
+  static void destroy(T* object) noexcept {
+    if (object != nullptr) {
+      object->~T();
+      ThreadCachingPool::deallocate(object, sizeof(T), alignof(T));
+    }
+  }
+
+  template <typename... Args>
+  static Ptr make(Args&&... args) {
+    return Ptr(create(std::forward<Args>(args)...));
+  }
+};
+
+// Stateless std allocator over ThreadCachingPool. Node containers and
+// std::allocate_shared get their nodes from the pool, arrays larger than
+// max_pooled_size bytes come from operator new.
+template <typename T>
+class PoolAllocator {
+ public:
+  using value_type = T;
+  using is_always_equal = std::true_type;
+
+  PoolAllocator() noexcept = default;
+  template <typename U>
+  PoolAllocator(const PoolAllocator<U>&) noexcept {}
+
+  T* allocate(size_t n) {
+    if (n > std::numeric_limits<size_t>::max() / sizeof(T)) {
+      throw std::bad_array_new_length();
+    }
+    return static_cast<T*>(
+        ThreadCachingPool::allocate(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T* p, size_t n) noexcept {
+    ThreadCachingPool::deallocate(p, n * sizeof(T), alignof(T));
+  }
+
+  template <typename U>
+  bool operator==(const PoolAllocator<U>&) const noexcept {
+    return true;
+  }
+  template <typename U>
+  bool operator!=(const PoolAllocator<U>&) const noexcept {
+    return false;
+  }
+};
+
+// Bump allocator for objects that all die together. deallocate is a no-op,
+// reset() frees everything at once. Chunks double from InitialChunk up to
+// 1MiB, larger requests get a chunk of their own. Not thread-safe.
+class MonotonicArena {
+ public:
+  explicit MonotonicArena(size_t InitialChunk = 4096)
+      : next_chunk(std::max<size_t>(InitialChunk, 256)) {}
+  // Starts in buffer, which the arena does not own and never frees
+  MonotonicArena(void* buffer, size_t size)
+      : next_chunk(std::max<size_t>(size, 256)),
+        cursor(static_cast<char*>(buffer)),
+        end(static_cast<char*>(buffer) + size),
+        initial(static_cast<char*>(buffer)),
+        initial_end(end) {}
+
+  MonotonicArena(const MonotonicArena&) = delete;
+  MonotonicArena& operator=(const MonotonicArena&) = delete;
+  ~MonotonicArena() { release(); }
+
+  void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t)) {
+    const auto address = reinterpret_cast<uintptr_t>(cursor);
+    const uintptr_t aligned = (address + alignment - 1) & ~(alignment - 1);
+    if (cursor != nullptr &&
+        aligned + bytes <= reinterpret_cast<uintptr_t>(end)) {
+      cursor = reinterpret_cast<char*>(aligned + bytes);
+      allocated += bytes;
+      return reinterpret_cast<void*>(aligned);
+    }
+    return grow(bytes, alignment);
+  }
+
+  void deallocate(void*, size_t, size_t = alignof(std::max_align_t)) noexcept {
+  }
+
+  template <typename T, typename... Args>
+  T* create(Args&&... args) {
+    return ::new (allocate(sizeof(T), alignof(T)))
+        T(std::forward<Args>(args)...);
+  }
+
+  // Forgets every allocation but keeps the newest chunk for reuse.
+  // Destructors of objects in the arena are not run.
+  void reset() noexcept {
+    if (chunks != nullptr) {
+      chunk* keep = chunks;
+      chunks = chunks->previous;
+      free_chunks();
+      keep->previous = nullptr;
+      chunks = keep;
+      cursor = reinterpret_cast<char*>(keep + 1);
+      end = reinterpret_cast<char*>(keep) + keep->size;
+    } else {
+      cursor = initial;
+      end = initial_end;
+    }
+    allocated = 0;
+  }
+
+  // Frees every chunk, back to the state after construction
+  void release() noexcept {
+    free_chunks();
+    cursor = initial;
+    end = initial_end;
+    allocated = 0;
+  }
+
+  // Bytes handed out since construction or the last reset
+  size_t bytes_allocated() const { return allocated; }
+
+ private:
+  struct alignas(std::max_align_t) chunk {
+    chunk* previous;
+    size_t size;
+  };
+
+  static constexpr size_t max_chunk = size_t{1} << 20;
+
+  size_t next_chunk;
+  size_t allocated = 0;
+  char* cursor = nullptr;
+  char* end = nullptr;
+  chunk* chunks = nullptr;  // Newest first
+  char* initial = nullptr;
+  char* initial_end = nullptr;
+
+  void* grow(size_t bytes, size_t alignment) {
+    const size_t needed = sizeof(chunk) + bytes + alignment;
+    const size_t size = std::max(next_chunk, needed);
+    auto* fresh = static_cast<chunk*>(::operator new(size));
+    fresh->previous = chunks;
+    fresh->size = size;
+    chunks = fresh;
+    if (size == next_chunk) {
+      next_chunk = std::min(next_chunk * 2, max_chunk);
+    }
+    cursor = reinterpret_cast<char*>(fresh + 1);
+    end = reinterpret_cast<char*>(fresh) + size;
+    return allocate(bytes, alignment);
+  }
+
+  void free_chunks() noexcept {
+    while (chunks != nullptr) {
+      chunk* previous = chunks->previous;
+      ::operator delete(chunks);
+      chunks = previous;
+    }
+  }
+};
+
+// std::pmr::memory_resource over anything with allocate(bytes, alignment)
+// and deallocate(p, bytes, alignment), e.g. PoolResource or ArenaResource
+// for std::pmr containers. Adapters of a stateless source compare equal.
+template <typename Source>
+class ResourceAdapter : public std::pmr::memory_resource {
+ public:
+  template <typename... Args>
+  explicit ResourceAdapter(Args&&... args)
+      : source(std::forward<Args>(args)...) {}
+
+  Source& get() { return source; }
+  const Source& get() const { return source; }
+
+ private:
+  Source source;
+
+  void* do_allocate(size_t bytes, size_t alignment) override {
+    return source.allocate(bytes, alignment);
+  }
+
+  void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+    source.deallocate(p, bytes, alignment);
+  }
+
+  bool do_is_equal(
+      const std::pmr::memory_resource& other) const noexcept override {
+    if constexpr (std::is_empty_v<Source>) {
+      return dynamic_cast<const ResourceAdapter*>(&other) != nullptr;
+    } else {
+      return this == &other;
+    }
+  }
+};
+
+using PoolResource = ResourceAdapter<ThreadCachingPool>;
+using ArenaResource = ResourceAdapter<MonotonicArena>;
+
+// Process-wide PoolResource, never destroyed
+std::pmr::memory_resource* pool_resource();
+
+}  // namespace memory
+}  // namespace cpputils
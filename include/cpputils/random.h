@@ -0,0 +1,135 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace cpputils {
+namespace rng {
+
+// 64-bit UniformRandomBitGenerators, small enough to keep one per thread.
+// Default constructors seed from the kernel CSPRNG.
+
+// Fills out from getrandom(), or /dev/urandom where that is unavailable.
+// Aborts when neither works, silently weak seeds are worse.
+void fill_secure(void* out, size_t size);
+
+namespace detail {
+// Bumped in the child on every fork() once fork_generation() registered
+// the handler. Self-seeded generators compare it with the value they were
+// seeded under.
+extern std::atomic<uint64_t> forks;
+uint64_t fork_generation();
+}  // namespace detail
+
+inline uint64_t splitmix64(uint64_t& state) {
+  uint64_t z = (state += 0x9E3779B97F4A7C15);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+  return z ^ (z >> 31);
+}
+
+// xoshiro256** (Blackman, Vigna). 32 bytes of state, ~1ns per value.
+// Not cryptographically secure.
+class xoshiro256ss {
+ public:
+  using result_type = uint64_t;
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return UINT64_MAX; }
+
+  xoshiro256ss() {
+    uint64_t seed;
+    fill_secure(&seed, sizeof(seed));
+    *this = xoshiro256ss(seed);
+  }
+
+  explicit xoshiro256ss(uint64_t seed) {
+    for (auto& word : s_) {
+      word = splitmix64(seed);
+    }
+  }
+
+  result_type operator()() {
+    const uint64_t result = rotl(s_[1] * 5, 7) * 9;
+    const uint64_t t = s_[1] << 17;
+    s_[2] ^= s_[0];
+    s_[3] ^= s_[1];
+    s_[1] ^= s_[2];
+    s_[0] ^= s_[3];
+    s_[2] ^= t;
+    s_[3] = rotl(s_[3], 45);
+    return result;
+  }
+
+ private:
+  std::array<uint64_t, 4> s_;
+
+  static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+};
+
+// wyrand (Wang Yi). 8 bytes of state, a counter through one 128-bit
+// multiply. Not cryptographically secure.
+class wyrand {
+ public:
+  using result_type = uint64_t;
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return UINT64_MAX; }
+
+  wyrand() { fill_secure(&state_, sizeof(state_)); }
+  explicit wyrand(uint64_t seed) : state_(seed) {}
+
+  result_type operator()() {
+    state_ += 0xA0761D6478BD642F;
+    const auto product = static_cast<unsigned __int128>(state_) *
+                         (state_ ^ 0xE7037ED1A0B428DB);
+    return static_cast<uint64_t>(product >> 64) ^
+           static_cast<uint64_t>(product);
+  }
+
+ private:
+  uint64_t state_;
+};
+
+// ChaCha20 keystream (RFC 7539 block function, 64-bit counter), for IDs
+// that must not be predictable. Keyed from the kernel, and keyed again on
+// the first value a fork() child draws, so parent and child never share
+// the stream. Explicitly keyed instances are never rekeyed.
+class chacha20 {
+ public:
+  using result_type = uint64_t;
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return UINT64_MAX; }
+
+  chacha20() { reseed(); }
+
+  explicit chacha20(const std::array<uint32_t, 8>& key, uint64_t nonce = 0)
+      : key_(key), nonce_(nonce) {}
+
+  result_type operator()() {
+    if (seeded_ &&
+        generation_ != detail::forks.load(std::memory_order_relaxed)) {
+      reseed();
+    }
+    if (position_ == block_.size()) {
+      refill();
+    }
+    return block_[position_++];
+  }
+
+ private:
+  std::array<uint32_t, 8> key_;
+  uint64_t nonce_;
+  uint64_t counter_ = 0;
+  std::array<uint64_t, 8> block_{};
+  size_t position_ = block_.size();
+  bool seeded_ = false;  // Keyed from the kernel
+  uint64_t generation_ = 0;
+
+  // Also drops what is left of the block
+  void reseed();
+  void refill();
+};
+
+}  // namespace rng
+}  // namespace cpputils
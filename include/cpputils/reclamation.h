@@ -0,0 +1,174 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+// Safe memory reclamation for lock-free structures: a node unlinked by a
+// writer is handed to retire instead of delete, and freed once no reader can
+// still be traversing it. Two schemes share the deleter convention:
+//
+// Epochs: readers wrap each traversal in an EpochGuard, a thread-local
+// store and a fence. Retired nodes are freed in batches once every pinned
+// thread has moved two epochs on. Cheapest for readers, but one stalled
+// reader holds back all garbage.
+//
+// Hazard pointers: readers publish each node they hold through a
+// HazardPointer. Costlier per node, but garbage stays bounded by the retire
+// threshold plus the number of hazard pointers, whatever readers do.
+//
+// Deleters may run on any thread, garbage left by exiting threads is
+// adopted by the next collection.
+
+namespace cpputils {
+namespace reclaim {
+
+using deleter_fn = void (*)(void*);
+
+template <typename T>
+void delete_object(void* p) {
+  delete static_cast<T*>(p);
+}
+
+namespace detail {
+struct alignas(64) epoch_record {
+  std::atomic<uint64_t> epoch{0};  // Global epoch when pinned, 0 when not
+  std::atomic<bool> in_use{false};
+  epoch_record* next = nullptr;
+  uint32_t nesting = 0;  // Only touched by the owning thread
+};
+
+extern std::atomic<uint64_t> global_epoch;
+// Trivial so guards need no TLS init check, set up by register_epoch_thread
+extern thread_local epoch_record* current_epoch_record;
+epoch_record* register_epoch_thread();
+
+struct alignas(64) hazard_slot {
+  std::atomic<const void*> pointer{nullptr};
+  std::atomic<bool> in_use{false};
+  hazard_slot* next = nullptr;
+};
+
+hazard_slot* acquire_hazard_slot();
+void release_hazard_slot(hazard_slot* slot);
+}  // namespace detail
+
+// Pins the calling thread to the current epoch for its lifetime. Nodes
+// reachable while pinned stay valid until the guard is gone. Nestable.
+class EpochGuard {
+ public:
+  EpochGuard() : record(detail::current_epoch_record) {
+    if (record == nullptr) {
+      record = detail::register_epoch_thread();
+    }
+    if (record->nesting++ == 0) {
+      record->epoch.store(detail::global_epoch.load(std::memory_order_relaxed),
+                          std::memory_order_relaxed);
+      // Collectors must see the pin before this thread reads any node
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+  }
+
+  ~EpochGuard() {
+    if (--record->nesting == 0) {
+      record->epoch.store(0, std::memory_order_release);
+    }
+  }
+
+  EpochGuard(const EpochGuard&) = delete;
+  EpochGuard& operator=(const EpochGuard&) = delete;
+
+ private:
+  detail::epoch_record* record;
+};
+
+// Frees p with deleter once every thread pinned now has unpinned. Call after
+// p is unreachable. Garbage is collected every 64 retires per thread.
+void epoch_retire(void* p, deleter_fn deleter);
+
+template <typename T>
+void epoch_retire(T* p) {
+  epoch_retire(const_cast<std::remove_cv_t<T>*>(p),
+               &delete_object<std::remove_cv_t<T>>);
+}
+
+// Waits for every thread pinned now to unpin, then frees what this thread
+// retired and the garbage of exited threads. Deadlocks inside an EpochGuard.
+void epoch_synchronize();
+
+// Owns one hazard slot. A pointer returned by protect stays valid until the
+// next protect or reset, or until the HazardPointer is destroyed.
+class HazardPointer {
+ public:
+  HazardPointer() : slot(detail::acquire_hazard_slot()) {}
+  ~HazardPointer() {
+    if (slot != nullptr) {
+      slot->pointer.store(nullptr, std::memory_order_release);
+      detail::release_hazard_slot(slot);
+    }
+  }
+
+  HazardPointer(HazardPointer&& other) noexcept
+      : slot(std::exchange(other.slot, nullptr)) {}
+  HazardPointer& operator=(HazardPointer&& other) noexcept {
+    std::swap(slot, other.slot);
+    return *this;
+  }
+
+  // Loads source and publishes the result, retrying until source still
+  // holds it, after which a retire can no longer free it
+  template <typename T>
+  T* protect(const std::atomic<T*>& source) {
+    T* p = source.load(std::memory_order_relaxed);
+    for (;;) {
+      slot->pointer.store(p, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      T* current = source.load(std::memory_order_acquire);
+      if (current == p) {
+        return p;
+      }
+      p = current;
+    }
+  }
+
+  // One attempt: publishes p, false when source no longer holds it, in
+  // which case p is updated to the new value and is not protected
+  template <typename T>
+  bool try_protect(T*& p, const std::atomic<T*>& source) {
+    T* expected = p;
+    slot->pointer.store(expected, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    p = source.load(std::memory_order_acquire);
+    if (p != expected) {
+      slot->pointer.store(nullptr, std::memory_order_release);
+      return false;
+    }
+    return true;
+  }
+
+  void reset() { slot->pointer.store(nullptr, std::memory_order_release); }
+
+ private:
+  detail::hazard_slot* slot;
+};
+
+// Frees p with deleter once no hazard pointer holds it. Call after p is
+// unreachable. Each thread scans the hazard pointers once its list reaches
+// twice their number (at least 64), so it never holds more than that plus
+// the number of hazard pointers.
+void hazard_retire(void* p, deleter_fn deleter);
+
+template <typename T>
+void hazard_retire(T* p) {
+  hazard_retire(const_cast<std::remove_cv_t<T>*>(p),
+                &delete_object<std::remove_cv_t<T>>);
+}
+
+// Frees whatever this thread and exited threads retired that is not
+// protected right now
+void hazard_reclaim();
+
+}  // namespace reclaim
+}  // namespace cpputils
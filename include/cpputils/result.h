@@ -1,12 +1,24 @@
 #pragma once
 
+#include <cstdint>
+#include <cstring>
 #include <exception>
+#include <memory>
 #include <optional>
 #include <stdexcept>
+#include <string>
 #include <type_traits>
+#include <typeinfo>
 #include <utility>
 #include <variant>
 
+// libstdc++ exposes the thrown type of an exception_ptr and the catch
+// matching of type_info (Itanium C++ ABI), so exceptions can be classified
+// without rethrowing. Elsewhere classification falls back to a rethrow.
+#if defined(__GLIBCXX__) && defined(__GXX_RTTI)
+#define RESULT_FAST_EXCEPTION_TYPES
+#endif
+
 #ifdef RESULT_ALLOW_EMPTY_STATE
 template <typename T = std::monostate>
 #else
@@ -22,6 +34,12 @@ struct Ok {
   explicit Ok(T&& val) : value(std::forward<T>(val)) {}
 };
 
+// return Ok<void>{} from a Result<void, E>
+template <>
+struct Ok<void> {
+  explicit Ok() = default;
+};
+
 template <typename E>
 struct Err {
   E error;
@@ -29,44 +47,403 @@ struct Err {
   explicit Err(E&& err) : error(std::forward<E>(err)) {}
 };
 
+// Construct the value or the error inside the Result from args, saving the
+// move out of an Ok / Err:
+//   return Result<Big, E>(in_place_ok, a, b);
+struct in_place_ok_t {
+  explicit in_place_ok_t() = default;
+};
+inline constexpr in_place_ok_t in_place_ok{};
+
+struct in_place_err_t {
+  explicit in_place_err_t() = default;
+};
+inline constexpr in_place_err_t in_place_err{};
+
+namespace result_detail {
+
+// Thrown object of an exception_ptr and its dynamic type
+struct exception_info {
+  const std::type_info* type = nullptr;
+  void* object = nullptr;
+};
+
+inline exception_info inspect(const std::exception_ptr& ept) noexcept {
+  exception_info info;
+#ifdef RESULT_FAST_EXCEPTION_TYPES
+  if (ept) {
+    // An exception_ptr is the address of the thrown object
+    static_assert(sizeof(ept) == sizeof(void*));
+    info.type = ept.__cxa_exception_type();
+    std::memcpy(&info.object, &ept, sizeof(void*));
+  }
+#else
+  (void)ept;
+#endif
+  return info;
+}
+
+// Whether catch (Exc&) would take the exception, storing what it would
+// bind to in caught. Never throws.
+template <typename Exc>
+bool catches(const std::exception_ptr& ept, const exception_info& info,
+             void*& caught) noexcept {
+  using Target = std::remove_cv_t<std::remove_reference_t<Exc>>;
+#ifdef RESULT_FAST_EXCEPTION_TYPES
+  (void)ept;
+  if (info.type == nullptr) {
+    return false;
+  }
+  const std::type_info& target = typeid(Target);
+  caught = info.object;
+  // Same adjustment as the personality routine: a thrown pointer is matched
+  // by its value, not by the address of the exception object holding it
+  if (info.type->__is_pointer_p()) {
+    caught = *static_cast<void**>(caught);
+  }
+  return target.__do_catch(info.type, &caught, 1);
+#else
+  (void)info;
+  if (!ept) {
+    return false;
+  }
+  try {
+    std::rethrow_exception(ept);
+  } catch (Target& e) {
+    caught = const_cast<void*>(static_cast<const void*>(std::addressof(e)));
+    return true;
+  } catch (...) {
+    return false;
+  }
+#endif
+}
+
+template <typename Exc>
+bool catches(const std::exception_ptr& ept) noexcept {
+  void* caught = nullptr;
+  return catches<Exc>(ept, inspect(ept), caught);
+}
+
+}  // namespace result_detail
+
+// Error holding an exception, its dynamic type is recorded once at
+// construction. Type checks and what() then cost a few compares along the
+// type's base classes, they never rethrow, throw or take locks.
 struct ExceptionError {
-  std::exception_ptr err;
+  ExceptionError(std::exception_ptr&& ept)
+      : ptr(std::move(ept)), info(result_detail::inspect(ptr)) {
+    void* caught = nullptr;
+    if (result_detail::catches<std::exception>(ptr, info, caught)) {
+      exception = static_cast<const std::exception*>(caught);
+    }
+  }
+
+  // Read-only, the recorded type describes it. Assign a whole
+  // ExceptionError to hold another exception.
+  const std::exception_ptr& err() const noexcept { return ptr; }
+
+  // The exception being handled, for use in a catch block
+  static ExceptionError current() {
+    return ExceptionError(std::current_exception());
+  }
+
+  // Whether catch (Exc&) would take the exception
+  template <typename Exc>
+  bool is() const noexcept {
+    void* caught = nullptr;
+    return result_detail::catches<Exc>(ptr, info, caught);
+  }
+
+  // The exception as catch (Exc&) would see it, nullptr when it would not
+  template <typename Exc>
+  const Exc* get() const noexcept {
+    static_assert(std::is_class_v<Exc>, "get() takes class types, use is()");
+    void* caught = nullptr;
+    return result_detail::catches<Exc>(ptr, info, caught)
+               ? static_cast<const Exc*>(caught)
+               : nullptr;
+  }
+
+  // std::exception::what(), or a fixed text for other thrown types
+  const char* what() const noexcept {
+    if (exception != nullptr) {
+      return exception->what();
+    }
+    return ptr ? "unknown exception" : "no exception";
+  }
 
-  ExceptionError(std::exception_ptr&& ept) : err(std::move(ept)) {}
+  // Dynamic type of the thrown object, nullptr when err() is empty or the
+  // type cannot be read without rethrowing
+  const std::type_info* type() const noexcept { return info.type; }
+
+  [[noreturn]] void rethrow() const { std::rethrow_exception(ptr); }
+
+ private:
+  std::exception_ptr ptr;
+  result_detail::exception_info info;
+  const std::exception* exception = nullptr;
 };
 
 template <typename T, typename E = ExceptionError, typename Enable = void>
-struct Result {
-  using value_type = T;
-  using error_type = E;
+struct Result;
+
+// Specialize with available = true for payloads that have spare
+// representations, Result<T, E> then keeps its error in them and is no
+// larger than T. A specialization provides
+//   using storage = ...;  // trivially copyable
+//   static storage from_value(T);
+//   static storage from_error(E);
+//   static bool is_error(storage);
+//   static T value(storage);
+//   static E error(storage);
+// Such Results return value() and error() by value and have no empty state.
+template <typename T, typename E, typename Enable = void>
+struct result_niche {
+  static constexpr bool available = false;
+};
 
-  template <typename Exc,
-            std::enable_if_t<std::is_same_v<error_type, ExceptionError> &&
-                                 std::is_same_v<Exc, Exc>,
-                             int> = 0>
+// Niche for pointers to types aligned to 2 or more, which never have the
+// low bit set. Errors that are small integers or enums are stored shifted
+// with the low bit set. Opt in per pair, the pointee may be incomplete
+// where the Result is only declared:
+//   template <>
+//   struct result_niche<Node*, Errc> : result_pointer_niche<Node*, Errc> {};
+// Layout never depends on the pointee, only on the specialization, which
+// has to be visible wherever the Result is used.
+template <typename P, typename E>
+struct result_pointer_niche {
+  static_assert(std::is_pointer_v<P>, "result_pointer_niche needs a pointer");
+  static_assert((std::is_enum_v<E> || std::is_integral_v<E>) &&
+                    sizeof(E) < sizeof(uintptr_t),
+                "result_pointer_niche needs an integer or enum error "
+                "narrower than a pointer");
+
+  static constexpr bool available = true;
+  using storage = uintptr_t;
+
+  static storage from_value(P value) {
+    using pointee = std::remove_cv_t<std::remove_pointer_t<P>>;
+    static_assert(!std::is_void_v<pointee>,
+                  "void pointers have no alignment to borrow a bit from");
+    static_assert(alignof(pointee) >= 2,
+                  "result_pointer_niche needs a pointee aligned to 2 or more");
+    return reinterpret_cast<uintptr_t>(value);
+  }
+  static storage from_error(E error) {
+    return static_cast<uintptr_t>(static_cast<intptr_t>(error)) << 1 | 1;
+  }
+  static bool is_error(storage bits) { return (bits & 1) != 0; }
+  static P value(storage bits) { return reinterpret_cast<P>(bits); }
+  static E error(storage bits) {
+    return static_cast<E>(static_cast<intptr_t>(bits) >> 1);
+  }
+};
+
+namespace result_detail {
+
+template <typename R>
+struct is_result : std::false_type {};
+template <typename T, typename E, typename Enable>
+struct is_result<Result<T, E, Enable>> : std::true_type {};
+
+template <typename T>
+using remove_cvref_t = std::remove_cv_t<std::remove_reference_t<T>>;
+
+// Calls func with the value of self, nothing for Result<void, E>, keeping
+// the value category of self
+template <typename Self, typename Func>
+decltype(auto) call_with_value(Self&& self, Func&& func) {
+  if constexpr (std::is_void_v<typename remove_cvref_t<Self>::value_type>) {
+    return std::forward<Func>(func)();
+  } else {
+    return std::forward<Func>(func)(std::forward<Self>(self).value());
+  }
+}
+
+template <typename Out, typename Self>
+Out value_into(Self&& self) {
+  if constexpr (std::is_void_v<typename remove_cvref_t<Self>::value_type>) {
+    return Out(in_place_ok);
+  } else {
+    return Out(in_place_ok, std::forward<Self>(self).value());
+  }
+}
+
+template <typename Self>
+void check_not_empty([[maybe_unused]] const Self& self, const char* what) {
+#ifdef RESULT_ALLOW_EMPTY_STATE
+  if (!self.has_value() && !self.has_error()) {
+    throw std::runtime_error(std::string("Called ") + what +
+                             "() on empty Result");
+  }
+#else
+  (void)what;
+#endif
+}
+
+template <typename Self, typename Func>
+auto map(Self&& self, Func&& func) {
+  using U = decltype(call_with_value(std::forward<Self>(self),
+                                     std::forward<Func>(func)));
+  using Out = Result<std::conditional_t<std::is_reference_v<U>, U,
+                                        std::remove_cv_t<U>>,
+                     typename remove_cvref_t<Self>::error_type>;
+  check_not_empty(self, "map");
+  if (!self.has_value()) {
+    return Out(in_place_err, std::forward<Self>(self).error());
+  }
+  if constexpr (std::is_void_v<U>) {
+    call_with_value(std::forward<Self>(self), std::forward<Func>(func));
+    return Out(in_place_ok);
+  } else {
+    return Out(in_place_ok, call_with_value(std::forward<Self>(self),
+                                            std::forward<Func>(func)));
+  }
+}
+
+template <typename Self, typename Func>
+auto and_then(Self&& self, Func&& func) {
+  using Out = remove_cvref_t<decltype(call_with_value(
+      std::forward<Self>(self), std::forward<Func>(func)))>;
+  static_assert(is_result<Out>::value, "and_then() must return a Result");
+  check_not_empty(self, "and_then");
+  if (!self.has_value()) {
+    return Out(in_place_err, std::forward<Self>(self).error());
+  }
+  return call_with_value(std::forward<Self>(self), std::forward<Func>(func));
+}
+
+template <typename Self, typename Func>
+auto or_else(Self&& self, Func&& func) {
+  using Out = remove_cvref_t<decltype(std::forward<Func>(func)(
+      std::forward<Self>(self).error()))>;
+  static_assert(is_result<Out>::value, "or_else() must return a Result");
+  check_not_empty(self, "or_else");
+  if (self.has_value()) {
+    return value_into<Out>(std::forward<Self>(self));
+  }
+  return std::forward<Func>(func)(std::forward<Self>(self).error());
+}
+
+template <typename Self, typename Func>
+auto map_err(Self&& self, Func&& func) {
+  using G = remove_cvref_t<decltype(std::forward<Func>(func)(
+      std::forward<Self>(self).error()))>;
+  using Out = Result<typename remove_cvref_t<Self>::value_type, G>;
+  check_not_empty(self, "map_err");
+  if (self.has_value()) {
+    return value_into<Out>(std::forward<Self>(self));
+  }
+  return Out(in_place_err,
+             std::forward<Func>(func)(std::forward<Self>(self).error()));
+}
+
+// Members shared by every Result layout. The && overloads move the payload
+// straight into the callback and the new Result.
+template <typename Derived>
+class result_base {
+ public:
+  template <typename Exc>
   bool contains_exception() const {
-    try {
-      std::rethrow_exception(unwrap_err().err);
-    } catch (Exc&) {
-      return true;
-    } catch (...) {
-      return false;
+    using E = typename Derived::error_type;
+    static_assert(std::is_same_v<E, ExceptionError> ||
+                      std::is_same_v<E, std::exception_ptr>,
+                  "contains_exception() needs an exception error type");
+    if constexpr (std::is_same_v<E, ExceptionError>) {
+      return self().unwrap_err().template is<Exc>();
+    } else {
+      return catches<Exc>(self().unwrap_err());
     }
   }
 
-  template <typename Exc,
-            std::enable_if_t<std::is_same_v<error_type, std::exception_ptr> &&
-                                 std::is_same_v<Exc, Exc>,
-                             int> = 0>
-  bool contains_exception() const {
-    try {
-      std::rethrow_exception(unwrap_err());
-    } catch (Exc&) {
-      return true;
-    } catch (...) {
-      return false;
+  // func(value) -> U, gives Result<U, E>
+  template <typename Func>
+  auto map(Func&& func) & {
+    return result_detail::map(self(), std::forward<Func>(func));
+  }
+  template <typename Func>
+  auto map(Func&& func) const& {
+    return result_detail::map(self(), std::forward<Func>(func));
+  }
+  template <typename Func>
+  auto map(Func&& func) && {
+    return result_detail::map(std::move(self()), std::forward<Func>(func));
+  }
+
+  // func(value) -> Result<U, E>
+  template <typename Func>
+  auto and_then(Func&& func) & {
+    return result_detail::and_then(self(), std::forward<Func>(func));
+  }
+  template <typename Func>
+  auto and_then(Func&& func) const& {
+    return result_detail::and_then(self(), std::forward<Func>(func));
+  }
+  template <typename Func>
+  auto and_then(Func&& func) && {
+    return result_detail::and_then(std::move(self()),
+                                   std::forward<Func>(func));
+  }
+
+  // func(error) -> Result<T, G>
+  template <typename Func>
+  auto or_else(Func&& func) & {
+    return result_detail::or_else(self(), std::forward<Func>(func));
+  }
+  template <typename Func>
+  auto or_else(Func&& func) const& {
+    return result_detail::or_else(self(), std::forward<Func>(func));
+  }
+  template <typename Func>
+  auto or_else(Func&& func) && {
+    return result_detail::or_else(std::move(self()), std::forward<Func>(func));
+  }
+
+  // func(error) -> G, gives Result<T, G>
+  template <typename Func>
+  auto map_err(Func&& func) & {
+    return result_detail::map_err(self(), std::forward<Func>(func));
+  }
+  template <typename Func>
+  auto map_err(Func&& func) const& {
+    return result_detail::map_err(self(), std::forward<Func>(func));
+  }
+  template <typename Func>
+  auto map_err(Func&& func) && {
+    return result_detail::map_err(std::move(self()),
+                                  std::forward<Func>(func));
+  }
+
+  // The value, or fallback converted to it when there is none
+  template <typename U>
+  decltype(auto) value_or(U&& fallback) const& {
+    using T = typename Derived::value_type;
+    if (self().has_value()) {
+      return static_cast<T>(self().value());
     }
+    return static_cast<T>(std::forward<U>(fallback));
   }
+  template <typename U>
+  decltype(auto) value_or(U&& fallback) && {
+    using T = typename Derived::value_type;
+    if (self().has_value()) {
+      return static_cast<T>(std::move(self()).value());
+    }
+    return static_cast<T>(std::forward<U>(fallback));
+  }
+
+ private:
+  Derived& self() & { return static_cast<Derived&>(*this); }
+  const Derived& self() const& { return static_cast<const Derived&>(*this); }
+  Derived&& self() && { return static_cast<Derived&&>(*this); }
+};
+
+}  // namespace result_detail
+
+template <typename T, typename E, typename Enable>
+struct Result : result_detail::result_base<Result<T, E, Enable>> {
+  using value_type = T;
+  using error_type = E;
 
   template <typename U,
             typename = std::enable_if_t<
@@ -115,6 +492,14 @@ struct Result {
   Result(Err<F>&& err) noexcept(std::is_nothrow_constructible_v<E>)
       : data(std::in_place_type<E>, std::move(err.error)) {}
 
+  template <typename... Args>
+  explicit Result(in_place_ok_t, Args&&... args)
+      : data(std::in_place_type<T>, std::forward<Args>(args)...) {}
+
+  template <typename... Args>
+  explicit Result(in_place_err_t, Args&&... args)
+      : data(std::in_place_type<E>, std::forward<Args>(args)...) {}
+
   // Status checks
   constexpr bool has_value() const noexcept {
     return std::holds_alternative<T>(data);
@@ -132,7 +517,7 @@ struct Result {
     return std::holds_alternative<E>(data);
   }
 
-  T& unwrap() {
+  T& unwrap() & {
     if (!std::holds_alternative<T>(data)) {
 #ifdef RESULT_ALLOW_EMPTY_STATE
       if (std::holds_alternative<std::monostate>(data)) {
@@ -144,7 +529,7 @@ struct Result {
     return std::get<T>(data);
   }
 
-  T const& unwrap() const {
+  T const& unwrap() const& {
     if (!std::holds_alternative<T>(data)) {
 #ifdef RESULT_ALLOW_EMPTY_STATE
       if (std::holds_alternative<std::monostate>(data)) {
@@ -156,7 +541,9 @@ struct Result {
     return std::get<T>(data);
   }
 
-  E& unwrap_err() {
+  T&& unwrap() && { return std::move(unwrap()); }
+
+  E& unwrap_err() & {
     if (!std::holds_alternative<E>(data)) {
 #ifdef RESULT_ALLOW_EMPTY_STATE
       if (std::holds_alternative<std::monostate>(data)) {
@@ -168,7 +555,7 @@ struct Result {
     return std::get<E>(data);
   }
 
-  E const& unwrap_err() const {
+  E const& unwrap_err() const& {
     if (!std::holds_alternative<E>(data)) {
 #ifdef RESULT_ALLOW_EMPTY_STATE
       if (std::holds_alternative<std::monostate>(data)) {
@@ -180,6 +567,8 @@ struct Result {
     return std::get<E>(data);
   }
 
+  E&& unwrap_err() && { return std::move(unwrap_err()); }
+
 #ifdef RESULT_ALLOW_EMPTY_STATE
   bool empty() const { return std::holds_alternative<std::monostate>(data); }
 
@@ -192,13 +581,17 @@ struct Result {
 
 #endif
 
-  T& value() { return std::get<T>(data); }
+  T& value() & { return std::get<T>(data); }
+
+  T const& value() const& { return std::get<T>(data); }
 
-  T const& value() const { return std::get<T>(data); }
+  T&& value() && { return std::get<T>(std::move(data)); }
 
-  E& error() { return std::get<E>(data); }
+  E& error() & { return std::get<E>(data); }
 
-  E const& error() const { return std::get<E>(data); }
+  E const& error() const& { return std::get<E>(data); }
+
+  E&& error() && { return std::get<E>(std::move(data)); }
 
   std::optional<T> take_value() {
     if (!has_value())
@@ -251,3 +644,197 @@ struct Result {
   std::variant<T, E> data;
 #endif
 };
+
+// Success without a value. Default constructed it is Ok, it has no empty
+// state.
+template <typename E>
+struct Result<void, E, void> : result_detail::result_base<Result<void, E>> {
+  using value_type = void;
+  using error_type = E;
+
+  Result() noexcept = default;
+  Result(Ok<void>&&) noexcept {}
+  explicit Result(in_place_ok_t) noexcept {}
+
+  template <typename F,
+            typename = std::enable_if_t<std::is_constructible_v<E, F&&>>>
+  Result(Err<F>&& err) : err_(std::in_place, std::move(err.error)) {}
+
+  template <typename... Args>
+  explicit Result(in_place_err_t, Args&&... args)
+      : err_(std::in_place, std::forward<Args>(args)...) {}
+
+  // return SomeError{...};
+  template <typename U,
+            typename = std::enable_if_t<
+                std::is_constructible_v<E, U&&> &&
+                !std::is_same_v<result_detail::remove_cvref_t<U>, Result>>>
+  Result(U&& err) : err_(std::in_place, std::forward<U>(err)) {}
+
+  bool has_value() const noexcept { return !err_.has_value(); }
+  bool is_ok() const noexcept { return !err_.has_value(); }
+  bool has_error() const noexcept { return err_.has_value(); }
+  bool is_err() const noexcept { return err_.has_value(); }
+
+  void value() const noexcept {}
+
+  void unwrap() const {
+    if (err_.has_value()) {
+      throw std::runtime_error("Called unwrap() on Err value");
+    }
+  }
+
+  E& unwrap_err() & { return checked_err(); }
+  E const& unwrap_err() const& { return checked_err(); }
+  E&& unwrap_err() && { return std::move(checked_err()); }
+
+  E& error() & { return *err_; }
+  E const& error() const& { return *err_; }
+  E&& error() && { return std::move(*err_); }
+
+  // Moves the error out, the Result stays an error holding the moved-from E
+  std::optional<E> take_error() {
+    if (!err_.has_value())
+      return std::nullopt;
+    return std::optional<E>(std::move(*err_));
+  }
+
+ private:
+  std::optional<E> err_;
+
+  E& checked_err() const {
+    if (!err_.has_value()) {
+      throw std::runtime_error("Called unwrap_err() on Ok value");
+    }
+    return const_cast<E&>(*err_);
+  }
+};
+
+// Refers to a value owned elsewhere, stored as a pointer
+template <typename T, typename E>
+struct Result<T&, E, void> : result_detail::result_base<Result<T&, E>> {
+  using value_type = T&;
+  using error_type = E;
+
+  template <typename U,
+            typename = std::enable_if_t<std::is_convertible_v<U&, T&>>>
+  Result(U& ref) noexcept : data(std::in_place_index<0>, std::addressof(ref)) {}
+
+  template <typename U,
+            typename = std::enable_if_t<std::is_convertible_v<U&, T&>>>
+  explicit Result(in_place_ok_t, U& ref) noexcept
+      : data(std::in_place_index<0>, std::addressof(ref)) {}
+
+  template <typename F,
+            typename = std::enable_if_t<std::is_constructible_v<E, F&&>>>
+  Result(Err<F>&& err) : data(std::in_place_index<1>, std::move(err.error)) {}
+
+  template <typename U,
+            typename = std::enable_if_t<
+                !std::is_lvalue_reference_v<U> &&
+                std::is_constructible_v<E, U&&> &&
+                !std::is_same_v<result_detail::remove_cvref_t<U>, Result>>>
+  Result(U&& err) : data(std::in_place_index<1>, std::forward<U>(err)) {}
+
+  template <typename... Args>
+  explicit Result(in_place_err_t, Args&&... args)
+      : data(std::in_place_index<1>, std::forward<Args>(args)...) {}
+
+  bool has_value() const noexcept { return data.index() == 0; }
+  bool is_ok() const noexcept { return data.index() == 0; }
+  bool has_error() const noexcept { return data.index() == 1; }
+  bool is_err() const noexcept { return data.index() == 1; }
+
+  T& value() const { return *std::get<0>(data); }
+
+  T& unwrap() const {
+    if (!has_value()) {
+      throw std::runtime_error("Called unwrap() on Err value");
+    }
+    return *std::get<0>(data);
+  }
+
+  E& unwrap_err() & { return checked_err(); }
+  E const& unwrap_err() const& { return checked_err(); }
+  E&& unwrap_err() && { return std::move(checked_err()); }
+
+  E& error() & { return std::get<1>(data); }
+  E const& error() const& { return std::get<1>(data); }
+  E&& error() && { return std::get<1>(std::move(data)); }
+
+ private:
+  std::variant<T*, E> data;
+
+  E& checked_err() const {
+    if (!has_error()) {
+      throw std::runtime_error("Called unwrap_err() on Ok value");
+    }
+    return const_cast<E&>(std::get<1>(data));
+  }
+};
+
+#ifndef RESULT_ALLOW_EMPTY_STATE
+// Value and error share the payload's storage, see result_niche
+template <typename T, typename E>
+struct Result<T, E, std::enable_if_t<result_niche<T, E>::available>>
+    : result_detail::result_base<Result<T, E>> {
+  using value_type = T;
+  using error_type = E;
+
+  template <typename U,
+            std::enable_if_t<std::is_constructible_v<T, U&&> &&
+                                 !std::is_constructible_v<E, U&&>,
+                             int> = 0>
+  Result(U&& val) : bits(niche::from_value(T(std::forward<U>(val)))) {}
+
+  template <typename U,
+            std::enable_if_t<!std::is_constructible_v<T, U&&> &&
+                                 std::is_constructible_v<E, U&&>,
+                             int> = 0>
+  Result(U&& err) : bits(niche::from_error(E(std::forward<U>(err)))) {}
+
+  template <typename U,
+            typename = std::enable_if_t<std::is_constructible_v<T, U&&>>>
+  Result(Ok<U>&& ok) noexcept
+      : bits(niche::from_value(T(std::move(ok.value)))) {}
+
+  template <typename F,
+            typename = std::enable_if_t<std::is_constructible_v<E, F&&>>>
+  Result(Err<F>&& err) noexcept
+      : bits(niche::from_error(E(std::move(err.error)))) {}
+
+  template <typename... Args>
+  explicit Result(in_place_ok_t, Args&&... args)
+      : bits(niche::from_value(T(std::forward<Args>(args)...))) {}
+
+  template <typename... Args>
+  explicit Result(in_place_err_t, Args&&... args)
+      : bits(niche::from_error(E(std::forward<Args>(args)...))) {}
+
+  bool has_value() const noexcept { return !niche::is_error(bits); }
+  bool is_ok() const noexcept { return !niche::is_error(bits); }
+  bool has_error() const noexcept { return niche::is_error(bits); }
+  bool is_err() const noexcept { return niche::is_error(bits); }
+
+  T value() const noexcept { return niche::value(bits); }
+  E error() const noexcept { return niche::error(bits); }
+
+  T unwrap() const {
+    if (has_error()) {
+      throw std::runtime_error("Called unwrap() on Err value");
+    }
+    return niche::value(bits);
+  }
+
+  E unwrap_err() const {
+    if (has_value()) {
+      throw std::runtime_error("Called unwrap_err() on Ok value");
+    }
+    return niche::error(bits);
+  }
+
+ private:
+  using niche = result_niche<T, E>;
+  typename niche::storage bits;
+};
+#endif
@@ -2,20 +2,38 @@
 
 #include <condition_variable>
 #include <cstddef>
+#include <deque>
+#include <memory>
 #include <mutex>
 #include <optional>
 #include <queue>
 #include <utility>
 
+#include "trace_recorder.h"
+
 namespace cpputils {
-template <typename T>
+// Allocator is used for the deque chunks holding the items, e.g.
+// memory::PoolAllocator<T> or std::pmr::polymorphic_allocator<T>
+template <typename T, typename Allocator = std::allocator<T>>
 class SafeQueue {
  private:
-  std::queue<T> queue;
+  std::queue<T, std::deque<T, Allocator>> queue;
   mutable std::mutex mtx;
   std::condition_variable cv;
   bool _closed;  // push returns false if closed
 
+  // cv.wait that shows up on the trace timeline when it actually blocks
+  template <typename Predicate>
+  void wait_traced(std::unique_lock<std::mutex>& lock, const char* what,
+                   Predicate pred) {
+    if (pred()) {
+      return;
+    }
+    CPPUTILS_TRACE(begin, what, "queue_blocked", 0);
+    cv.wait(lock, pred);
+    CPPUTILS_TRACE(end, what, "queue_blocked", 0);
+  }
+
  public:
   const size_t max_size;
 
@@ -33,14 +51,14 @@ class SafeQueue {
     return *this;
   }
 
-  explicit SafeQueue(size_t MaxSize) noexcept(true)
-      : _closed(false), max_size(MaxSize) {}
+  explicit SafeQueue(size_t MaxSize, const Allocator& alloc = Allocator())
+      : queue(alloc), _closed(false), max_size(MaxSize) {}
 
   bool push(const T& item) noexcept {
     std::unique_lock<std::mutex> lock(mtx);
     if (_closed)  // We should not be able to push into a closed queue
       return false;
-    cv.wait(lock, [this]() {
+    wait_traced(lock, "SafeQueue::push", [this]() {
       return queue.size() < max_size;
     });  // Wait if the queue is full
     queue.push(item);
@@ -52,7 +70,8 @@ class SafeQueue {
     std::unique_lock<std::mutex> lock(mtx);
     if (_closed)
       return false;
-    cv.wait(lock, [this]() { return queue.size() < max_size; });
+    wait_traced(lock, "SafeQueue::push",
+                [this]() { return queue.size() < max_size; });
     queue.push(std::move(item));
     cv.notify_one();
     return true;
@@ -62,8 +81,9 @@ class SafeQueue {
   // SafeQueue that get's closed) -> use popsafe
   [[nodiscard]] T pop() {
     std::unique_lock<std::mutex> lock(mtx);
-    cv.wait(lock,
-            [this]() { return !queue.empty(); });  // Wait if the queue is empty
+    wait_traced(lock, "SafeQueue::pop", [this]() {
+      return !queue.empty();
+    });  // Wait if the queue is empty
     T item = std::move(queue.front());
     queue.pop();
     cv.notify_all();
@@ -73,7 +93,7 @@ class SafeQueue {
   // Being woken up by closing the queue when it is empty returns a std::nullopt
   [[nodiscard]] std::optional<T> popsafe() noexcept {
     std::unique_lock<std::mutex> lock(mtx);
-    cv.wait(lock, [this]() {
+    wait_traced(lock, "SafeQueue::popsafe", [this]() {
       return !queue.empty() || _closed;
     });  // Wait if the queue is empty
     if (_closed && queue.empty()) {
@@ -130,7 +150,8 @@ class SafeQueue {
   // Waits on an empty open SafeQueue
   inline void waititem() {
     std::unique_lock<std::mutex> lock(mtx);
-    cv.wait(lock, [this]() { return !queue.empty() || _closed; });
+    wait_traced(lock, "SafeQueue::waititem",
+                [this]() { return !queue.empty() || _closed; });
   }
 
   inline size_t current_size() const {
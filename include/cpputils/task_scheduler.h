@@ -6,25 +6,32 @@
 #include <functional>
 #include <future>
 #include <iostream>
+#include <memory>
 #include <optional>
 #include <thread>
 #include <utility>
 #include <vector>
 
+#include "clock.h"
 #include "safe_queue.h"
+#include "trace_recorder.h"
 
 namespace cpputils {
 
-template <typename T = void>
+// Allocator, rebound to the task type, is used for the task queue. The
+// closures inside std::function and the shared states of packaged_task stay
+// on the heap, C++17 dropped allocator support from both.
+template <typename T = void, typename Allocator = std::allocator<std::byte>>
 class TaskScheduler {
  private:
   using TaskType =
       std::conditional_t<std::is_void<T>::value, std::function<void()>,
                          std::packaged_task<T()>>;
 
-  using QueueType = std::conditional_t<std::is_void<T>::value,
-                                       SafeQueue<std::function<void()>>,
-                                       SafeQueue<std::packaged_task<T()>>>;
+  using TaskAllocator = typename std::allocator_traits<
+      Allocator>::template rebind_alloc<TaskType>;
+
+  using QueueType = SafeQueue<TaskType, TaskAllocator>;
 
   QueueType taskQueue;
   std::vector<std::thread> workerThreads;
@@ -50,11 +57,11 @@ class TaskScheduler {
         return;
       }
       auto& task = maybetask.value();
+      CPPUTILS_TRACE(instant, "task_dequeue", "scheduler", threadId);
+      CPPUTILS_TRACE(begin, "task", "scheduler", threadId);
       try {
-        threadStartTimestamps[threadId] = static_cast<uint64_t>(
-            std::chrono::duration_cast<std::chrono::seconds>(
-                std::chrono::system_clock::now().time_since_epoch())
-                .count());
+        threadStartTimestamps[threadId] =
+            static_cast<uint64_t>(clocks::unix_ms() / 1000);
         if constexpr (std::is_void<T>::value) {
           task();
           if (taskDoneCallback) {
@@ -74,12 +81,16 @@ class TaskScheduler {
       } catch (...) {
         std::cerr << "Caught unknown exception\n";
       }
+      CPPUTILS_TRACE(end, "task", "scheduler", threadId);
     }
   }
 
  public:
-  TaskScheduler(size_t NumThreads, size_t QueueMaxSize)
-      : taskQueue(QueueMaxSize), isRunning(true), numThreads(NumThreads) {
+  TaskScheduler(size_t NumThreads, size_t QueueMaxSize,
+                const Allocator& alloc = Allocator())
+      : taskQueue(QueueMaxSize, TaskAllocator(alloc)),
+        isRunning(true),
+        numThreads(NumThreads) {
     threadStartTimestamps.resize(numThreads);
     for (size_t i = 0; i < numThreads; ++i) {
       workerThreads.emplace_back([this, i]() { this->workerFunction(i); });
@@ -1,19 +1,44 @@
 #pragma once
 
+#include <chrono>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <shared_mutex>
+#include <type_traits>
+#include <utility>
 
+#include "distributed_rw_lock.h"
 #include "fair_rw_lock.h"
 
 namespace cpputils {
+namespace detail {
+// try_* and *_for return false (void funcs) or std::nullopt when the lock
+// could not be acquired
+template <typename R>
+using try_result_t =
+    std::conditional_t<std::is_void_v<R>, bool, std::optional<std::decay_t<R>>>;
+
+template <typename Func, typename Data>
+auto invoke_locked(Func& func, Data& data)
+    -> try_result_t<decltype(func(data))> {
+  if constexpr (std::is_void_v<decltype(func(data))>) {
+    func(data);
+    return true;
+  } else {
+    return func(data);
+  }
+}
+}  // namespace detail
+
 template <typename T, typename LockType = std::shared_mutex>
 class ThreadSafeContainer {
   static_assert(std::is_same_v<LockType, std::shared_mutex> ||
                     std::is_same_v<LockType, std::mutex> ||
-                    std::is_same_v<LockType, FairRWLock>,
+                    std::is_same_v<LockType, FairRWLock> ||
+                    std::is_same_v<LockType, DistributedRWLock>,
                 "ThreadSafeContainer can only be used with std::shared_mutex, "
-                "std::mutex, or FairRWLock");
+                "std::mutex, FairRWLock or DistributedRWLock");
 
  private:
   std::shared_ptr<T> data;
@@ -22,14 +47,14 @@ class ThreadSafeContainer {
  public:
   ThreadSafeContainer(T&& initialData)
       : data(std::make_shared<T>(std::move(initialData))),
-        rwLock(std::make_shared<std::shared_mutex>()) {}
+        rwLock(std::make_shared<LockType>()) {}
 
   ThreadSafeContainer(const ThreadSafeContainer& other)
       : data(other.data), rwLock(other.rwLock) {}
 
   ThreadSafeContainer(std::shared_ptr<T>&& existingData)
       : data(std::move(existingData)),
-        rwLock(std::make_shared<std::shared_mutex>()) {}
+        rwLock(std::make_shared<LockType>()) {}
 
   template <typename Func>
   auto read(Func func) const -> decltype(func(std::declval<const T&>())) const {
@@ -50,6 +75,25 @@ class ThreadSafeContainer {
     }
     return func(*data);
   }
+
+  template <typename Func>
+  auto try_read(Func func) const
+      -> detail::try_result_t<decltype(func(std::declval<const T&>()))> {
+    std::shared_lock lock(*rwLock, std::try_to_lock);
+    if (!lock.owns_lock()) {
+      return {};
+    }
+    return detail::invoke_locked(func, std::as_const(*data));
+  }
+
+  template <typename Func>
+  auto try_write(Func func) -> detail::try_result_t<decltype(func(*data))> {
+    std::unique_lock lock(*rwLock, std::try_to_lock);
+    if (!lock.owns_lock()) {
+      return {};
+    }
+    return detail::invoke_locked(func, *data);
+  }
 };
 
 template <typename T>
@@ -72,30 +116,112 @@ class ThreadSafeContainer<T, FairRWLock> {
   template <typename Func>
   auto read(Func func) const -> decltype(func(std::declval<const T&>())) const {
     rwLock->acquire_read();
-    if constexpr (std::is_void_v<decltype(func(*data))>) {
-      func(*data);
-      rwLock->release_read();
-      return;
-    } else {
-      auto result = func(*data);
-      rwLock->release_read();
-      return result;
-    }
+    ReadGuard guard{*rwLock};
+    return func(std::as_const(*data));
   }
 
   template <typename Func>
   auto write(Func func) -> decltype(func(*data)) {
     rwLock->acquire_write();
-    if constexpr (std::is_void_v<decltype(func(*data))>) {
-      func(*data);
-      rwLock->release_write();
-      return;
-    } else {
-      auto result = func(*data);
-      rwLock->release_write();
-      return result;
+    WriteGuard guard{*rwLock};
+    return func(*data);
+  }
+
+  template <typename Func>
+  auto try_read(Func func) const
+      -> detail::try_result_t<decltype(func(std::declval<const T&>()))> {
+    if (!rwLock->try_acquire_read()) {
+      return {};
+    }
+    ReadGuard guard{*rwLock};
+    return detail::invoke_locked(func, std::as_const(*data));
+  }
+
+  template <typename Func>
+  auto try_write(Func func) -> detail::try_result_t<decltype(func(*data))> {
+    if (!rwLock->try_acquire_write()) {
+      return {};
     }
+    WriteGuard guard{*rwLock};
+    return detail::invoke_locked(func, *data);
   }
+
+  template <typename Rep, typename Period, typename Func>
+  auto read_for(const std::chrono::duration<Rep, Period>& timeout,
+                Func func) const
+      -> detail::try_result_t<decltype(func(std::declval<const T&>()))> {
+    if (!rwLock->acquire_read_for(timeout)) {
+      return {};
+    }
+    ReadGuard guard{*rwLock};
+    return detail::invoke_locked(func, std::as_const(*data));
+  }
+
+  template <typename Rep, typename Period, typename Func>
+  auto write_for(const std::chrono::duration<Rep, Period>& timeout, Func func)
+      -> detail::try_result_t<decltype(func(*data))> {
+    if (!rwLock->acquire_write_for(timeout)) {
+      return {};
+    }
+    WriteGuard guard{*rwLock};
+    return detail::invoke_locked(func, *data);
+  }
+
+  // Passed to upgradable_read, calling it switches to the write lock (once)
+  // and runs mutator(T&)
+  class Upgrader {
+    friend class ThreadSafeContainer;
+    ThreadSafeContainer& container;
+    bool upgraded = false;
+
+    explicit Upgrader(ThreadSafeContainer& owner) : container(owner) {}
+
+   public:
+    template <typename Mutator>
+    auto operator()(Mutator mutator) -> decltype(mutator(std::declval<T&>())) {
+      if (!upgraded) {
+        container.rwLock->upgrade();
+        upgraded = true;
+      }
+      return mutator(*container.data);
+    }
+  };
+
+  // Runs func(const T&, Upgrader&) under an upgradable read lock. Whatever
+  // func checked before upgrading still holds when the mutator runs.
+  template <typename Func>
+  auto upgradable_read(Func func) -> decltype(func(std::declval<const T&>(),
+                                                   std::declval<Upgrader&>())) {
+    rwLock->acquire_upgradable();
+    Upgrader upgrader(*this);
+    UpgradableGuard guard{*rwLock, upgrader};
+    return func(std::as_const(*data), upgrader);
+  }
+
+ private:
+  // Release what was acquired before them, also when func throws
+  struct ReadGuard {
+    const FairRWLock& lock;
+    ~ReadGuard() { lock.release_read(); }
+  };
+
+  struct WriteGuard {
+    FairRWLock& lock;
+    ~WriteGuard() { lock.release_write(); }
+  };
+
+  // The write lock once the Upgrader ran, the upgradable one before
+  struct UpgradableGuard {
+    FairRWLock& lock;
+    const Upgrader& upgrader;
+    ~UpgradableGuard() {
+      if (upgrader.upgraded) {
+        lock.release_write();
+      } else {
+        lock.release_upgradable();
+      }
+    }
+  };
 };
 
 template <typename T>
@@ -134,5 +260,24 @@ class ThreadSafeContainer<T, std::mutex> {
     }
     return func(*data);
   }
+
+  template <typename Func>
+  auto try_read(Func func) const
+      -> detail::try_result_t<decltype(func(std::declval<const T&>()))> {
+    std::unique_lock lock(*rwLock, std::try_to_lock);
+    if (!lock.owns_lock()) {
+      return {};
+    }
+    return detail::invoke_locked(func, std::as_const(*data));
+  }
+
+  template <typename Func>
+  auto try_write(Func func) -> detail::try_result_t<decltype(func(*data))> {
+    std::unique_lock lock(*rwLock, std::try_to_lock);
+    if (!lock.owns_lock()) {
+      return {};
+    }
+    return detail::invoke_locked(func, *data);
+  }
 };
 }  // namespace cpputils
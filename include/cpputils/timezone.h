@@ -0,0 +1,83 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "datetime.h"
+
+namespace cpputils {
+namespace datetime {
+
+// "2025-05-18T20:53:46.123456789+02:00"
+constexpr size_t rfc3339_local_max_length = 35;
+
+struct LocalTimeType {
+  int32_t offset = 0;  // Seconds east of UTC
+  bool dst = false;
+  std::string abbreviation;
+};
+
+// Rules of one zone from a TZif file (RFC 8536) or a POSIX TZ string.
+// Immutable once loaded, lookups are a binary search over the transitions
+// and safe from any thread. Leap second records are ignored.
+class TimeZone {
+ public:
+  // IANA name resolved against $TZDIR or /usr/share/zoneinfo, an absolute
+  // TZif path, or a POSIX TZ string such as "CET-1CEST,M3.5.0,M10.5.0/3".
+  // nullptr when none of these works.
+  static std::shared_ptr<const TimeZone> Load(std::string_view name);
+  // $TZ when set, /etc/localtime otherwise, UTC when neither loads
+  static std::shared_ptr<const TimeZone> LoadLocal();
+  // Parses the contents of a TZif file, nullptr when malformed
+  static std::shared_ptr<const TimeZone> FromTzif(std::string_view data,
+                                                  std::string name);
+  static std::shared_ptr<const TimeZone> Utc();
+
+  const std::string& name() const { return name_; }
+
+  const LocalTimeType& lookup(int64_t unix_seconds) const;
+  int32_t offset_at(int64_t unix_seconds) const {
+    return lookup(unix_seconds).offset;
+  }
+  int32_t offset_at(std::chrono::system_clock::time_point tp) const;
+
+ private:
+  TimeZone() = default;
+
+  std::string name_;
+  // Transition instants in UTC seconds, with the type each one switches to.
+  // Type 0 applies before the first one.
+  std::vector<int64_t> transitions;
+  std::vector<uint16_t> transition_types;
+  std::vector<LocalTimeType> types;
+
+  // Appends the transitions of a POSIX TZ rule after the last one, up to
+  // the end of system_clock, so no lookup has to evaluate the rule
+  bool apply_rule(std::string_view posix);
+};
+
+// Zone used by the *_local functions. Loaded on first use, later reads are
+// one atomic load. Replaced zones are kept until exit, so a reference from
+// local_zone() stays valid across reloads.
+const TimeZone& local_zone();
+
+// Loads the local zone again, e.g. after $TZ or /etc/localtime changed.
+// Returns false and keeps the current zone when loading fails.
+bool reload_local_zone();
+void set_local_zone(std::shared_ptr<const TimeZone> zone);
+
+// format_rfc3339 in the time of zone, ending in its offset ("+02:00",
+// "+00:00" for UTC). Historic offsets with seconds are rounded to the
+// minute. Returns the length, at most rfc3339_local_max_length.
+size_t format_rfc3339_local(char* buf, std::chrono::system_clock::time_point tp,
+                            precision digits = precision::milliseconds,
+                            const TimeZone& zone = local_zone());
+
+}  // namespace datetime
+}  // namespace cpputils
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+#include "clock.h"
+
+namespace cpputils {
+namespace trace {
+
+// Timeline recorder: every thread appends events to its own lock-free ring
+// buffer, a flusher drains them into Chrome trace-event JSON that Perfetto
+// and chrome://tracing open. Recording is off until start() and costs one
+// relaxed load while off. Define CPPUTILS_NO_TRACE to compile the hooks in
+// the library headers out entirely.
+
+// Events per thread buffer, when a buffer is full new events are dropped
+constexpr size_t buffer_events = 8192;
+
+enum class phase : uint8_t {
+  begin,    // "B", opens a span on the thread
+  end,      // "E", closes the innermost span
+  instant,  // "i"
+};
+
+// name and category must outlive the trace, e.g. string literals
+struct event {
+  int64_t ts_ns;
+  const char* name;
+  const char* category;
+  uint64_t arg;
+  phase type;
+};
+
+namespace detail {
+
+inline std::atomic<bool> enabled{false};
+
+// Single producer (the owning thread), single consumer (the flusher)
+class thread_buffer {
+ public:
+  explicit thread_buffer(uint32_t tid) : tid_(tid) {}
+
+  void push(const event& e) {
+    const uint64_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) == buffer_events) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    events_[head % buffer_events] = e;
+    head_.store(head + 1, std::memory_order_release);
+  }
+
+  // Consumer side, calls fn(event) for everything pushed so far
+  template <typename Func>
+  size_t drain(Func fn) {
+    const uint64_t tail = tail_.load(std::memory_order_relaxed);
+    const uint64_t head = head_.load(std::memory_order_acquire);
+    for (uint64_t i = tail; i != head; ++i) {
+      fn(events_[i % buffer_events]);
+    }
+    tail_.store(head, std::memory_order_release);
+    return static_cast<size_t>(head - tail);
+  }
+
+  uint32_t tid() const { return tid_; }
+  uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+ private:
+  const uint32_t tid_;
+  alignas(64) std::atomic<uint64_t> head_{0};
+  alignas(64) std::atomic<uint64_t> tail_{0};
+  std::atomic<uint64_t> dropped_{0};
+  std::array<event, buffer_events> events_;
+};
+
+inline thread_local thread_buffer* current_buffer = nullptr;
+
+// Registers a buffer for the calling thread, kept until it is drained after
+// the thread exited. nullptr once the thread is past its exit.
+thread_buffer* register_thread();
+
+inline thread_buffer* local_buffer() {
+  thread_buffer* buffer = current_buffer;
+  return buffer != nullptr ? buffer : register_thread();
+}
+
+}  // namespace detail
+
+inline bool enabled() {
+  return detail::enabled.load(std::memory_order_relaxed);
+}
+
+inline void start() {
+  detail::enabled.store(true, std::memory_order_relaxed);
+}
+
+inline void stop() {
+  detail::enabled.store(false, std::memory_order_relaxed);
+}
+
+inline void record(phase type, const char* name, const char* category,
+                   uint64_t arg = 0) {
+  if (!enabled()) {
+    return;
+  }
+  if (auto* buffer = detail::local_buffer()) {
+    buffer->push({clocks::tsc::now_ns(), name, category, arg, type});
+  }
+}
+
+// Drains every thread buffer and writes a complete Chrome trace document
+void write_chrome_trace(std::ostream& out);
+
+// Appends the drained events to path every interval from a background
+// thread. The file uses the JSON array format, which trace viewers accept
+// without the closing bracket, stop_background_flush() writes it.
+// Returns false when the file cannot be opened or a flusher is running.
+bool start_background_flush(
+    const std::string& path,
+    std::chrono::milliseconds interval = std::chrono::milliseconds(100));
+void stop_background_flush();
+
+// Events lost to full buffers so far
+uint64_t dropped_events();
+
+}  // namespace trace
+}  // namespace cpputils
+
+// Hook used inside the library, type is one of the phase enumerators
+#ifdef CPPUTILS_NO_TRACE
+#define CPPUTILS_TRACE(type, name, category, arg)
+#else
+#define CPPUTILS_TRACE(type, name, category, arg)                   \
+  ::cpputils::trace::record(::cpputils::trace::phase::type, name, \
+                            category, arg)
+#endif
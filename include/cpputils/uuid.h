@@ -1,29 +1,91 @@
 #pragma once
 
 #include <array>
-#include <atomic>
+#include <cstddef>
 #include <cstdint>
-#include <random>
+#include <cstring>
+#include <functional>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <utility>
+
+#include "datetime.h"
+#include "random.h"
 
 namespace cpputils {
 namespace uuid {
 
 extern std::string uuidToString(const std::array<uint8_t, 16>& uuid);
 
-class V4 {
+// Text forms, lowercase hex: canonical 8-4-4-4-12 or compact 32 digits
+constexpr size_t string_length = 36;
+constexpr size_t compact_length = 32;
+
+// Write exactly string_length / compact_length chars, no terminator.
+// SSE2 on x86, a table lookup elsewhere.
+void to_chars(const std::array<uint8_t, 16>& uuid, char* out);
+void to_chars_compact(const std::array<uint8_t, 16>& uuid, char* out);
+
+// count canonical strings back to back, string_length chars apart
+void to_chars_n(const std::array<uint8_t, 16>* uuids, size_t count,
+                char* out);
+
+// Accepts the canonical and the compact form in either case, nullopt for
+// anything else
+std::optional<std::array<uint8_t, 16>> from_chars(std::string_view text);
+
+namespace detail {
+
+// Reserves count consecutive V7 (unix_ts_ms << 12 | counter) values and
+// returns the first. Process-wide, so IDs from every thread and generator
+// are ordered.
+uint64_t v7_reserve(int64_t timestamp_ms, uint64_t count);
+
+inline void store_big_endian(uint8_t* out, uint64_t value) {
+  for (int i = 7; i >= 0; --i) {
+    out[i] = value & 0xFF;
+    value >>= 8;
+  }
+}
+
+}  // namespace detail
+
+// Rng is a 64-bit UniformRandomBitGenerator that seeds itself when default
+// constructed, see random.h. An instance is not thread-safe, keep one per
+// thread.
+template <typename Rng = rng::xoshiro256ss>
+class basic_v4 {
  private:
-  std::mt19937_64 rng;
+  Rng rng;
 
-  inline uint64_t random64() { return rng(); }
+  // ver and var over two random words, 122 random bits
+  void fill(uint8_t* out) {
+    const uint64_t high = (rng() & 0xFFFFFFFFFFFF0FFF) | 0x4000;
+    const uint64_t low = (rng() >> 2) | 0x8000000000000000;
+    detail::store_big_endian(out, high);
+    detail::store_big_endian(out + 8, low);
+  }
 
  public:
-  inline V4() : rng(std::random_device{}()) {}
+  basic_v4() = default;
+  explicit basic_v4(Rng Generator) : rng(std::move(Generator)) {}
+
+  std::array<uint8_t, 16> generate() {
+    std::array<uint8_t, 16> uuid;
+    fill(uuid.data());
+    return uuid;
+  }
 
-  std::array<uint8_t, 16> generate();
+  void generate_n(std::array<uint8_t, 16>* out, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+      fill(out[i].data());
+    }
+  }
 };
 
-class V7 {
+template <typename Rng = rng::xoshiro256ss>
+class basic_v7 {
   /*
    *
    *    0                   1                   2                   3
@@ -40,27 +102,15 @@ class V7 {
    *
    */
 
- private:
-  std::atomic<int64_t> last_timestamp{0};
-  std::atomic<uint8_t> sequence{0};
-  std::mt19937_64 rng;
-
-  // inline uint64_t get_current_timestamp_ms() {
-  //   using namespace std::chrono;
-  //   return static_cast<uint64_t>(
-  //       duration_cast<milliseconds>(system_clock::now().time_since_epoch())
-  //           .count());
-  // }
-
-  inline uint64_t random64() { return rng(); }
-
-  uint8_t next_sequence(int64_t current_timestamp);
+  // Method 1 of RFC 9562 6.2: rand_a is a 12-bit counter, restarting at 0
+  // every millisecond and carrying into the timestamp when it overflows.
+  // rand_b comes from a per-thread Rng.
 
  public:
-  inline V7() : rng(std::random_device{}()) {}
+  basic_v7() = default;
 
   static inline uint64_t get_timestamp_from_uuid(
-      std::array<uint8_t, 16>& uuid) {
+      const std::array<uint8_t, 16>& uuid) {
     uint64_t timestamp = 0;
     for (size_t i = 0; i < 6; ++i) {
       timestamp = (timestamp << 8) | uuid[i];
@@ -68,9 +118,157 @@ class V7 {
     return timestamp;
   }
 
-  std::array<uint8_t, 16> generate();
+  // Thread-safe and lock-free
+  std::array<uint8_t, 16> generate() {
+    std::array<uint8_t, 16> uuid;
+    generate_n(&uuid, 1);
+    return uuid;
+  }
+
+  // One atomic reservation for the whole batch, ordered within it. Beyond
+  // 4096 IDs per millisecond the timestamp runs ahead of the clock.
+  void generate_n(std::array<uint8_t, 16>* out, size_t count) {
+    thread_local Rng rng;
+    if (count == 0) {
+      return;
+    }
+    const uint64_t first = detail::v7_reserve(datetime::now(), count);
+    for (size_t i = 0; i < count; ++i) {
+      const uint64_t packed = first + i;
+      // unix_ts_ms | ver | rand_a (the counter)
+      const uint64_t high = (packed >> 12) << 16 | 0x7000 | (packed & 0xFFF);
+      // var | rand_b (62 random bits)
+      const uint64_t low = 0x8000000000000000 | (rng() >> 2);
+      detail::store_big_endian(out[i].data(), high);
+      detail::store_big_endian(out[i].data() + 8, low);
+    }
+  }
+};
+
+using V4 = basic_v4<>;
+using V7 = basic_v7<>;
+
+// Unpredictable IDs, e.g. for tokens exposed to clients
+using SecureV4 = basic_v4<rng::chacha20>;
+
+// 16-byte aligned UUID value. Bytes are kept in RFC order, comparisons go
+// through the two big-endian 64-bit halves as one 128-bit integer, so the
+// order matches the byte order (and creation order for V7).
+class alignas(16) Uuid {
+ public:
+  constexpr Uuid() = default;
+  constexpr explicit Uuid(const std::array<uint8_t, 16>& bytes)
+      : bytes_(bytes) {}
+
+  // Same forms as from_chars, usable in constant expressions
+  static constexpr std::optional<Uuid> parse(std::string_view text) {
+    size_t digits = 0;
+    std::array<uint8_t, 16> bytes{};
+    if (text.size() != string_length && text.size() != compact_length) {
+      return std::nullopt;
+    }
+    const bool dashed = text.size() == string_length;
+    for (size_t i = 0; i < text.size(); ++i) {
+      if (dashed && (i == 8 || i == 13 || i == 18 || i == 23)) {
+        if (text[i] != '-') {
+          return std::nullopt;
+        }
+        continue;
+      }
+      const int value = hex_value(text[i]);
+      if (value < 0) {
+        return std::nullopt;
+      }
+      bytes[digits / 2] = static_cast<uint8_t>(
+          digits % 2 == 0 ? value << 4 : bytes[digits / 2] | value);
+      ++digits;
+    }
+    return Uuid(bytes);
+  }
+
+  // Smallest and largest V7 value of a millisecond, bounds for range scans
+  static constexpr Uuid min_v7(uint64_t timestamp_ms) {
+    return from_halves(timestamp_ms << 16, 0);
+  }
+  static constexpr Uuid max_v7(uint64_t timestamp_ms) {
+    return from_halves(timestamp_ms << 16 | 0xFFFF, ~uint64_t{0});
+  }
+
+  constexpr const std::array<uint8_t, 16>& bytes() const { return bytes_; }
+  constexpr int version() const { return bytes_[6] >> 4; }
+  constexpr uint64_t timestamp_ms() const { return high() >> 16; }
+
+  // Big-endian halves
+  constexpr uint64_t high() const { return load(0); }
+  constexpr uint64_t low() const { return load(8); }
+
+  unsigned __int128 value() const {
+    return static_cast<unsigned __int128>(high()) << 64 | low();
+  }
+
+  // wyhash style: one 128-bit multiply of the keyed halves, folded
+  size_t hash() const {
+    const auto product =
+        static_cast<unsigned __int128>(high() ^ 0xA0761D6478BD642F) *
+        (low() ^ 0xE7037ED1A0B428DB);
+    return static_cast<size_t>(static_cast<uint64_t>(product >> 64) ^
+                               static_cast<uint64_t>(product));
+  }
+
+  std::string str() const { return uuidToString(bytes_); }
+
+  friend bool operator==(const Uuid& a, const Uuid& b) {
+    return std::memcmp(a.bytes_.data(), b.bytes_.data(), 16) == 0;
+  }
+  friend bool operator!=(const Uuid& a, const Uuid& b) { return !(a == b); }
+  friend bool operator<(const Uuid& a, const Uuid& b) {
+    return a.value() < b.value();
+  }
+  friend bool operator>(const Uuid& a, const Uuid& b) { return b < a; }
+  friend bool operator<=(const Uuid& a, const Uuid& b) { return !(b < a); }
+  friend bool operator>=(const Uuid& a, const Uuid& b) { return !(a < b); }
+
+ private:
+  std::array<uint8_t, 16> bytes_{};
+
+  static constexpr int hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+      return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+      return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+      return c - 'A' + 10;
+    }
+    return -1;
+  }
+
+  constexpr uint64_t load(size_t offset) const {
+    uint64_t value = 0;
+    for (size_t i = 0; i < 8; ++i) {
+      value = value << 8 | bytes_[offset + i];
+    }
+    return value;
+  }
+
+  static constexpr Uuid from_halves(uint64_t high, uint64_t low) {
+    std::array<uint8_t, 16> bytes{};
+    for (size_t i = 0; i < 8; ++i) {
+      bytes[i] = static_cast<uint8_t>(high >> (56 - 8 * i));
+      bytes[8 + i] = static_cast<uint8_t>(low >> (56 - 8 * i));
+    }
+    return Uuid(bytes);
+  }
+};
+
+struct UuidHash {
+  size_t operator()(const Uuid& uuid) const { return uuid.hash(); }
 };
 
 }  // namespace uuid
 
 }  // namespace cpputils
+
+template <>
+struct std::hash<cpputils::uuid::Uuid> : cpputils::uuid::UuidHash {};
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "uuid.h"
+
+namespace cpputils {
+namespace uuid {
+
+// Ordered map from UUID to Value, built for V7 keys that mostly arrive in
+// time order. Keys live in sorted blocks of contiguous arrays: in-order keys
+// append to the last block, late ones are inserted into the block covering
+// them, which splits once it doubles. A lookup is a binary search over the
+// first key of each block, then one inside the block, so a time range costs
+// two searches plus the matches. Not thread-safe.
+template <typename Value>
+class V7Index {
+ public:
+  explicit V7Index(size_t BlockSize = 1024)
+      : block_size(std::max<size_t>(BlockSize, 2)) {}
+
+  // Returns false, leaving the index unchanged, when key is already present
+  bool insert(const Uuid& key, Value value) {
+    if (blocks.empty() || blocks.back().keys.back() < key) {
+      if (blocks.empty() || blocks.back().keys.size() >= block_size) {
+        firsts.push_back(key);
+        blocks.emplace_back();
+        blocks.back().keys.reserve(block_size);
+        blocks.back().values.reserve(block_size);
+      }
+      blocks.back().keys.push_back(key);
+      blocks.back().values.push_back(std::move(value));
+      ++count;
+      return true;
+    }
+
+    const size_t index = block_for(key);
+    Block& block = blocks[index];
+    const auto it = std::lower_bound(block.keys.begin(), block.keys.end(), key);
+    if (it != block.keys.end() && *it == key) {
+      return false;
+    }
+    const auto offset = it - block.keys.begin();
+    block.keys.insert(it, key);
+    block.values.insert(block.values.begin() + offset, std::move(value));
+    firsts[index] = block.keys.front();
+    ++count;
+    if (block.keys.size() >= 2 * block_size) {
+      split(index);
+    }
+    return true;
+  }
+
+  const Value* find(const Uuid& key) const {
+    if (blocks.empty()) {
+      return nullptr;
+    }
+    const Block& block = blocks[block_for(key)];
+    const auto it = std::lower_bound(block.keys.begin(), block.keys.end(), key);
+    if (it == block.keys.end() || *it != key) {
+      return nullptr;
+    }
+    return &block.values[it - block.keys.begin()];
+  }
+
+  Value* find(const Uuid& key) {
+    return const_cast<Value*>(std::as_const(*this).find(key));
+  }
+
+  bool contains(const Uuid& key) const { return find(key) != nullptr; }
+
+  // Calls func(const Uuid&, const Value&) in key order for every key
+  // created in [from_ms, to_ms], returns how many there were
+  template <typename Func>
+  size_t for_each_in_range(uint64_t from_ms, uint64_t to_ms,
+                           Func&& func) const {
+    if (blocks.empty() || from_ms > to_ms) {
+      return 0;
+    }
+    const Uuid first = Uuid::min_v7(from_ms);
+    const Uuid last = Uuid::max_v7(to_ms);
+    size_t matched = 0;
+    for (size_t index = block_for(first); index < blocks.size(); ++index) {
+      const Block& block = blocks[index];
+      if (last < block.keys.front()) {
+        break;
+      }
+      auto it = block.keys.begin();
+      if (matched == 0) {
+        it = std::lower_bound(block.keys.begin(), block.keys.end(), first);
+      }
+      for (; it != block.keys.end(); ++it) {
+        if (last < *it) {
+          return matched;
+        }
+        func(*it, block.values[it - block.keys.begin()]);
+        ++matched;
+      }
+    }
+    return matched;
+  }
+
+  // Removes every key created before timestamp_ms, whole blocks at a time
+  // where possible. Returns how many were removed.
+  size_t erase_before(uint64_t timestamp_ms) {
+    const Uuid bound = Uuid::min_v7(timestamp_ms);
+    size_t whole = 0;
+    size_t removed = 0;
+    while (whole < blocks.size() && blocks[whole].keys.back() < bound) {
+      removed += blocks[whole].keys.size();
+      ++whole;
+    }
+    blocks.erase(blocks.begin(), blocks.begin() + whole);
+    firsts.erase(firsts.begin(), firsts.begin() + whole);
+    if (!blocks.empty()) {
+      Block& block = blocks.front();
+      const auto end =
+          std::lower_bound(block.keys.begin(), block.keys.end(), bound);
+      const auto partial = end - block.keys.begin();
+      block.keys.erase(block.keys.begin(), end);
+      block.values.erase(block.values.begin(), block.values.begin() + partial);
+      removed += static_cast<size_t>(partial);
+      firsts.front() = block.keys.front();
+    }
+    count -= removed;
+    return removed;
+  }
+
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+
+  void clear() {
+    blocks.clear();
+    firsts.clear();
+    count = 0;
+  }
+
+ private:
+  struct Block {
+    std::vector<Uuid> keys;
+    std::vector<Value> values;
+  };
+
+  size_t block_size;
+  size_t count = 0;
+  std::vector<Block> blocks;
+  // blocks[i].keys.front(), kept apart so the top-level search stays in cache
+  std::vector<Uuid> firsts;
+
+  // Last block starting at or before key, the first one when key is smaller
+  size_t block_for(const Uuid& key) const {
+    const auto it = std::upper_bound(firsts.begin(), firsts.end(), key);
+    return it == firsts.begin()
+               ? 0
+               : static_cast<size_t>(it - firsts.begin()) - 1;
+  }
+
+  void split(size_t index) {
+    Block upper;
+    Block& lower = blocks[index];
+    const size_t half = lower.keys.size() / 2;
+    upper.keys.assign(lower.keys.begin() + half, lower.keys.end());
+    upper.values.assign(std::make_move_iterator(lower.values.begin() + half),
+                        std::make_move_iterator(lower.values.end()));
+    lower.keys.resize(half);
+    lower.values.erase(lower.values.begin() + half, lower.values.end());
+    firsts.insert(firsts.begin() + index + 1, upper.keys.front());
+    blocks.insert(blocks.begin() + index + 1, std::move(upper));
+  }
+};
+
+}  // namespace uuid
+}  // namespace cpputils
@@ -0,0 +1,282 @@
+#include "cpputils/clock.h"
+#include <pthread.h>
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#ifdef CPPUTILS_HAS_TSC
+#include <cpuid.h>
+#endif
+
+namespace cpputils {
+namespace clocks {
+
+namespace {
+
+// Long enough for a ~10ppm error from the reference reads at both ends
+constexpr int64_t calibration_ns = 5'000'000;
+constexpr auto tick_interval = std::chrono::milliseconds(1);
+// How often a read checks the TSC, and the time an error found is spread
+// over
+constexpr int64_t correction_period_ns = 1'000'000'000;
+
+// Guards ticker and shut_down, and serializes start and stop
+std::mutex ticker_mtx;
+// Leaked in children after fork(), the thread did not come along
+std::thread* ticker = nullptr;
+std::atomic<bool> ticker_stopping{false};
+// Set at exit, later starts do nothing
+bool shut_down = false;
+
+#ifdef CPPUTILS_HAS_TSC
+struct reference_point {
+  uint64_t ticks;
+  int64_t ns;
+};
+
+// Held by the reader writing the calibration, the others go on without
+std::atomic<bool> updating{false};
+// steady_ns() of the first reference point, 0 before the first read
+std::atomic<int64_t> calibration_start{0};
+// Start of the calibration, the long-term rate is measured from here.
+// Written under updating.
+reference_point origin{0, 0};
+
+// Pairs a TSC read with the steady_clock, keeping the tightest of a few
+// brackets so preemption between the two reads does not skew it
+reference_point read_reference() {
+  reference_point best{0, 0};
+  int64_t best_gap = INT64_MAX;
+  for (int i = 0; i < 8; ++i) {
+    const int64_t before = steady_ns();
+    const uint64_t ticks = __rdtsc();
+    const int64_t after = steady_ns();
+    if (after - before < best_gap) {
+      best_gap = after - before;
+      best = {ticks, before + (after - before) / 2};
+    }
+  }
+  return best;
+}
+
+// Under updating
+void publish(uint64_t base_ticks, int64_t base_ns, uint64_t ns_per_tick) {
+  auto& cal = detail::tsc;
+  const uint32_t sequence = cal.sequence.load(std::memory_order_relaxed);
+  cal.sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  cal.base_ticks.store(base_ticks, std::memory_order_relaxed);
+  cal.base_ns.store(base_ns, std::memory_order_relaxed);
+  cal.ns_per_tick.store(ns_per_tick, std::memory_order_relaxed);
+  cal.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+uint64_t rate_between(const reference_point& start,
+                      const reference_point& end) {
+  return static_cast<uint64_t>(
+      (static_cast<unsigned __int128>(end.ns - start.ns) << 32) /
+      (end.ticks - start.ticks));
+}
+
+uint64_t ticks_per_period(uint64_t ns_per_tick) {
+  return static_cast<uint64_t>(
+      (static_cast<unsigned __int128>(correction_period_ns) << 32) /
+      ns_per_tick);
+}
+
+// Continues from the current estimate, at a rate that meets steady_clock
+// again one correction period from now. Under updating.
+void correct(const reference_point& now) {
+  auto& cal = detail::tsc;
+  const uint64_t base_ticks = cal.base_ticks.load(std::memory_order_relaxed);
+  if (now.ticks <= base_ticks || now.ticks <= origin.ticks) {
+    return;
+  }
+  const int64_t estimate =
+      cal.base_ns.load(std::memory_order_relaxed) +
+      static_cast<int64_t>(
+          (static_cast<unsigned __int128>(now.ticks - base_ticks) *
+           cal.ns_per_tick.load(std::memory_order_relaxed)) >>
+          32);
+  const uint64_t long_term = rate_between(origin, now);
+  const uint64_t period_ticks = ticks_per_period(long_term);
+  cal.next_correction.store(now.ticks + period_ticks,
+                            std::memory_order_relaxed);
+  int64_t error = now.ns - estimate;
+  if (error > correction_period_ns) {
+    // Far behind, e.g. the TSC stopped in a sleep state: jump forwards
+    publish(now.ticks, now.ns, long_term);
+    return;
+  }
+  // Keeps the rate positive when far ahead
+  error = std::max(error, -correction_period_ns / 2);
+  const auto rate = static_cast<uint64_t>(
+      (static_cast<unsigned __int128>(correction_period_ns + error) << 32) /
+      period_ticks);
+  publish(now.ticks, estimate, rate);
+}
+
+bool invariant_tsc() {
+  unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+  // CPUID 0x80000007 EDX bit 8: invariant TSC
+  return __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) &&
+         (edx & (1u << 8)) != 0;
+}
+
+// Takes the first reference point, or publishes the rate measured since
+// then once calibration_ns have passed. Under updating.
+void calibrate_step() {
+  auto& cal = detail::tsc;
+  if (cal.usable.load(std::memory_order_relaxed)) {
+    return;
+  }
+  const auto now = read_reference();
+  if (calibration_start.load(std::memory_order_relaxed) == 0 ||
+      now.ticks <= origin.ticks) {
+    origin = now;
+    calibration_start.store(now.ns, std::memory_order_relaxed);
+    return;
+  }
+  if (now.ns - origin.ns < calibration_ns) {
+    return;
+  }
+  const uint64_t rate = rate_between(origin, now);
+  publish(now.ticks, now.ns, rate);
+  cal.next_correction.store(now.ticks + ticks_per_period(rate),
+                            std::memory_order_relaxed);
+  cal.usable.store(true, std::memory_order_release);
+}
+
+// The thread holding updating, or publishing, did not survive fork()
+void reset_tsc_after_fork() {
+  auto& cal = detail::tsc;
+  if ((cal.sequence.load(std::memory_order_relaxed) & 1) != 0) {
+    // Cut short mid-publish, calibrates again from scratch
+    cal.usable.store(false, std::memory_order_relaxed);
+    cal.sequence.fetch_add(1, std::memory_order_relaxed);
+    calibration_start.store(0, std::memory_order_relaxed);
+  }
+  updating.store(false, std::memory_order_relaxed);
+}
+#endif
+
+// The coarse clocks the readers fall back to, so they agree with them
+void refresh_cached() {
+  detail::cached_steady_ms.store(monotonic_coarse_ns() / 1000000,
+                                 std::memory_order_relaxed);
+  detail::cached_unix_ms.store(realtime_coarse_ns() / 1000000,
+                               std::memory_order_relaxed);
+}
+
+void run_ticker() {
+  while (!ticker_stopping.load(std::memory_order_relaxed)) {
+    std::this_thread::sleep_for(tick_interval);
+    refresh_cached();
+  }
+}
+
+// Stops the ticker when static objects are destroyed
+struct ticker_reaper {
+  ~ticker_reaper() {
+    stop_ticker();
+    std::lock_guard<std::mutex> lock(ticker_mtx);
+    shut_down = true;
+  }
+} reaper;
+
+// Held across fork(), so the child gets ticker in a consistent state
+void lock_ticker() {
+  ticker_mtx.lock();
+}
+
+void unlock_ticker() {
+  ticker_mtx.unlock();
+}
+
+void reset_after_fork() {
+  // The ticker does not survive fork(), the child runs without one
+  ticker = nullptr;
+  ticker_stopping.store(false, std::memory_order_relaxed);
+  detail::cached_unix_ms.store(0, std::memory_order_relaxed);
+  detail::cached_steady_ms.store(0, std::memory_order_relaxed);
+#ifdef CPPUTILS_HAS_TSC
+  reset_tsc_after_fork();
+#endif
+  unlock_ticker();
+}
+
+void register_fork_handler() {
+  static std::once_flag at_fork;
+  std::call_once(at_fork, [] {
+    pthread_atfork(lock_ticker, unlock_ticker, reset_after_fork);
+  });
+}
+
+}  // namespace
+
+namespace detail {
+std::atomic<int64_t> cached_unix_ms{0};
+std::atomic<int64_t> cached_steady_ms{0};
+tsc_calibration tsc;
+
+int64_t calibrate_tsc() {
+  const int64_t now = steady_ns();
+#ifdef CPPUTILS_HAS_TSC
+  static const bool invariant = invariant_tsc();
+  if (!invariant) {
+    return now;
+  }
+  const int64_t start = calibration_start.load(std::memory_order_relaxed);
+  if (start != 0 && now - start < calibration_ns) {
+    return now;
+  }
+  if (!updating.exchange(true, std::memory_order_acquire)) {
+    register_fork_handler();
+    calibrate_step();
+    updating.store(false, std::memory_order_release);
+  }
+#endif
+  return now;
+}
+
+void correct_tsc([[maybe_unused]] uint64_t ticks) {
+#ifdef CPPUTILS_HAS_TSC
+  if (updating.exchange(true, std::memory_order_acquire)) {
+    return;
+  }
+  // Unless another reader got here first
+  if (ticks >= tsc.next_correction.load(std::memory_order_relaxed)) {
+    correct(read_reference());
+  }
+  updating.store(false, std::memory_order_release);
+#endif
+}
+}  // namespace detail
+
+void start_ticker() {
+  std::lock_guard<std::mutex> lock(ticker_mtx);
+  if (ticker != nullptr || shut_down) {
+    return;
+  }
+  register_fork_handler();
+  refresh_cached();
+  ticker = new std::thread(run_ticker);
+}
+
+void stop_ticker() {
+  std::lock_guard<std::mutex> lock(ticker_mtx);
+  if (ticker == nullptr) {
+    return;
+  }
+  ticker_stopping.store(true, std::memory_order_relaxed);
+  ticker->join();
+  delete ticker;
+  ticker = nullptr;
+  ticker_stopping.store(false, std::memory_order_relaxed);
+  detail::cached_unix_ms.store(0, std::memory_order_relaxed);
+  detail::cached_steady_ms.store(0, std::memory_order_relaxed);
+}
+
+}  // namespace clocks
+}  // namespace cpputils
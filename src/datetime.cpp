@@ -0,0 +1,217 @@
+#include "cpputils/datetime.h"
+#include <array>
+#include <cstring>
+
+namespace cpputils {
+namespace datetime {
+
+namespace {
+
+using detail::civil;
+using detail::civil_from_days;
+using detail::days_from_civil;
+using detail::days_in_month;
+using std::chrono::system_clock;
+
+constexpr int64_t ns_per_second = 1000000000;
+constexpr int64_t seconds_per_day = 86400;
+
+static_assert(days_from_civil(1970, 1, 1) == 0);
+static_assert(days_from_civil(2000, 3, 1) == 11017);
+static_assert(civil_from_days(11017).month == 3);
+
+// "00" ... "99"
+constexpr auto digit_pairs = []() {
+  std::array<char, 200> table{};
+  for (int i = 0; i < 100; ++i) {
+    table[2 * i] = static_cast<char>('0' + i / 10);
+    table[2 * i + 1] = static_cast<char>('0' + i % 10);
+  }
+  return table;
+}();
+
+inline void write2(char* out, unsigned value) {
+  std::memcpy(out, &digit_pairs[2 * value], 2);
+}
+
+// "YYYY-MM-DDTHH:MM:SS" of one second since the epoch. system_clock spans
+// a few centuries around 1970, so the year always has four digits.
+void format_second(char* out, int64_t seconds) {
+  int64_t days = seconds / seconds_per_day;
+  int64_t rest = seconds % seconds_per_day;
+  if (rest < 0) {
+    rest += seconds_per_day;
+    --days;
+  }
+  const civil date = civil_from_days(days);
+  const auto year = static_cast<unsigned>(date.year);
+  write2(out, year / 100 % 100);
+  write2(out + 2, year % 100);
+  out[4] = '-';
+  write2(out + 5, date.month);
+  out[7] = '-';
+  write2(out + 8, date.day);
+  out[10] = 'T';
+  const auto time = static_cast<unsigned>(rest);
+  write2(out + 11, time / 3600);
+  out[13] = ':';
+  write2(out + 14, time / 60 % 60);
+  out[16] = ':';
+  write2(out + 17, time % 60);
+}
+
+constexpr size_t second_length = 19;
+
+struct second_cache {
+  int64_t second = INT64_MIN;
+  char text[second_length];
+};
+
+thread_local second_cache cache;
+
+// Reads count digits, -1 if any of them is not one
+inline int parse_digits(const char* in, size_t count) {
+  int value = 0;
+  for (size_t i = 0; i < count; ++i) {
+    const unsigned digit = static_cast<unsigned char>(in[i]) - '0';
+    if (digit > 9) {
+      return -1;
+    }
+    value = value * 10 + static_cast<int>(digit);
+  }
+  return value;
+}
+
+}  // namespace
+
+size_t format_rfc3339(char* buf, system_clock::time_point tp,
+                      precision digits) {
+  const int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         tp.time_since_epoch())
+                         .count();
+  int64_t seconds = ns / ns_per_second;
+  int64_t fraction = ns % ns_per_second;
+  if (fraction < 0) {
+    fraction += ns_per_second;
+    --seconds;
+  }
+
+  if (cache.second != seconds) {
+    format_second(cache.text, seconds);
+    cache.second = seconds;
+  }
+  std::memcpy(buf, cache.text, second_length);
+
+  size_t length = second_length;
+  size_t count = 0;
+  switch (digits) {
+    case precision::seconds:
+      break;
+    case precision::milliseconds:
+      count = 3;
+      fraction /= 1000000;
+      break;
+    case precision::microseconds:
+      count = 6;
+      fraction /= 1000;
+      break;
+    case precision::nanoseconds:
+      count = 9;
+      break;
+  }
+  if (count > 0) {
+    buf[length] = '.';
+    auto value = static_cast<unsigned>(fraction);
+    size_t i = count;
+    if (i % 2 == 1) {
+      buf[length + i] = static_cast<char>('0' + value % 10);
+      value /= 10;
+      --i;
+    }
+    for (; i > 0; i -= 2) {
+      write2(buf + length + i - 1, value % 100);
+      value /= 100;
+    }
+    length += count + 1;
+  }
+  buf[length++] = 'Z';
+  return length;
+}
+
+std::optional<system_clock::time_point> parse_rfc3339(std::string_view text) {
+  // Shortest form "YYYY-MM-DDTHH:MM:SSZ"
+  if (text.size() < second_length + 1) {
+    return std::nullopt;
+  }
+  const char* in = text.data();
+  if (in[4] != '-' || in[7] != '-' || in[13] != ':' || in[16] != ':' ||
+      (in[10] != 'T' && in[10] != 't' && in[10] != ' ')) {
+    return std::nullopt;
+  }
+  const int year = parse_digits(in, 4);
+  const int month = parse_digits(in + 5, 2);
+  const int day = parse_digits(in + 8, 2);
+  const int hour = parse_digits(in + 11, 2);
+  const int minute = parse_digits(in + 14, 2);
+  const int second = parse_digits(in + 17, 2);
+  if (year < 0 || month < 1 || month > 12 || day < 1 ||
+      day > static_cast<int>(days_in_month(year, month)) || hour < 0 ||
+      hour > 23 || minute < 0 || minute > 59 || second < 0 || second > 59) {
+    return std::nullopt;
+  }
+
+  size_t pos = second_length;
+  int64_t fraction = 0;
+  if (in[pos] == '.') {
+    ++pos;
+    const size_t start = pos;
+    for (; pos < text.size() && in[pos] >= '0' && in[pos] <= '9'; ++pos) {
+      if (pos - start < 9) {
+        fraction = fraction * 10 + (in[pos] - '0');
+      }
+    }
+    if (pos == start) {
+      return std::nullopt;
+    }
+    for (size_t scale = pos - start; scale < 9; ++scale) {
+      fraction *= 10;
+    }
+  }
+
+  int offset = 0;
+  if (pos + 1 == text.size() && (in[pos] == 'Z' || in[pos] == 'z')) {
+    offset = 0;
+  } else if (pos + 6 == text.size() && (in[pos] == '+' || in[pos] == '-') &&
+             in[pos + 3] == ':') {
+    const int offset_hour = parse_digits(in + pos + 1, 2);
+    const int offset_minute = parse_digits(in + pos + 4, 2);
+    if (offset_hour < 0 || offset_hour > 23 || offset_minute < 0 ||
+        offset_minute > 59) {
+      return std::nullopt;
+    }
+    offset = (offset_hour * 60 + offset_minute) * 60;
+    if (in[pos] == '-') {
+      offset = -offset;
+    }
+  } else {
+    return std::nullopt;
+  }
+
+  const int64_t seconds =
+      days_from_civil(year, static_cast<unsigned>(month),
+                      static_cast<unsigned>(day)) *
+          seconds_per_day +
+      hour * 3600 + minute * 60 + second - offset;
+  // Beyond what a nanosecond system_clock can hold
+  constexpr int64_t limit = INT64_MAX / ns_per_second - 1;
+  if (seconds > limit || seconds < -limit) {
+    return std::nullopt;
+  }
+  const std::chrono::nanoseconds since_epoch(seconds * ns_per_second +
+                                             fraction);
+  return system_clock::time_point(
+      std::chrono::duration_cast<system_clock::duration>(since_epoch));
+}
+
+}  // namespace datetime
+}  // namespace cpputils
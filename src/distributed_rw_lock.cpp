@@ -0,0 +1,58 @@
+#include "cpputils/distributed_rw_lock.h"
+#include <thread>
+
+using cpputils::DistributedRWLock;
+
+DistributedRWLock::DistributedRWLock(size_t slot_count) {
+  if (slot_count == 0) {
+    slot_count = std::thread::hardware_concurrency();
+  }
+  size_t rounded = 1;
+  while (rounded < slot_count) {
+    rounded <<= 1;
+  }
+  slots = std::make_unique<Slot[]>(rounded);
+  slot_mask = rounded - 1;
+}
+
+void DistributedRWLock::wait_for_writer() {
+  // The writer holds writer_mtx for its whole critical section
+  std::lock_guard<std::mutex> lock(writer_mtx);
+}
+
+// Slot loads are seq_cst like the writer_active store before them and the
+// reader's increment and load. Acquire loads could be ordered before the
+// store, then the writer and a reader each miss the other (store buffering).
+void DistributedRWLock::drain_readers() const {
+  for (size_t i = 0; i <= slot_mask; ++i) {
+    while (slots[i].readers.load(std::memory_order_seq_cst) != 0) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+void DistributedRWLock::lock() {
+  writer_mtx.lock();
+  writer_active.store(true, std::memory_order_seq_cst);
+  drain_readers();
+}
+
+bool DistributedRWLock::try_lock() {
+  if (!writer_mtx.try_lock()) {
+    return false;
+  }
+  writer_active.store(true, std::memory_order_seq_cst);
+  for (size_t i = 0; i <= slot_mask; ++i) {
+    if (slots[i].readers.load(std::memory_order_seq_cst) != 0) {
+      writer_active.store(false, std::memory_order_release);
+      writer_mtx.unlock();
+      return false;
+    }
+  }
+  return true;
+}
+
+void DistributedRWLock::unlock() {
+  writer_active.store(false, std::memory_order_release);
+  writer_mtx.unlock();
+}
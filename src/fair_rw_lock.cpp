@@ -8,12 +8,12 @@ FairRWLock::FairRWLock(FairRWLock&& other) noexcept
       cv(),
       active_readers(other.active_readers),
       active_writers(other.active_writers),
-      waiting_writers(other.waiting_writers) {}
+      waiting_writers(other.waiting_writers),
+      active_upgrader(other.active_upgrader) {}
 
 void FairRWLock::acquire_read() const {
   std::unique_lock<std::mutex> lock(mtx);
-  cv.wait(lock,
-          [this]() { return active_writers == 0 && waiting_writers == 0; });
+  cv.wait(lock, [this]() { return can_read(); });
   ++active_readers;
   rwLock.lock_shared();
 }
@@ -29,8 +29,7 @@ void FairRWLock::release_read() const {
 void FairRWLock::acquire_write() {
   std::unique_lock<std::mutex> lock(mtx);
   ++waiting_writers;
-  cv.wait(lock,
-          [this]() { return active_readers == 0 && active_writers == 0; });
+  cv.wait(lock, [this]() { return can_write(); });
   --waiting_writers;
   ++active_writers;
   rwLock.lock();
@@ -42,3 +41,62 @@ void FairRWLock::release_write() {
   --active_writers;
   cv.notify_all();
 }
+
+void FairRWLock::acquire_upgradable() {
+  std::unique_lock<std::mutex> lock(mtx);
+  cv.wait(lock, [this]() { return can_upgradable(); });
+  active_upgrader = true;
+  rwLock.lock_shared();
+}
+
+void FairRWLock::release_upgradable() {
+  rwLock.unlock_shared();
+  std::unique_lock<std::mutex> lock(mtx);
+  active_upgrader = false;
+  cv.notify_all();
+}
+
+void FairRWLock::upgrade() {
+  // Writers stay excluded by active_upgrader until we become the writer, so
+  // dropping the shared lock first does not open a gap
+  rwLock.unlock_shared();
+  std::unique_lock<std::mutex> lock(mtx);
+  // Counting as a waiting writer stops new readers, only the current readers
+  // must drain
+  ++waiting_writers;
+  cv.wait(lock, [this]() { return active_readers == 0; });
+  --waiting_writers;
+  active_upgrader = false;
+  ++active_writers;
+  rwLock.lock();
+}
+
+bool FairRWLock::try_acquire_read() const {
+  std::unique_lock<std::mutex> lock(mtx);
+  if (!can_read()) {
+    return false;
+  }
+  ++active_readers;
+  rwLock.lock_shared();
+  return true;
+}
+
+bool FairRWLock::try_acquire_write() {
+  std::unique_lock<std::mutex> lock(mtx);
+  if (!can_write()) {
+    return false;
+  }
+  ++active_writers;
+  rwLock.lock();
+  return true;
+}
+
+bool FairRWLock::try_acquire_upgradable() {
+  std::unique_lock<std::mutex> lock(mtx);
+  if (!can_upgradable()) {
+    return false;
+  }
+  active_upgrader = true;
+  rwLock.lock_shared();
+  return true;
+}
@@ -1,50 +1,1300 @@
 #include "cpputils/file_container.h"
-#include <fstream>
-#include <sstream>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#endif
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory_resource>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "cpputils/clock.h"
+#include "cpputils/task_scheduler.h"
 
 namespace cpputils {
 
-std::string FileContainer::read_file(const std::filesystem::path& file_path) {
-  std::ifstream file(
-      file_path,
-      std::ios::in |
-          std::ios::binary);  // Open in binary mode to preserve all bytes
-  if (!file.is_open()) {
-    return "";
+namespace {
+
+constexpr char pack_magic[8] = {'C', 'P', 'U', 'P', 'A', 'C', 'K', '\0'};
+constexpr uint32_t pack_version = 1;
+constexpr uint64_t pack_page = 4096;
+constexpr uint64_t pack_align = 64;
+
+struct PackHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t count;
+  uint64_t index_offset;  // Offsets are from the start of the file
+  uint64_t names_offset;
+  uint64_t data_offset;
+  uint64_t file_size;
+  uint32_t index_crc;   // Index and names
+  uint32_t header_crc;  // This header with header_crc = 0
+  uint64_t reserved;
+};
+static_assert(sizeof(PackHeader) == 64);
+
+struct PackEntry {
+  uint64_t name_offset;  // From names_offset
+  uint64_t data_offset;  // From data_offset
+  uint64_t size;
+  int64_t mtime_ns;
+  uint32_t name_size;
+  uint32_t crc;
+  uint32_t flags;
+  uint32_t reserved;
+};
+static_assert(sizeof(PackEntry) == 48);
+
+constexpr uint32_t pack_has_stamp = 1;
+
+// CRC-32 (IEEE, reflected), table driven
+uint32_t crc32(const char* data, size_t size, uint32_t crc = 0) {
+  static const auto table = []() {
+    std::array<uint32_t, 256> t{};
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; ++k) {
+        c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      }
+      t[i] = c;
+    }
+    return t;
+  }();
+  crc = ~crc;
+  for (size_t i = 0; i < size; ++i) {
+    crc = table[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+uint64_t align_up(uint64_t value, uint64_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+// Rounded down so the shards together stay within the limit, but never 0,
+// which would make a shard unlimited
+size_t shard_budget(size_t limit, size_t shards) {
+  return limit == 0 ? 0 : std::max<size_t>(limit / shards, 1);
+}
+
+// Defaults apart from the load mode
+FileContainerOptions options_with(FileLoadMode mode) {
+  FileContainerOptions options;
+  options.mode = mode;
+  return options;
+}
+
+FileStamp stamp_of(const struct stat& st) {
+  return {static_cast<int64_t>(st.st_mtim.tv_sec) * 1'000'000'000 +
+              st.st_mtim.tv_nsec,
+          static_cast<uint64_t>(st.st_size)};
+}
+
+// Buffered writes to a file descriptor, retrying interrupted ones
+class FdWriter {
+ public:
+  explicit FdWriter(int fd) : fd_(fd) {}
+
+  bool write(const char* data, size_t size) {
+    if (buffer_.size() + size > capacity) {
+      if (!flush()) {
+        return false;
+      }
+      if (size > capacity) {
+        return write_all(data, size);
+      }
+    }
+    buffer_.append(data, size);
+    return true;
+  }
+
+  bool flush() {
+    const bool ok = write_all(buffer_.data(), buffer_.size());
+    buffer_.clear();
+    return ok;
+  }
+
+ private:
+  static constexpr size_t capacity = 1 << 20;
+  const int fd_;
+  std::string buffer_;
+
+  bool write_all(const char* data, size_t size) {
+    while (size > 0) {
+      const ssize_t n = ::write(fd_, data, size);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        return false;
+      }
+      data += n;
+      size -= static_cast<size_t>(n);
+    }
+    return true;
+  }
+};
+
+// Makes a rename or creation in directory durable
+bool sync_directory(const std::filesystem::path& directory) {
+  const int fd = ::open(directory.empty() ? "." : directory.c_str(),
+                        O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  const bool ok = ::fsync(fd) == 0;
+  ::close(fd);
+  return ok;
+}
+
+// Runs job on the indices taken from next until count. The first error
+// ends the batch for every thread working on it.
+std::exception_ptr take_jobs(std::atomic<size_t>& next, size_t count,
+                             const std::function<void(size_t)>& job) {
+  try {
+    for (size_t i = next++; i < count; i = next++) {
+      job(i);
+    }
+  } catch (...) {
+    next = count;
+    return std::current_exception();
+  }
+  return nullptr;
+}
+
+}  // namespace
+
+FileStamp FileStamp::Of(const std::filesystem::path& file_path) {
+  struct stat st {};
+  if (::stat(file_path.c_str(), &st) != 0) {
+    return {};
+  }
+  return stamp_of(st);
+}
+
+FileBuffer::FileBuffer(std::string content, std::optional<FileStamp> stamp)
+    : owned_(std::move(content)),
+      data_(owned_.data()),
+      size_(owned_.size()),
+      mapped_(false),
+      stamp_(stamp) {}
+
+FileBuffer::FileBuffer(const char* data, size_t size, FileStamp stamp)
+    : data_(data), size_(size), mapped_(true), stamp_(stamp) {}
+
+FileBuffer::FileBuffer(const char* data, size_t size,
+                       std::shared_ptr<const void> owner,
+                       std::optional<FileStamp> stamp)
+    : data_(data),
+      size_(size),
+      mapped_(true),
+      owner_(std::move(owner)),
+      stamp_(stamp) {}
+
+FileBuffer::~FileBuffer() {
+  if (mapped_ && !owner_) {
+    ::munmap(const_cast<char*>(data_), size_);
+  }
+}
+
+std::shared_ptr<const FileBuffer> FileBuffer::Read(
+    const std::filesystem::path& file_path) {
+  const int fd = ::open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return std::shared_ptr<const FileBuffer>(new FileBuffer({}, FileStamp{}));
+  }
+
+  struct stat st {};
+  if (::fstat(fd, &st) != 0) {
+    ::close(fd);
+    return std::shared_ptr<const FileBuffer>(new FileBuffer({}, FileStamp{}));
   }
 
-  std::stringstream buffer;
-  buffer << file.rdbuf();
-  return buffer.str();
+  // Read straight into the final string instead of through a stringstream,
+  // sized by fstat and grown for files that report no size
+  std::string content(static_cast<size_t>(st.st_size), '\0');
+  size_t filled = 0;
+  while (true) {
+    if (filled == content.size()) {
+      content.resize(content.empty() ? 4096 : content.size() * 2);
+    }
+    const ssize_t n =
+        ::read(fd, content.data() + filled, content.size() - filled);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+    filled += static_cast<size_t>(n);
+  }
+  ::close(fd);
+  content.resize(filled);
+  return std::shared_ptr<const FileBuffer>(
+      new FileBuffer(std::move(content), stamp_of(st)));
 }
 
-std::string FileContainer::GetFileContent(const std::string& filename) {
-  std::lock_guard<std::mutex> lock(mtx);
-  // Check cache first
-  auto it = data.find(filename);
-  if (it != data.end()) {
-    return it->second;
+std::shared_ptr<const FileBuffer> FileBuffer::Map(
+    const std::filesystem::path& file_path) {
+  const int fd = ::open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return std::shared_ptr<const FileBuffer>(new FileBuffer({}, FileStamp{}));
+  }
+
+  struct stat st {};
+  if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+    ::close(fd);
+    return Read(file_path);
+  }
+
+  const auto size = static_cast<size_t>(st.st_size);
+  void* addr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);  // The mapping keeps the file alive
+  if (addr == MAP_FAILED) {
+    return Read(file_path);
+  }
+  return std::shared_ptr<const FileBuffer>(
+      new FileBuffer(static_cast<const char*>(addr), size, stamp_of(st)));
+}
+
+std::shared_ptr<const FileBuffer> FileBuffer::FromString(std::string content) {
+  return std::shared_ptr<const FileBuffer>(
+      new FileBuffer(std::move(content), std::nullopt));
+}
+
+struct FileContainer::Shard {
+  struct Entry {
+    explicit Entry(std::pmr::memory_resource* memory) : name(memory) {}
+
+    std::pmr::string name;
+    BufferPtr buffer;
+    Entry* prev = nullptr;
+    Entry* next = nullptr;
+    uint8_t freq = 0;  // S3-FIFO hits since insertion or promotion, max 3
+    bool main = true;  // Queue the entry is in, always main for LRU
+    // Last FileWatchMode::Poll comparison, or the load the stamp came from
+    int64_t checked_at = 0;
+  };
+
+  // Intrusive list, newest at the head
+  struct Queue {
+    Entry* head = nullptr;
+    Entry* tail = nullptr;
+    size_t bytes = 0;
+    size_t count = 0;
+
+    void push_front(Entry* e) {
+      e->prev = nullptr;
+      e->next = head;
+      (head ? head->prev : tail) = e;
+      head = e;
+      bytes += e->buffer->view().size();
+      ++count;
+    }
+
+    void remove(Entry* e) {
+      (e->prev ? e->prev->next : head) = e->next;
+      (e->next ? e->next->prev : tail) = e->prev;
+      bytes -= e->buffer->view().size();
+      --count;
+    }
+  };
+
+  // Entries live in the shard's memory resource like the tables below
+  struct EntryDeleter {
+    std::pmr::memory_resource* memory;
+    void operator()(Entry* e) const {
+      e->~Entry();
+      memory->deallocate(e, sizeof(Entry), alignof(Entry));
+    }
+  };
+  using EntryPtr = std::unique_ptr<Entry, EntryDeleter>;
+
+  explicit Shard(std::pmr::memory_resource* Memory)
+      : memory(Memory),
+        index(Memory),
+        loading(Memory),
+        ghost(Memory),
+        ghost_set(Memory) {}
+
+  std::mutex mtx;
+  std::pmr::memory_resource* memory;
+  // Keys view the name owned by the entry
+  std::pmr::unordered_map<std::string_view, EntryPtr> index;
+  // Reads in progress, later misses wait on these instead of reading again
+  struct Loading {
+    std::shared_future<BufferPtr> result;
+    // Changed on disk during the read, which then reads again
+    bool dirty = false;
+  };
+  std::pmr::map<std::pmr::string, Loading, std::less<>> loading;
+  Queue small;
+  Queue main;
+  // S3-FIFO: hashes of names recently evicted from the small queue
+  std::pmr::deque<size_t> ghost;
+  std::pmr::unordered_multiset<size_t> ghost_set;
+
+  EvictionPolicy policy = EvictionPolicy::LRU;
+  size_t max_bytes = 0;
+  size_t max_entries = 0;
+
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t evictions = 0;
+
+  Queue& queue_of(const Entry& e) { return e.main ? main : small; }
+
+  // Cached entry or nullptr, counts the access
+  Entry* find(std::string_view name) {
+    auto it = index.find(name);
+    if (it == index.end()) {
+      ++misses;
+      return nullptr;
+    }
+    ++hits;
+    Entry* e = it->second.get();
+    if (policy == EvictionPolicy::LRU) {
+      main.remove(e);
+      main.push_front(e);
+    } else if (e->freq < 3) {
+      ++e->freq;
+    }
+    return e;
+  }
+
+  // Returns what is cached under name afterwards, the existing entry
+  // unless overwrite is set
+  BufferPtr insert(std::string_view name, BufferPtr buffer, bool overwrite) {
+    auto it = index.find(name);
+    if (it != index.end()) {
+      if (!overwrite) {
+        return it->second->buffer;
+      }
+      replace(it->second.get(), buffer);
+      return buffer;
+    }
+
+    if (max_bytes != 0 && buffer->view().size() > max_bytes) {
+      return buffer;
+    }
+
+    EntryPtr entry(
+        new (memory->allocate(sizeof(Entry), alignof(Entry))) Entry(memory),
+        EntryDeleter{memory});
+    entry->name = name;
+    entry->buffer = buffer;
+    entry->checked_at = clocks::steady_ns();
+    Entry* e = entry.get();
+    index.emplace(e->name, std::move(entry));
+
+    if (policy == EvictionPolicy::S3FIFO && !forget_ghost(name)) {
+      e->main = false;
+      small.push_front(e);
+    } else {
+      main.push_front(e);
+    }
+    evict();
+    return buffer;
+  }
+
+  // Swaps the contents of an entry in place
+  void replace(Entry* e, BufferPtr buffer) {
+    auto& queue = queue_of(*e);
+    queue.remove(e);
+    e->buffer = std::move(buffer);
+    e->checked_at = clocks::steady_ns();
+    queue.push_front(e);
+    evict();
+  }
+
+  void erase(std::string_view name) {
+    auto it = index.find(name);
+    if (it != index.end()) {
+      Entry* e = it->second.get();
+      queue_of(*e).remove(e);
+      index.erase(it);
+    }
+  }
+
+  // A read of name in progress has to start over, it may predate a change
+  void mark_dirty(std::string_view name) {
+    if (auto it = loading.find(name); it != loading.end()) {
+      it->second.dirty = true;
+    }
+  }
+
+  // Drops everything below directory/ and restarts reads there
+  void erase_under(std::string_view directory) {
+    const auto under = [directory](std::string_view name) {
+      return name.size() > directory.size() &&
+             name.compare(0, directory.size(), directory) == 0 &&
+             name[directory.size()] == '/';
+    };
+    for (auto it = index.begin(); it != index.end();) {
+      Entry* e = it->second.get();
+      if (under(e->name)) {
+        queue_of(*e).remove(e);
+        it = index.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    for (auto it = loading.lower_bound(directory);
+         it != loading.end() &&
+         std::string_view(it->first).substr(0, directory.size()) == directory;
+         ++it) {
+      if (under(it->first)) {
+        it->second.dirty = true;
+      }
+    }
+  }
+
+  bool over_budget() const {
+    return (max_bytes != 0 && small.bytes + main.bytes > max_bytes) ||
+           (max_entries != 0 && index.size() > max_entries);
+  }
+
+  bool small_over_budget() const {
+    return (max_bytes != 0 && small.bytes > max_bytes / 10) ||
+           (max_entries != 0 && small.count > max_entries / 10);
+  }
+
+  void evict() {
+    while (over_budget()) {
+      if (policy == EvictionPolicy::LRU) {
+        drop(main.tail);
+      } else if (small.count != 0 && (small_over_budget() || main.count == 0)) {
+        evict_small();
+      } else {
+        evict_main();
+      }
+    }
+  }
+
+  // Entries hit while in the small queue move to main, the others leave a
+  // ghost so a quick return goes straight to main
+  void evict_small() {
+    Entry* e = small.tail;
+    if (e->freq > 0) {
+      small.remove(e);
+      e->freq = 0;
+      e->main = true;
+      main.push_front(e);
+      return;
+    }
+    remember_ghost(std::hash<std::string_view>{}(e->name));
+    drop(e);
+  }
+
+  // Main is a FIFO with reinsertion, each hit buys one more round
+  void evict_main() {
+    Entry* e = main.tail;
+    if (e->freq > 0) {
+      main.remove(e);
+      --e->freq;
+      main.push_front(e);
+      return;
+    }
+    drop(e);
+  }
+
+  void drop(Entry* e) {
+    queue_of(*e).remove(e);
+    index.erase(index.find(e->name));
+    ++evictions;
+  }
+
+  void remember_ghost(size_t hash) {
+    ghost.push_back(hash);
+    ghost_set.insert(hash);
+    // About as many ghosts as cached entries
+    while (ghost.size() > index.size() + 1) {
+      auto it = ghost_set.find(ghost.front());
+      if (it != ghost_set.end()) {
+        ghost_set.erase(it);
+      }
+      ghost.pop_front();
+    }
+  }
+
+  bool forget_ghost(std::string_view name) {
+    auto it = ghost_set.find(std::hash<std::string_view>{}(name));
+    if (it == ghost_set.end()) {
+      return false;
+    }
+    // Left in the deque, aging it out later finds nothing to erase
+    ghost_set.erase(it);
+    return true;
+  }
+};
+
+// Background reloads for FileWatchMode, and the inotify reader feeding them
+struct FileContainer::Watcher {
+  FileContainer& owner;
+  bool poll = true;  // Hits compare stamps, unless inotify is running
+
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::deque<std::string> queue;
+  std::unordered_set<std::string> queued;  // Coalesces repeated changes
+  bool stopping = false;
+  std::thread reloader;
+
+  int inotify_fd = -1;
+  int wake_fd = -1;
+  std::unordered_map<int, std::string> dirs;  // Watch to relative directory
+  std::thread reader;
+
+  Watcher(FileContainer& Owner, FileWatchMode mode) : owner(Owner) {
+#ifdef __linux__
+    if (mode == FileWatchMode::Inotify) {
+      start_inotify();
+    }
+#endif
+    reloader = std::thread([this]() { reload_loop(); });
+  }
+
+  ~Watcher() {
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      stopping = true;
+    }
+    cv.notify_all();
+    if (reader.joinable()) {
+      const uint64_t one = 1;
+      [[maybe_unused]] auto written = ::write(wake_fd, &one, sizeof(one));
+      reader.join();
+    }
+    reloader.join();
+    close_fds();
+  }
+
+  void enqueue(std::string filename) {
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      if (stopping || !queued.insert(filename).second) {
+        return;
+      }
+      queue.push_back(std::move(filename));
+    }
+    cv.notify_one();
+  }
+
+  void reload_loop() {
+    std::unique_lock<std::mutex> lock(mtx);
+    while (true) {
+      cv.wait(lock, [this]() { return stopping || !queue.empty(); });
+      if (stopping) {
+        return;
+      }
+      std::string filename = std::move(queue.front());
+      queue.pop_front();
+      // Changes from here on queue it again
+      queued.erase(filename);
+      lock.unlock();
+      try {
+        owner.reload(filename);
+      } catch (...) {
+        // The old contents stay cached
+      }
+      lock.lock();
+    }
+  }
+
+  void close_fds() {
+    if (inotify_fd >= 0) {
+      ::close(inotify_fd);
+    }
+    if (wake_fd >= 0) {
+      ::close(wake_fd);
+    }
+    inotify_fd = wake_fd = -1;
+  }
+
+#ifdef __linux__
+  void start_inotify() {
+    inotify_fd = ::inotify_init1(IN_CLOEXEC);
+    wake_fd = ::eventfd(0, EFD_CLOEXEC);
+    if (inotify_fd < 0 || wake_fd < 0) {
+      close_fds();
+      return;
+    }
+    add_watches("");
+    if (dirs.empty()) {
+      close_fds();
+      return;
+    }
+    poll = false;
+    reader = std::thread([this]() { watch_loop(); });
+  }
+
+  // Watches rel_dir and every directory below it
+  void add_watches(const std::string& rel_dir) {
+    const auto dir = rel_dir.empty() ? owner.abs_path : owner.abs_path / rel_dir;
+    const int wd = ::inotify_add_watch(
+        inotify_fd, dir.c_str(),
+        IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_CREATE |
+            IN_ONLYDIR);
+    if (wd < 0) {
+      return;
+    }
+    dirs[wd] = rel_dir;
+
+    std::error_code ec;
+    for (std::filesystem::directory_iterator it(dir, ec), end; !ec && it != end;
+         it.increment(ec)) {
+      if (it->is_directory(ec) && !it->is_symlink(ec)) {
+        const auto name = it->path().filename().string();
+        add_watches(rel_dir.empty() ? name : rel_dir + "/" + name);
+      }
+    }
+  }
+
+  // Stops watching rel_dir and every directory below it
+  void remove_watches(const std::string& rel_dir) {
+    for (auto it = dirs.begin(); it != dirs.end();) {
+      const std::string& dir = it->second;
+      if (dir == rel_dir || (dir.size() > rel_dir.size() &&
+                             dir.compare(0, rel_dir.size(), rel_dir) == 0 &&
+                             dir[rel_dir.size()] == '/')) {
+        ::inotify_rm_watch(inotify_fd, it->first);
+        it = dirs.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  void watch_loop() {
+    alignas(inotify_event) char buf[16384];
+    pollfd fds[2] = {{inotify_fd, POLLIN, 0}, {wake_fd, POLLIN, 0}};
+    while (true) {
+      if (::poll(fds, 2, -1) < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return;
+      }
+      if (fds[1].revents != 0) {
+        return;
+      }
+      const ssize_t n = ::read(inotify_fd, buf, sizeof(buf));
+      for (ssize_t offset = 0; offset < n;) {
+        const auto* event = reinterpret_cast<const inotify_event*>(buf + offset);
+        handle(*event);
+        offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+      }
+    }
+  }
+
+  void handle(const inotify_event& event) {
+    if (event.mask & IN_Q_OVERFLOW) {
+      // Events were lost, any cached file may have changed
+      owner.reload_all();
+      return;
+    }
+    if (event.mask & IN_IGNORED) {
+      dirs.erase(event.wd);
+      return;
+    }
+    auto dir = dirs.find(event.wd);
+    if (dir == dirs.end() || event.len == 0) {
+      return;
+    }
+
+    std::string name = dir->second.empty()
+                           ? std::string(event.name)
+                           : dir->second + "/" + event.name;
+    if (event.mask & IN_ISDIR) {
+      if (event.mask & (IN_CREATE | IN_MOVED_TO)) {
+        add_watches(name);
+      } else if (event.mask & IN_MOVED_FROM) {
+        // Its files are gone from here, and its watches would keep
+        // reporting them under the old name
+        remove_watches(name);
+        owner.invalidate_directory(name);
+      }
+      return;
+    }
+    if (event.mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+      enqueue(std::move(name));
+    } else if (event.mask & (IN_DELETE | IN_MOVED_FROM)) {
+      owner.invalidate(name);
+    }
+  }
+#endif
+};
+
+// Read-only mapping of a pack written by SaveSnapshot
+struct FileContainer::Snapshot {
+  const char* base = nullptr;
+  size_t size = 0;
+  const PackHeader* header = nullptr;
+  const PackEntry* index = nullptr;
+  const char* names = nullptr;
+  const char* data = nullptr;
+  bool verify = true;
+  // Per entry: 0 unchecked, 1 checksum ok, 2 corrupt
+  std::unique_ptr<std::atomic<uint8_t>[]> verified;
+
+  ~Snapshot() {
+    if (base != nullptr) {
+      ::munmap(const_cast<char*>(base), size);
+    }
+  }
+
+  static std::shared_ptr<const Snapshot> Open(
+      const std::filesystem::path& pack_path, bool verify) {
+    const int fd = ::open(pack_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return nullptr;
+    }
+    struct stat st {};
+    if (::fstat(fd, &st) != 0 ||
+        static_cast<uint64_t>(st.st_size) < sizeof(PackHeader)) {
+      ::close(fd);
+      return nullptr;
+    }
+    void* addr = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ,
+                        MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+      return nullptr;
+    }
+
+    auto snapshot = std::make_shared<Snapshot>();
+    snapshot->base = static_cast<const char*>(addr);
+    snapshot->size = static_cast<size_t>(st.st_size);
+    snapshot->verify = verify;
+    if (!snapshot->validate()) {
+      return nullptr;
+    }
+    snapshot->verified =
+        std::make_unique<std::atomic<uint8_t>[]>(snapshot->header->count);
+    return snapshot;
+  }
+
+  // Only the header and the index are checked here, contents lazily
+  bool validate() {
+    header = reinterpret_cast<const PackHeader*>(base);
+    PackHeader copy = *header;
+    copy.header_crc = 0;
+    if (std::memcmp(header->magic, pack_magic, sizeof(pack_magic)) != 0 ||
+        header->version != pack_version || header->file_size != size ||
+        crc32(reinterpret_cast<const char*>(&copy), sizeof(copy)) !=
+            header->header_crc) {
+      return false;
+    }
+
+    const uint64_t index_size = uint64_t{header->count} * sizeof(PackEntry);
+    if (header->index_offset != sizeof(PackHeader) ||
+        header->names_offset != header->index_offset + index_size ||
+        header->data_offset < header->names_offset ||
+        header->data_offset > size) {
+      return false;
+    }
+    index = reinterpret_cast<const PackEntry*>(base + header->index_offset);
+    names = base + header->names_offset;
+    data = base + header->data_offset;
+    if (crc32(base + header->index_offset,
+              header->data_offset - header->index_offset) !=
+        header->index_crc) {
+      return false;
+    }
+
+    const uint64_t names_size = header->data_offset - header->names_offset;
+    const uint64_t data_size = size - header->data_offset;
+    for (uint32_t i = 0; i < header->count; ++i) {
+      const auto& entry = index[i];
+      // Not summed, a crafted name_offset would wrap around
+      if (entry.name_offset > names_size ||
+          entry.name_size > names_size - entry.name_offset ||
+          entry.data_offset > data_size ||
+          entry.size > data_size - entry.data_offset) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  std::string_view name_of(const PackEntry& entry) const {
+    return {names + entry.name_offset, entry.name_size};
   }
 
+  // Packed contents of filename, nullptr when absent or corrupt
+  BufferPtr find(std::string_view filename,
+                 const std::shared_ptr<const Snapshot>& self) const {
+    const PackEntry* end = index + header->count;
+    const PackEntry* entry = std::lower_bound(
+        index, end, filename, [this](const PackEntry& e, std::string_view n) {
+          return name_of(e) < n;
+        });
+    if (entry == end || name_of(*entry) != filename) {
+      return nullptr;
+    }
+
+    const char* contents = data + entry->data_offset;
+    if (verify) {
+      auto& state = verified[entry - index];
+      if (state.load(std::memory_order_acquire) == 0) {
+        state.store(crc32(contents, entry->size) == entry->crc ? 1 : 2,
+                    std::memory_order_release);
+      }
+      if (state.load(std::memory_order_acquire) != 1) {
+        return nullptr;
+      }
+    }
+
+    std::optional<FileStamp> stamp;
+    if (entry->flags & pack_has_stamp) {
+      stamp = FileStamp{entry->mtime_ns, entry->size};
+    }
+    return BufferPtr(new FileBuffer(contents, entry->size, self, stamp));
+  }
+};
+
+// Worker threads for Preload and batched reads. io_uring would save the
+// threads, but blocking reads on a pool need no extra dependency.
+struct FileContainer::IoPool {
+  std::once_flag started;
+  size_t threads = 0;
+  std::unique_ptr<TaskScheduler<void>> scheduler;
+
+  // Pool whose batch the current thread works on, if any
+  inline static thread_local const IoPool* current = nullptr;
+};
+
+FileContainer::FileContainer(std::string_view folder, FileLoadMode Mode)
+    : FileContainer(folder, options_with(Mode)) {}
+
+FileContainer::FileContainer(std::string_view folder,
+                             const FileContainerOptions& Options)
+    : abs_path(std::filesystem::absolute(folder)),
+      options(Options),
+      io_pool(std::make_unique<IoPool>()) {
+  if (!options.snapshot.empty()) {
+    snapshot = Snapshot::Open(options.snapshot, options.verify_snapshot);
+  }
+  std::pmr::memory_resource* memory =
+      options.memory ? options.memory : std::pmr::get_default_resource();
+  shards.reserve(shard_count);
+  for (size_t i = 0; i < shard_count; ++i) {
+    auto& shard = *shards.emplace_back(std::make_unique<Shard>(memory));
+    shard.policy = options.eviction;
+    shard.max_bytes = shard_budget(options.max_bytes, shard_count);
+    shard.max_entries = shard_budget(options.max_entries, shard_count);
+  }
+  if (options.watch != FileWatchMode::None) {
+    watcher = std::make_unique<Watcher>(*this, options.watch);
+  }
+}
+
+FileContainer::~FileContainer() = default;
+
+FileContainer::Shard& FileContainer::shard_for(
+    std::string_view filename) const {
+  return *shards[std::hash<std::string_view>{}(filename) % shard_count];
+}
+
+FileContainer::BufferPtr FileContainer::load(std::string_view filename,
+                                             bool from_snapshot) const {
+  if (from_snapshot && snapshot) {
+    if (auto buffer = snapshot->find(filename, snapshot)) {
+      return buffer;
+    }
+  }
   std::filesystem::path file_path = abs_path / filename;
-  std::string content = read_file(file_path);
-  data[filename] = content;
-  return content;
+  return options.mode == FileLoadMode::Mmap ? FileBuffer::Map(file_path)
+                                            : FileBuffer::Read(file_path);
+}
+
+FileView FileContainer::GetFileView(std::string_view filename) {
+  auto& shard = shard_for(filename);
+  std::promise<BufferPtr> promise;
+  std::shared_future<BufferPtr> pending;
+  BufferPtr cached;
+  // FileWatchMode::Poll compares each entry at most once per interval
+  auto poll_due = [this](Shard::Entry& entry) {
+    if (!watcher || !watcher->poll || !entry.buffer->stamp()) {
+      return false;
+    }
+    const int64_t now = clocks::steady_ns();
+    if (now - entry.checked_at <
+        std::chrono::nanoseconds(options.poll_interval).count()) {
+      return false;
+    }
+    entry.checked_at = now;
+    return true;
+  };
+  {
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    // Check cache first
+    if (auto* entry = shard.find(filename)) {
+      if (!poll_due(*entry)) {
+        return FileView(entry->buffer);
+      }
+      cached = entry->buffer;
+    } else if (auto loading = shard.loading.find(filename);
+               loading != shard.loading.end()) {
+      pending = loading->second.result;
+    } else {
+      shard.loading.emplace(filename,
+                            Shard::Loading{promise.get_future().share()});
+    }
+  }
+
+  // Compared outside the lock, a changed file is served as cached until the
+  // background reload swaps it
+  if (cached) {
+    if (FileStamp::Of(abs_path / filename) != *cached->stamp()) {
+      watcher->enqueue(std::string(filename));
+    }
+    return FileView(std::move(cached));
+  }
+
+  // Someone else is reading it already
+  if (pending.valid()) {
+    return FileView(pending.get());
+  }
+
+  BufferPtr buffer;
+  try {
+    bool from_snapshot = true;
+    while (true) {
+      buffer = load(filename, from_snapshot);
+      std::lock_guard<std::mutex> lock(shard.mtx);
+      auto loading = shard.loading.find(filename);
+      if (!loading->second.dirty) {
+        // A SetFileContent during the read wins over what was read
+        buffer = shard.insert(filename, std::move(buffer), false);
+        shard.loading.erase(loading);
+        break;
+      }
+      // The watcher saw a change during the read, like its reloads the
+      // next read skips the snapshot
+      loading->second.dirty = false;
+      from_snapshot = false;
+    }
+  } catch (...) {
+    {
+      std::lock_guard<std::mutex> lock(shard.mtx);
+      shard.loading.erase(shard.loading.find(filename));
+    }
+    promise.set_exception(std::current_exception());
+    throw;
+  }
+  promise.set_value(buffer);
+  return FileView(std::move(buffer));
+}
+
+std::string FileContainer::GetFileContent(std::string_view filename) {
+  return GetFileView(filename).str();
 }
 
 std::string FileContainer::SetFileContent(std::string filename,
                                           std::optional<std::string> content) {
-  std::lock_guard<std::mutex> lock(mtx);
+  auto& shard = shard_for(filename);
   if (content) {
-    data[filename] = *content;
+    auto buffer = FileBuffer::FromString(*content);
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    shard.insert(filename, std::move(buffer), true);
     return *content;
   }
 
-  std::filesystem::path file_path = abs_path / filename;
-  std::string file_content = read_file(file_path);
-  return data[filename] = file_content;
-  return file_content;
+  auto buffer = load(filename);
+  std::lock_guard<std::mutex> lock(shard.mtx);
+  shard.insert(filename, buffer, true);
+  return std::string(buffer->view());
+}
+
+void FileContainer::run_parallel(size_t count,
+                                 const std::function<void(size_t)>& job) {
+  if (count == 0) {
+    return;
+  }
+  // Nested in a batch of this pool, e.g. from a PreloadProgress callback.
+  // Handing work to the pool could wait on the very threads waiting here.
+  if (IoPool::current == io_pool.get()) {
+    for (size_t i = 0; i < count; ++i) {
+      job(i);
+    }
+    return;
+  }
+
+  std::call_once(io_pool->started, [this]() {
+    io_pool->threads = options.io_threads;
+    if (io_pool->threads == 0) {
+      io_pool->threads =
+          std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+    io_pool->scheduler = std::make_unique<TaskScheduler<void>>(
+        io_pool->threads, io_pool->threads);
+  });
+
+  // The caller takes jobs too, and only waits for the helpers that got to
+  // start before it ran out of them. One helper task per thread pulling
+  // indices, rather than one per job, keeps the scheduler queue out of the
+  // per-file cost.
+  struct Batch {
+    std::atomic<size_t> next{0};
+    std::mutex mtx;
+    std::condition_variable cv;
+    size_t running = 0;
+    bool closed = false;  // Helpers starting later leave right away
+    std::exception_ptr error;
+  };
+  auto batch = std::make_shared<Batch>();
+
+  auto helper = [&job, batch, count, pool = io_pool.get()]() {
+    {
+      std::lock_guard<std::mutex> lock(batch->mtx);
+      if (batch->closed) {
+        return;
+      }
+      ++batch->running;
+    }
+    IoPool::current = pool;
+    auto error = take_jobs(batch->next, count, job);
+    IoPool::current = nullptr;
+    std::lock_guard<std::mutex> lock(batch->mtx);
+    if (error && !batch->error) {
+      batch->error = error;
+    }
+    if (--batch->running == 0) {
+      batch->cv.notify_all();
+    }
+  };
+  const size_t helpers = std::min(count - 1, io_pool->threads);
+  for (size_t t = 0; t < helpers && batch->next < count; ++t) {
+    if (!io_pool->scheduler->addTask(helper)) {
+      break;
+    }
+  }
+
+  auto error = take_jobs(batch->next, count, job);
+  std::unique_lock<std::mutex> lock(batch->mtx);
+  batch->closed = true;
+  if (error && !batch->error) {
+    batch->error = error;
+  }
+  batch->cv.wait(lock, [&batch]() { return batch->running == 0; });
+  if (batch->error) {
+    std::rethrow_exception(batch->error);
+  }
+}
+
+std::vector<FileView> FileContainer::get_views(
+    const std::vector<std::string_view>& names) {
+  std::vector<FileView> views(names.size());
+  std::vector<size_t> misses;
+  for (size_t i = 0; i < names.size(); ++i) {
+    auto& shard = shard_for(names[i]);
+    bool cached;
+    {
+      std::lock_guard<std::mutex> lock(shard.mtx);
+      cached = shard.index.find(names[i]) != shard.index.end();
+    }
+    if (cached) {
+      views[i] = GetFileView(names[i]);
+    } else {
+      misses.push_back(i);
+    }
+  }
+
+  if (misses.size() == 1) {
+    views[misses[0]] = GetFileView(names[misses[0]]);
+  } else if (!misses.empty()) {
+    run_parallel(misses.size(), [&](size_t i) {
+      views[misses[i]] = GetFileView(names[misses[i]]);
+    });
+  }
+  return views;
+}
+
+PreloadResult FileContainer::Preload(std::string_view directory,
+                                     const PreloadFilter& filter,
+                                     const PreloadProgress& progress) {
+  std::vector<std::string> names;
+  std::error_code ec;
+  for (std::filesystem::recursive_directory_iterator it(abs_path / directory,
+                                                        ec),
+       end;
+       !ec && it != end; it.increment(ec)) {
+    if (!it->is_regular_file(ec)) {
+      continue;
+    }
+    auto name = it->path().lexically_relative(abs_path);
+    if (!filter || filter(name)) {
+      names.push_back(name.generic_string());
+    }
+  }
+
+  std::atomic<size_t> files{0};
+  std::atomic<uint64_t> bytes{0};
+  run_parallel(names.size(), [&](size_t i) {
+    const size_t size = GetFileView(names[i]).size();
+    const size_t done = ++files;
+    const uint64_t total_bytes = bytes += size;
+    if (progress) {
+      progress(done, names.size(), total_bytes);
+    }
+  });
+  return {files, bytes};
+}
+
+void FileContainer::reload(const std::string& filename) {
+  auto& shard = shard_for(filename);
+  {
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    if (shard.index.find(filename) == shard.index.end()) {
+      shard.mark_dirty(filename);
+      return;
+    }
+  }
+
+  auto buffer = load(filename);
+  std::lock_guard<std::mutex> lock(shard.mtx);
+  auto it = shard.index.find(filename);
+  if (it != shard.index.end()) {
+    shard.replace(it->second.get(), std::move(buffer));
+  }
+}
+
+void FileContainer::invalidate(const std::string& filename) {
+  auto& shard = shard_for(filename);
+  std::lock_guard<std::mutex> lock(shard.mtx);
+  shard.erase(filename);
+  shard.mark_dirty(filename);
+}
+
+void FileContainer::invalidate_directory(const std::string& directory) {
+  for (size_t i = 0; i < shard_count; ++i) {
+    std::lock_guard<std::mutex> lock(shards[i]->mtx);
+    shards[i]->erase_under(directory);
+  }
+}
+
+void FileContainer::reload_all() {
+  std::vector<std::string> names;
+  for (size_t i = 0; i < shard_count; ++i) {
+    std::lock_guard<std::mutex> lock(shards[i]->mtx);
+    for (const auto& entry : shards[i]->index) {
+      names.emplace_back(entry.first);
+    }
+  }
+  for (auto& name : names) {
+    watcher->enqueue(std::move(name));
+  }
+}
+
+FileContainerStats FileContainer::GetStats() const {
+  FileContainerStats stats;
+  for (size_t i = 0; i < shard_count; ++i) {
+    auto& shard = *shards[i];
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    stats.hits += shard.hits;
+    stats.misses += shard.misses;
+    stats.evictions += shard.evictions;
+    stats.entries += shard.index.size();
+    stats.bytes += shard.small.bytes + shard.main.bytes;
+  }
+  return stats;
+}
+
+bool FileContainer::SaveSnapshot(const std::filesystem::path& pack_path) const {
+  std::vector<std::pair<std::string, BufferPtr>> files;
+  for (size_t i = 0; i < shard_count; ++i) {
+    std::lock_guard<std::mutex> lock(shards[i]->mtx);
+    for (const auto& entry : shards[i]->index) {
+      files.emplace_back(std::string(entry.second->name),
+                         entry.second->buffer);
+    }
+  }
+  std::sort(files.begin(), files.end(),
+            [](const auto& a, const auto& b) { return a.first < b.first; });
+
+  std::vector<PackEntry> index(files.size());
+  std::string names;
+  uint64_t data_size = 0;
+  for (size_t i = 0; i < files.size(); ++i) {
+    const auto contents = files[i].second->view();
+    const auto& stamp = files[i].second->stamp();
+    auto& entry = index[i];
+    entry.name_offset = names.size();
+    entry.name_size = static_cast<uint32_t>(files[i].first.size());
+    entry.data_offset = data_size;
+    entry.size = contents.size();
+    entry.crc = crc32(contents.data(), contents.size());
+    entry.flags = stamp ? pack_has_stamp : 0;
+    entry.mtime_ns = stamp ? stamp->mtime_ns : 0;
+    names += files[i].first;
+    data_size = align_up(data_size + contents.size(), pack_align);
+  }
+
+  PackHeader header{};
+  std::memcpy(header.magic, pack_magic, sizeof(pack_magic));
+  header.version = pack_version;
+  header.count = static_cast<uint32_t>(files.size());
+  header.index_offset = sizeof(PackHeader);
+  header.names_offset = header.index_offset + index.size() * sizeof(PackEntry);
+  header.data_offset = align_up(header.names_offset + names.size(), pack_page);
+  header.file_size = header.data_offset + data_size;
+
+  // The index checksum covers the padding up to the data as well
+  std::string index_area(header.data_offset - header.index_offset, '\0');
+  std::memcpy(index_area.data(), index.data(), index.size() * sizeof(PackEntry));
+  std::memcpy(index_area.data() + index.size() * sizeof(PackEntry),
+              names.data(), names.size());
+  header.index_crc = crc32(index_area.data(), index_area.size());
+  header.header_crc =
+      crc32(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  // Unique in the target directory, so concurrent saves never write into
+  // each other's file and the rename stays on one file system
+  std::string tmp_path = pack_path.string() + ".XXXXXX";
+  const int fd = ::mkstemp(tmp_path.data());
+  if (fd < 0) {
+    return false;
+  }
+  FdWriter out(fd);
+  bool ok = ::fchmod(fd, 0644) == 0 &&
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header)) &&
+            out.write(index_area.data(), index_area.size());
+  const char zeros[pack_align] = {};
+  for (size_t i = 0; ok && i < files.size(); ++i) {
+    const auto contents = files[i].second->view();
+    const uint64_t end = index[i].data_offset + contents.size();
+    ok = out.write(contents.data(), contents.size()) &&
+         out.write(zeros, align_up(end, pack_align) - end);
+  }
+  // The contents are on disk before the name points at them
+  ok = ok && out.flush() && ::fsync(fd) == 0;
+  ok = ::close(fd) == 0 && ok;
+  if (!ok || ::rename(tmp_path.c_str(), pack_path.c_str()) != 0) {
+    ::unlink(tmp_path.c_str());
+    return false;
+  }
+  return sync_directory(pack_path.parent_path());
 }
 
 }  // namespace cpputils
@@ -0,0 +1,313 @@
+#include "cpputils/io_reactor.h"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <exception>
+#include <iostream>
+#include <utility>
+
+namespace cpputils {
+
+namespace {
+
+// Generation 0 is never handed out, so no watch matches the eventfd token
+constexpr uint64_t wake_token = 0;
+
+uint64_t token_of(int fd, uint32_t generation) {
+  return (static_cast<uint64_t>(generation) << 32) | static_cast<uint32_t>(fd);
+}
+
+uint32_t to_epoll(IoEvents events) {
+  uint32_t flags = 0;
+  if (has_event(events, IoEvents::Read)) {
+    flags |= EPOLLIN | EPOLLRDHUP;
+  }
+  if (has_event(events, IoEvents::Write)) {
+    flags |= EPOLLOUT;
+  }
+  return flags;
+}
+
+IoEvents from_epoll(uint32_t flags) {
+  IoEvents events = IoEvents::None;
+  if (flags & EPOLLIN) {
+    events = events | IoEvents::Read;
+  }
+  if (flags & EPOLLOUT) {
+    events = events | IoEvents::Write;
+  }
+  if (flags & (EPOLLRDHUP | EPOLLHUP)) {
+    events = events | IoEvents::Hangup;
+  }
+  if (flags & EPOLLERR) {
+    events = events | IoEvents::Error;
+  }
+  return events;
+}
+
+}  // namespace
+
+struct IoReactor::Watch {
+  int fd;
+  uint32_t generation;
+  IoCallback callback;
+
+  std::mutex mtx;  // Orders re-arming against modify and remove
+  uint32_t events;  // epoll flags, without EPOLLONESHOT
+  bool active = true;
+  bool running = false;  // A callback is out, it re-arms when done
+};
+
+std::unique_ptr<IoReactor> IoReactor::Create(TaskScheduler<void>* scheduler,
+                                             size_t max_events) {
+  const int epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd < 0) {
+    return nullptr;
+  }
+  const int wake_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  epoll_event ev{};
+  ev.events = EPOLLIN;
+  ev.data.u64 = wake_token;
+  if (wake_fd < 0 ||
+      ::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev) != 0) {
+    const int error = errno;
+    if (wake_fd >= 0) {
+      ::close(wake_fd);
+    }
+    ::close(epoll_fd);
+    errno = error;
+    return nullptr;
+  }
+  return std::unique_ptr<IoReactor>(new IoReactor(
+      scheduler, std::max<size_t>(max_events, 1), epoll_fd, wake_fd));
+}
+
+IoReactor::IoReactor(TaskScheduler<void>* Scheduler, size_t MaxEvents,
+                     int EpollFd, int WakeFd)
+    : scheduler(Scheduler),
+      max_events(MaxEvents),
+      epoll_fd(EpollFd),
+      wake_fd(WakeFd),
+      thread([this]() { loop(); }) {}
+
+IoReactor::~IoReactor() {
+  stop();
+  if (thread.joinable()) {
+    thread.join();
+  }
+  {
+    std::unique_lock<std::mutex> lock(mtx);
+    idle.wait(lock, [this]() { return in_flight == 0; });
+  }
+  ::close(wake_fd);
+  ::close(epoll_fd);
+}
+
+bool IoReactor::arm(Watch& watch, int op) {
+  epoll_event ev{};
+  ev.events = watch.events | EPOLLONESHOT;
+  ev.data.u64 = token_of(watch.fd, watch.generation);
+  return ::epoll_ctl(epoll_fd, op, watch.fd, &ev) == 0;
+}
+
+bool IoReactor::add(int fd, IoEvents events, IoCallback callback,
+                    IoTrigger trigger) {
+  auto watch = std::make_shared<Watch>();
+  watch->fd = fd;
+  watch->callback = std::move(callback);
+  watch->events =
+      to_epoll(events) | (trigger == IoTrigger::Edge ? EPOLLET : 0u);
+  std::lock_guard<std::mutex> lock(mtx);
+  if (watches.count(fd) != 0) {
+    errno = EEXIST;
+    return false;
+  }
+  if (++next_generation == 0) {
+    ++next_generation;
+  }
+  watch->generation = next_generation;
+  if (!arm(*watch, EPOLL_CTL_ADD)) {
+    return false;
+  }
+  watches.emplace(fd, std::move(watch));
+  return true;
+}
+
+bool IoReactor::modify(int fd, IoEvents events) {
+  std::shared_ptr<Watch> watch;
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = watches.find(fd);
+    if (it == watches.end()) {
+      errno = ENOENT;
+      return false;
+    }
+    watch = it->second;
+  }
+  std::lock_guard<std::mutex> lock(watch->mtx);
+  watch->events = to_epoll(events) | (watch->events & EPOLLET);
+  return watch->running || !watch->active || arm(*watch, EPOLL_CTL_MOD);
+}
+
+bool IoReactor::remove(int fd) {
+  std::lock_guard<std::mutex> lock(mtx);
+  auto it = watches.find(fd);
+  if (it == watches.end()) {
+    errno = ENOENT;
+    return false;
+  }
+  {
+    std::lock_guard<std::mutex> watch_lock(it->second->mtx);
+    it->second->active = false;
+  }
+  watches.erase(it);
+  return ::epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr) == 0;
+}
+
+void IoReactor::post(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    posted.push_back(std::move(task));
+  }
+  const uint64_t one = 1;
+  [[maybe_unused]] auto written = ::write(wake_fd, &one, sizeof(one));
+}
+
+void IoReactor::stop() {
+  if (stopping.exchange(true)) {
+    return;
+  }
+  const uint64_t one = 1;
+  [[maybe_unused]] auto written = ::write(wake_fd, &one, sizeof(one));
+  // From a callback on the reactor thread the loop ends on its own
+  if (thread.joinable() && thread.get_id() != std::this_thread::get_id()) {
+    thread.join();
+  }
+}
+
+size_t IoReactor::watched() const {
+  std::lock_guard<std::mutex> lock(mtx);
+  return watches.size();
+}
+
+void IoReactor::run_callback(const std::shared_ptr<Watch>& watch,
+                             uint32_t ready) {
+  // Re-arms even when the callback throws
+  struct rearm {
+    IoReactor& reactor;
+    Watch& watch;
+    ~rearm() {
+      std::lock_guard<std::mutex> lock(watch.mtx);
+      watch.running = false;
+      if (watch.active) {
+        reactor.arm(watch, EPOLL_CTL_MOD);
+      }
+    }
+  } guard{*this, *watch};
+  watch->callback(watch->fd, from_epoll(ready));
+}
+
+void IoReactor::dispatch(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    ++in_flight;
+  }
+  std::function<void()> counted = [this, task = std::move(task)]() {
+    struct done {
+      IoReactor& reactor;
+      ~done() {
+        std::lock_guard<std::mutex> lock(reactor.mtx);
+        if (--reactor.in_flight == 0) {
+          reactor.idle.notify_all();
+        }
+      }
+    } guard{*this};
+    task();
+  };
+  // A closed queue refuses the task without moving from it, once the
+  // scheduler stopped it runs here instead
+  if (scheduler != nullptr && scheduler->addTask(std::move(counted))) {
+    return;
+  }
+  try {
+    counted();
+  } catch (const std::exception& e) {
+    std::cerr << "Caught std::exception: " << e.what() << "\n";
+  } catch (...) {
+    std::cerr << "Caught unknown exception\n";
+  }
+}
+
+void IoReactor::loop() {
+  std::vector<epoll_event> events(max_events);
+  std::vector<std::pair<std::shared_ptr<Watch>, uint32_t>> ready;
+  std::vector<std::function<void()>> tasks;
+  while (!stopping.load(std::memory_order_acquire)) {
+    const int count = ::epoll_wait(epoll_fd, events.data(),
+                                   static_cast<int>(events.size()), -1);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      std::cerr << "IoReactor: epoll_wait failed, errno " << errno << "\n";
+      return;
+    }
+
+    // One pass over the registry for the whole batch
+    bool woken = false;
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      for (int i = 0; i < count; ++i) {
+        const uint64_t token = events[i].data.u64;
+        if (token == wake_token) {
+          woken = true;
+          continue;
+        }
+        auto it = watches.find(static_cast<int>(token & 0xffffffffu));
+        // A stale event of a removed fd whose number was reused
+        if (it == watches.end() ||
+            it->second->generation != static_cast<uint32_t>(token >> 32)) {
+          continue;
+        }
+        ready.emplace_back(it->second, uint32_t{events[i].events});
+      }
+      if (woken) {
+        // Drained under the lock before taking the tasks. A post() that
+        // writes after this read pushed after the swap, and its write
+        // wakes the next epoll_wait.
+        uint64_t value;
+        [[maybe_unused]] auto read = ::read(wake_fd, &value, sizeof(value));
+        tasks.swap(posted);
+      }
+    }
+
+    for (auto& [watch, flags] : ready) {
+      {
+        std::lock_guard<std::mutex> lock(watch->mtx);
+        // A modify() between the one-shot firing and here armed the fd
+        // again, the running callback's re-arm picks the readiness up
+        if (!watch->active || watch->running) {
+          continue;
+        }
+        watch->running = true;
+      }
+      dispatch([this, watch = std::move(watch), flags = flags]() {
+        run_callback(watch, flags);
+      });
+    }
+    ready.clear();
+    for (auto& task : tasks) {
+      dispatch(std::move(task));
+    }
+    tasks.clear();
+  }
+}
+
+}  // namespace cpputils
+
+#endif  // __linux__
@@ -0,0 +1,186 @@
+#include "cpputils/lock_order.h"
+#include <array>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+namespace cpputils {
+namespace lockdep {
+
+namespace {
+
+constexpr size_t words_per_row = max_classes / 64;
+constexpr size_t thread_cache_size = 256;
+
+// Where an edge was first observed
+struct edge_info {
+  const lock_profiler::lock_stats* from;
+  const lock_profiler::lock_stats* to;
+  lock_profiler::call_stack stack;
+};
+
+struct thread_state {
+  std::array<const lock_profiler::lock_stats*, max_held> held{};
+  size_t depth = 0;
+  size_t overflow = 0;
+  // Direct-mapped cache of edges this thread already found in the graph,
+  // stored as key + 1 so zero means empty
+  std::array<uint32_t, thread_cache_size> known{};
+};
+
+thread_local thread_state state;
+
+std::array<std::array<std::atomic<uint64_t>, words_per_row>, max_classes>
+    edges{};
+
+std::mutex graph_mtx;
+std::unordered_map<uint32_t, edge_info> edge_infos;
+std::string report;
+std::atomic<bool> reported{false};
+
+inline uint32_t edge_key(uint32_t from, uint32_t to) {
+  return from * max_classes + to;
+}
+
+inline bool has_edge(uint32_t from, uint32_t to) {
+  return (edges[from][to / 64].load(std::memory_order_acquire) >>
+          (to % 64)) &
+         1;
+}
+
+// Path from -> ... -> to over known edges, empty when there is none
+std::vector<uint32_t> find_path(uint32_t from, uint32_t to) {
+  std::vector<int32_t> parent(max_classes, -1);
+  std::vector<uint32_t> pending{from};
+  parent[from] = static_cast<int32_t>(from);
+  while (!pending.empty()) {
+    uint32_t node = pending.back();
+    pending.pop_back();
+    if (node == to) {
+      std::vector<uint32_t> path{to};
+      while (path.back() != from) {
+        path.push_back(static_cast<uint32_t>(parent[path.back()]));
+      }
+      return std::vector<uint32_t>(path.rbegin(), path.rend());
+    }
+    for (size_t word = 0; word < words_per_row; ++word) {
+      uint64_t bits = edges[node][word].load(std::memory_order_acquire);
+      while (bits != 0) {
+        auto next =
+            static_cast<uint32_t>(word * 64 + __builtin_ctzll(bits));
+        bits &= bits - 1;
+        if (parent[next] < 0) {
+          parent[next] = static_cast<int32_t>(node);
+          pending.push_back(next);
+        }
+      }
+    }
+  }
+  return {};
+}
+
+// Slow path for an edge not in the graph yet, returns false on a new cycle
+bool add_edge(const lock_profiler::lock_stats& held,
+              const lock_profiler::lock_stats& lock) {
+  const uint32_t from = held.id();
+  const uint32_t to = lock.id();
+  const auto stack = lock_profiler::capture_stack();
+  std::lock_guard<std::mutex> guard(graph_mtx);
+  if (has_edge(from, to)) {
+    return true;
+  }
+
+  bool ok = true;
+  if (!reported.load(std::memory_order_relaxed)) {
+    auto path = find_path(to, from);
+    if (!path.empty()) {
+      std::ostringstream out;
+      out << "Possible deadlock, lock order inversion between \""
+          << held.name() << "\" and \"" << lock.name() << "\"\n"
+          << "  this thread holds \"" << held.name() << "\" and acquires \""
+          << lock.name() << "\" at:\n"
+          << lock_profiler::format_stack(stack, "      ")
+          << "  previously observed:\n";
+      for (size_t i = 0; i + 1 < path.size(); ++i) {
+        const auto& info = edge_infos[edge_key(path[i], path[i + 1])];
+        out << "    holding \"" << info.from->name() << "\" then acquiring \""
+            << info.to->name() << "\" at:\n"
+            << lock_profiler::format_stack(info.stack, "      ");
+      }
+      report = out.str();
+      reported.store(true, std::memory_order_release);
+      ok = false;
+    }
+  }
+
+  edge_infos[edge_key(from, to)] = {&held, &lock, stack};
+  edges[from][to / 64].fetch_or(uint64_t{1} << (to % 64),
+                                std::memory_order_release);
+  return ok;
+}
+
+}  // namespace
+
+bool check_acquire(const lock_profiler::lock_stats& lock) {
+  const uint32_t to = lock.id();
+  if (to >= max_classes) {
+    return true;
+  }
+
+  bool ok = true;
+  for (size_t i = 0; i < state.depth; ++i) {
+    const auto& held = *state.held[i];
+    const uint32_t from = held.id();
+    if (from == to || from >= max_classes) {
+      continue;
+    }
+
+    const uint32_t key = edge_key(from, to);
+    auto& cached = state.known[key % thread_cache_size];
+    if (cached == key + 1) {
+      continue;
+    }
+    if (has_edge(from, to) || add_edge(held, lock)) {
+      cached = key + 1;
+    } else {
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+void acquired(const lock_profiler::lock_stats& lock) {
+  if (state.depth == max_held) {
+    ++state.overflow;
+    return;
+  }
+  state.held[state.depth++] = &lock;
+}
+
+void released(const lock_profiler::lock_stats& lock) {
+  // Usually the top of the stack, but unlock order does not have to be LIFO
+  for (size_t i = state.depth; i-- > 0;) {
+    if (state.held[i] == &lock) {
+      for (size_t j = i + 1; j < state.depth; ++j) {
+        state.held[j - 1] = state.held[j];
+      }
+      --state.depth;
+      return;
+    }
+  }
+  if (state.overflow != 0) {
+    --state.overflow;
+  }
+}
+
+std::string first_report() {
+  if (!reported.load(std::memory_order_acquire)) {
+    return {};
+  }
+  std::lock_guard<std::mutex> guard(graph_mtx);
+  return report;
+}
+
+}  // namespace lockdep
+}  // namespace cpputils
@@ -0,0 +1,371 @@
+#include "cpputils/lock_profiler.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#if __has_include(<execinfo.h>)
+#include <execinfo.h>
+#define CPPUTILS_HAS_BACKTRACE
+#endif
+
+namespace cpputils {
+namespace lock_profiler {
+
+namespace {
+
+struct registry {
+  std::mutex mtx;
+  std::map<std::string, std::unique_ptr<lock_stats>, std::less<>> locks;
+};
+
+registry& global_registry() {
+  // Leaked on purpose, mutexes with static storage may outlive it otherwise
+  static registry* instance = new registry();
+  return *instance;
+}
+
+void append_json_string(std::ostringstream& out, std::string_view str) {
+  out << '"';
+  for (char c : str) {
+    switch (c) {
+      case '"':
+        out << "\\\"";
+        break;
+      case '\\':
+        out << "\\\\";
+        break;
+      case '\n':
+        out << "\\n";
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          char buf[8];
+          snprintf(buf, sizeof(buf), "\\u%04x", c);
+          out << buf;
+        } else {
+          out << c;
+        }
+    }
+  }
+  out << '"';
+}
+
+uint64_t stack_key(const call_stack& stack) {
+  uint64_t key = 0xcbf29ce484222325ULL;
+  for (auto frame : stack) {
+    key = (key ^ frame) * 0x100000001b3ULL;
+  }
+  return key | 1;
+}
+
+// Key of a call site whose frames are still being written, stack keys are
+// odd
+constexpr uint64_t claimed_site = 2;
+
+std::vector<std::string> symbolize(const call_stack& stack) {
+  std::vector<std::string> lines;
+  size_t depth = 0;
+  while (depth < site_depth && stack[depth] != 0) {
+    ++depth;
+  }
+#ifdef CPPUTILS_HAS_BACKTRACE
+  void* frames[site_depth] = {};
+  for (size_t i = 0; i < depth; ++i) {
+    frames[i] = reinterpret_cast<void*>(stack[i]);
+  }
+  if (char** symbols = backtrace_symbols(frames, static_cast<int>(depth))) {
+    for (size_t i = 0; i < depth; ++i) {
+      lines.emplace_back(symbols[i]);
+    }
+    free(symbols);
+    return lines;
+  }
+#endif
+  for (size_t i = 0; i < depth; ++i) {
+    std::ostringstream out;
+    out << "0x" << std::hex << stack[i];
+    lines.push_back(out.str());
+  }
+  return lines;
+}
+
+std::vector<lock_snapshot> top(size_t top_n) {
+  auto locks = snapshot();
+  if (top_n != 0 && locks.size() > top_n) {
+    locks.erase(locks.begin() + static_cast<std::ptrdiff_t>(top_n),
+                locks.end());
+  }
+  return locks;
+}
+
+}  // namespace
+
+uint64_t histogram::quantile(double q) const {
+  auto values = counts();
+  uint64_t total = 0;
+  for (auto count : values) {
+    total += count;
+  }
+  if (total == 0) {
+    return 0;
+  }
+  uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(total));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < histogram_buckets; ++i) {
+    seen += values[i];
+    if (seen > rank) {
+      return (uint64_t{1} << (i + 1)) - 1;
+    }
+  }
+  return (uint64_t{1} << histogram_buckets) - 1;
+}
+
+std::array<uint64_t, histogram_buckets> histogram::counts() const {
+  std::array<uint64_t, histogram_buckets> values{};
+  for (size_t i = 0; i < histogram_buckets; ++i) {
+    values[i] = buckets_[i].load(std::memory_order_relaxed);
+  }
+  return values;
+}
+
+void histogram::reset() {
+  for (auto& bucket : buckets_) {
+    bucket.store(0, std::memory_order_relaxed);
+  }
+}
+
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+call_stack capture_stack() {
+  call_stack stack{};
+#ifdef CPPUTILS_HAS_BACKTRACE
+  // Frame 0 is capture_stack itself
+  void* frames[site_depth + 1];
+  int depth = backtrace(frames, static_cast<int>(site_depth + 1));
+  for (int i = 1; i < depth; ++i) {
+    stack[static_cast<size_t>(i - 1)] = reinterpret_cast<uintptr_t>(frames[i]);
+  }
+#endif
+  return stack;
+}
+
+std::string format_stack(const call_stack& stack, std::string_view indent) {
+  std::string out;
+  for (const auto& line : symbolize(stack)) {
+    out.append(indent);
+    out.append(line);
+    out.push_back('\n');
+  }
+  return out;
+}
+
+void lock_stats::record_wait(uint64_t ns, const call_stack* stack,
+                             uint64_t weight) {
+  contentions_.fetch_add(1, std::memory_order_relaxed);
+  total_wait_ns_.fetch_add(ns, std::memory_order_relaxed);
+  wait_.record(ns);
+
+  uint64_t max = max_wait_ns_.load(std::memory_order_relaxed);
+  while (ns > max && !max_wait_ns_.compare_exchange_weak(
+                         max, ns, std::memory_order_relaxed)) {
+  }
+
+  if (stack == nullptr) {
+    return;
+  }
+  const uint64_t site = stack_key(*stack);
+  for (auto& entry : sites_) {
+    uint64_t key = entry.key.load(std::memory_order_acquire);
+    if (key == 0 && entry.key.compare_exchange_strong(
+                        key, claimed_site, std::memory_order_acquire)) {
+      // Frames are published before the key, readers never see a key
+      // without them
+      for (size_t i = 0; i < site_depth; ++i) {
+        entry.frames[i].store((*stack)[i], std::memory_order_relaxed);
+      }
+      entry.key.store(site, std::memory_order_release);
+      key = site;
+    }
+    while (key == claimed_site) {
+      std::this_thread::yield();
+      key = entry.key.load(std::memory_order_acquire);
+    }
+    if (key == site) {
+      entry.waits.fetch_add(weight, std::memory_order_relaxed);
+      entry.wait_ns.fetch_add(ns * weight, std::memory_order_relaxed);
+      return;
+    }
+  }
+  other_site_waits_.fetch_add(weight, std::memory_order_relaxed);
+}
+
+void lock_stats::reset() {
+  acquisitions_.store(0, std::memory_order_relaxed);
+  contentions_.store(0, std::memory_order_relaxed);
+  total_wait_ns_.store(0, std::memory_order_relaxed);
+  max_wait_ns_.store(0, std::memory_order_relaxed);
+  total_hold_ns_.store(0, std::memory_order_relaxed);
+  other_site_waits_.store(0, std::memory_order_relaxed);
+  wait_.reset();
+  hold_.reset();
+  for (auto& entry : sites_) {
+    entry.waits.store(0, std::memory_order_relaxed);
+    entry.wait_ns.store(0, std::memory_order_relaxed);
+  }
+}
+
+lock_snapshot::lock_snapshot(const lock_stats& stats)
+    : name(stats.name_),
+      acquisitions(stats.acquisitions_.load(std::memory_order_relaxed)),
+      contentions(stats.contentions_.load(std::memory_order_relaxed)),
+      total_wait_ns(stats.total_wait_ns_.load(std::memory_order_relaxed)),
+      max_wait_ns(stats.max_wait_ns_.load(std::memory_order_relaxed)),
+      total_hold_ns(stats.total_hold_ns_.load(std::memory_order_relaxed)),
+      other_site_waits(stats.other_site_waits_.load(std::memory_order_relaxed)),
+      wait_histogram(stats.wait_.counts()),
+      hold_histogram(stats.hold_.counts()),
+      wait_p50_ns(stats.wait_.quantile(0.50)),
+      wait_p99_ns(stats.wait_.quantile(0.99)),
+      hold_p50_ns(stats.hold_.quantile(0.50)),
+      hold_p99_ns(stats.hold_.quantile(0.99)) {
+  for (const auto& entry : stats.sites_) {
+    uint64_t waits = entry.waits.load(std::memory_order_relaxed);
+    const uint64_t key = entry.key.load(std::memory_order_acquire);
+    if (key == 0 || key == claimed_site || waits == 0) {
+      continue;
+    }
+    call_stack stack{};
+    for (size_t i = 0; i < site_depth; ++i) {
+      stack[i] = entry.frames[i].load(std::memory_order_relaxed);
+    }
+    top_sites.push_back(
+        {stack, waits, entry.wait_ns.load(std::memory_order_relaxed)});
+  }
+  std::sort(top_sites.begin(), top_sites.end(),
+            [](const site_snapshot& a, const site_snapshot& b) {
+              return a.wait_ns > b.wait_ns;
+            });
+}
+
+lock_stats& register_lock(std::string_view name) {
+  auto& reg = global_registry();
+  std::lock_guard<std::mutex> lock(reg.mtx);
+  auto it = reg.locks.find(name);
+  if (it != reg.locks.end()) {
+    return *it->second;
+  }
+  auto id = static_cast<uint32_t>(reg.locks.size());
+  auto stats = std::make_unique<lock_stats>(std::string(name), id);
+  auto& ref = *stats;
+  reg.locks.emplace(std::string(name), std::move(stats));
+  return ref;
+}
+
+std::vector<lock_snapshot> snapshot() {
+  std::vector<lock_snapshot> result;
+  {
+    auto& reg = global_registry();
+    std::lock_guard<std::mutex> lock(reg.mtx);
+    result.reserve(reg.locks.size());
+    for (const auto& [name, stats] : reg.locks) {
+      result.emplace_back(*stats);
+    }
+  }
+  std::sort(result.begin(), result.end(),
+            [](const lock_snapshot& a, const lock_snapshot& b) {
+              return a.total_wait_ns > b.total_wait_ns;
+            });
+  return result;
+}
+
+std::string dump_text(size_t top_n) {
+  std::ostringstream out;
+  for (const auto& lock : top(top_n)) {
+    double contention_pct =
+        lock.acquisitions == 0
+            ? 0.0
+            : 100.0 * static_cast<double>(lock.contentions) /
+                  static_cast<double>(lock.acquisitions);
+    out << lock.name << ": acquisitions=" << lock.acquisitions
+        << " contentions=" << lock.contentions << " (" << contention_pct
+        << "%) wait_total_ns=" << lock.total_wait_ns
+        << " wait_max_ns=" << lock.max_wait_ns
+        << " wait_p50_ns<=" << lock.wait_p50_ns
+        << " wait_p99_ns<=" << lock.wait_p99_ns
+        << " hold_total_ns=" << lock.total_hold_ns
+        << " hold_p50_ns<=" << lock.hold_p50_ns
+        << " hold_p99_ns<=" << lock.hold_p99_ns << "\n";
+    for (const auto& site : lock.top_sites) {
+      out << "  waiter: waits=" << site.waits << " wait_ns=" << site.wait_ns
+          << "\n"
+          << format_stack(site.stack, "    ");
+    }
+    if (lock.other_site_waits != 0) {
+      out << "  other waiters: waits=" << lock.other_site_waits << "\n";
+    }
+  }
+  return out.str();
+}
+
+std::string dump_json(size_t top_n) {
+  std::ostringstream out;
+  out << "[";
+  bool first_lock = true;
+  for (const auto& lock : top(top_n)) {
+    out << (first_lock ? "" : ",") << "{\"name\":";
+    first_lock = false;
+    append_json_string(out, lock.name);
+    out << ",\"acquisitions\":" << lock.acquisitions
+        << ",\"contentions\":" << lock.contentions
+        << ",\"wait_total_ns\":" << lock.total_wait_ns
+        << ",\"wait_max_ns\":" << lock.max_wait_ns
+        << ",\"wait_p50_ns\":" << lock.wait_p50_ns
+        << ",\"wait_p99_ns\":" << lock.wait_p99_ns
+        << ",\"hold_total_ns\":" << lock.total_hold_ns
+        << ",\"hold_p50_ns\":" << lock.hold_p50_ns
+        << ",\"hold_p99_ns\":" << lock.hold_p99_ns;
+    for (auto [key, values] :
+         {std::pair{"wait_histogram", &lock.wait_histogram},
+          std::pair{"hold_histogram", &lock.hold_histogram}}) {
+      out << ",\"" << key << "\":[";
+      for (size_t i = 0; i < histogram_buckets; ++i) {
+        out << (i == 0 ? "" : ",") << (*values)[i];
+      }
+      out << "]";
+    }
+    out << ",\"top_waiters\":[";
+    bool first_site = true;
+    for (const auto& site : lock.top_sites) {
+      out << (first_site ? "" : ",") << "{\"waits\":" << site.waits
+          << ",\"wait_ns\":" << site.wait_ns << ",\"stack\":[";
+      first_site = false;
+      bool first_frame = true;
+      for (const auto& frame : symbolize(site.stack)) {
+        out << (first_frame ? "" : ",");
+        first_frame = false;
+        append_json_string(out, frame);
+      }
+      out << "]}";
+    }
+    out << "],\"other_site_waits\":" << lock.other_site_waits << "}";
+  }
+  out << "]";
+  return out.str();
+}
+
+void reset() {
+  auto& reg = global_registry();
+  std::lock_guard<std::mutex> lock(reg.mtx);
+  for (auto& [name, stats] : reg.locks) {
+    stats->reset();
+  }
+}
+
+}  // namespace lock_profiler
+}  // namespace cpputils
@@ -0,0 +1,145 @@
+#include "cpputils/memory_pool.h"
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+namespace cpputils {
+namespace memory {
+
+namespace detail {
+thread_local thread_cache caches[size_class_count];
+thread_local bool flush_registered = false;
+}  // namespace detail
+
+namespace {
+
+constexpr size_t chunk_size = 64 * 1024;
+
+struct batch {
+  detail::free_block* head;
+  uint32_t count;
+};
+
+// Blocks parked by threads, in the batches they were handed over in
+struct shared_list {
+  std::mutex mtx;
+  std::vector<batch> batches;
+};
+
+// Leaked, threads exiting during static destruction still flush into it
+shared_list* shared_lists() {
+  static auto* lists = new shared_list[detail::size_class_count];
+  return lists;
+}
+
+// Unlinks up to count blocks from the front of the thread's cache
+batch take(detail::thread_cache& cache, uint32_t count) {
+  batch taken{cache.head, 0};
+  detail::free_block* last = nullptr;
+  while (taken.count < count && cache.head != nullptr) {
+    last = cache.head;
+    cache.head = last->next;
+    ++taken.count;
+  }
+  if (last != nullptr) {
+    last->next = nullptr;
+  }
+  cache.count -= taken.count;
+  return taken;
+}
+
+void park(size_t size_class, batch blocks) {
+  shared_list& list = shared_lists()[size_class];
+  std::lock_guard<std::mutex> lock(list.mtx);
+  list.batches.push_back(blocks);
+}
+
+// Moves the thread's cache to the shared lists when it exits
+struct cache_flusher {
+  ~cache_flusher() { ThreadCachingPool::flush_thread_cache(); }
+};
+
+}  // namespace
+
+namespace detail {
+
+void register_flush() {
+  thread_local cache_flusher flusher;
+  (void)flusher;
+  flush_registered = true;
+}
+
+void* refill(size_t size_class) {
+  if (!flush_registered) {
+    register_flush();
+  }
+
+  thread_cache& cache = caches[size_class];
+  batch parked{nullptr, 0};
+  {
+    shared_list& list = shared_lists()[size_class];
+    std::lock_guard<std::mutex> lock(list.mtx);
+    if (!list.batches.empty()) {
+      parked = list.batches.back();
+      list.batches.pop_back();
+    }
+  }
+  if (parked.head != nullptr) {
+    cache.head = parked.head->next;
+    cache.count = parked.count - 1;
+    return parked.head;
+  }
+
+  // Nothing parked, carve a new chunk into batches. The first block is
+  // returned and the rest of its batch goes to the cache, the other
+  // batches are parked for any thread.
+  const size_t size = class_size(size_class);
+  const size_t count = chunk_size / size;
+  const size_t per_batch = batch_size(size_class);
+  char* chunk = static_cast<char*>(::operator new(chunk_size));
+  std::vector<batch> carved;
+  carved.reserve((count + per_batch - 1) / per_batch);
+  for (size_t first = 0; first < count; first += per_batch) {
+    const size_t last = std::min(first + per_batch, count);
+    free_block* head = nullptr;
+    for (size_t i = last; i-- > first;) {
+      auto* block = reinterpret_cast<free_block*>(chunk + i * size);
+      block->next = head;
+      head = block;
+    }
+    carved.push_back({head, static_cast<uint32_t>(last - first)});
+  }
+  if (carved.size() > 1) {
+    shared_list& list = shared_lists()[size_class];
+    std::lock_guard<std::mutex> lock(list.mtx);
+    list.batches.insert(list.batches.end(), carved.begin() + 1, carved.end());
+  }
+  cache.head = carved.front().head->next;
+  cache.count = carved.front().count - 1;
+  return carved.front().head;
+}
+
+void drain(size_t size_class) {
+  park(size_class, take(caches[size_class], batch_size(size_class)));
+}
+
+}  // namespace detail
+
+void ThreadCachingPool::flush_thread_cache() {
+  for (size_t size_class = 0; size_class < detail::size_class_count;
+       ++size_class) {
+    detail::thread_cache& cache = detail::caches[size_class];
+    while (cache.count != 0) {
+      park(size_class, take(cache, detail::batch_size(size_class)));
+    }
+  }
+}
+
+std::pmr::memory_resource* pool_resource() {
+  static auto* resource = new PoolResource();
+  return resource;
+}
+
+}  // namespace memory
+}  // namespace cpputils
@@ -0,0 +1,144 @@
+#include "cpputils/random.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <mutex>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<sys/random.h>)
+#include <sys/random.h>
+#define CPPUTILS_HAS_GETRANDOM
+#endif
+#endif
+
+namespace cpputils {
+namespace rng {
+
+namespace {
+
+bool fill_urandom(unsigned char* out, size_t size) {
+  const int fd = ::open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  while (size > 0) {
+    const ssize_t n = ::read(fd, out, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      ::close(fd);
+      return false;
+    }
+    out += n;
+    size -= static_cast<size_t>(n);
+  }
+  ::close(fd);
+  return true;
+}
+
+inline uint32_t rotl32(uint32_t x, int k) {
+  return (x << k) | (x >> (32 - k));
+}
+
+inline void quarter_round(uint32_t& a, uint32_t& b, uint32_t& c, uint32_t& d) {
+  a += b;
+  d = rotl32(d ^ a, 16);
+  c += d;
+  b = rotl32(b ^ c, 12);
+  a += b;
+  d = rotl32(d ^ a, 8);
+  c += d;
+  b = rotl32(b ^ c, 7);
+}
+
+}  // namespace
+
+void fill_secure(void* out, size_t size) {
+  auto* bytes = static_cast<unsigned char*>(out);
+#ifdef CPPUTILS_HAS_GETRANDOM
+  while (size > 0) {
+    const ssize_t n = ::getrandom(bytes, size, 0);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;  // ENOSYS on old kernels, try the device
+    }
+    bytes += n;
+    size -= static_cast<size_t>(n);
+  }
+  if (size == 0) {
+    return;
+  }
+#endif
+  if (!fill_urandom(bytes, size)) {
+    std::abort();
+  }
+}
+
+namespace detail {
+std::atomic<uint64_t> forks{0};
+
+uint64_t fork_generation() {
+  static std::once_flag at_fork;
+  std::call_once(at_fork, [] {
+    pthread_atfork(nullptr, nullptr, [] {
+      forks.fetch_add(1, std::memory_order_relaxed);
+    });
+  });
+  return forks.load(std::memory_order_relaxed);
+}
+}  // namespace detail
+
+void chacha20::reseed() {
+  generation_ = detail::fork_generation();
+  fill_secure(key_.data(), sizeof(key_));
+  fill_secure(&nonce_, sizeof(nonce_));
+  counter_ = 0;
+  position_ = block_.size();
+  seeded_ = true;
+}
+
+void chacha20::refill() {
+  // "expand 32-byte k"
+  const std::array<uint32_t, 16> input = {
+      0x61707865,
+      0x3320646E,
+      0x79622D32,
+      0x6B206574,
+      key_[0],
+      key_[1],
+      key_[2],
+      key_[3],
+      key_[4],
+      key_[5],
+      key_[6],
+      key_[7],
+      static_cast<uint32_t>(counter_),
+      static_cast<uint32_t>(counter_ >> 32),
+      static_cast<uint32_t>(nonce_),
+      static_cast<uint32_t>(nonce_ >> 32)};
+  auto x = input;
+  for (int round = 0; round < 10; ++round) {
+    quarter_round(x[0], x[4], x[8], x[12]);
+    quarter_round(x[1], x[5], x[9], x[13]);
+    quarter_round(x[2], x[6], x[10], x[14]);
+    quarter_round(x[3], x[7], x[11], x[15]);
+    quarter_round(x[0], x[5], x[10], x[15]);
+    quarter_round(x[1], x[6], x[11], x[12]);
+    quarter_round(x[2], x[7], x[8], x[13]);
+    quarter_round(x[3], x[4], x[9], x[14]);
+  }
+  for (size_t i = 0; i < block_.size(); ++i) {
+    block_[i] = uint64_t{x[2 * i] + input[2 * i]} |
+                uint64_t{x[2 * i + 1] + input[2 * i + 1]} << 32;
+  }
+  ++counter_;
+  position_ = 0;
+}
+
+}  // namespace rng
+}  // namespace cpputils
@@ -0,0 +1,270 @@
+#include "cpputils/reclamation.h"
+
+#include <algorithm>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cpputils {
+namespace reclaim {
+
+namespace detail {
+std::atomic<uint64_t> global_epoch{1};
+thread_local epoch_record* current_epoch_record = nullptr;
+}  // namespace detail
+
+namespace {
+
+constexpr size_t epoch_batch = 64;
+constexpr size_t hazard_batch = 64;
+
+struct retired {
+  void* p;
+  deleter_fn deleter;
+  uint64_t epoch;  // Global epoch at retirement, unused by hazard pointers
+};
+
+// Records and slots are never freed, exiting threads mark them unused for
+// the next thread to take over
+std::atomic<detail::epoch_record*> epoch_records{nullptr};
+std::atomic<detail::hazard_slot*> hazard_slots{nullptr};
+std::atomic<size_t> hazard_slot_count{0};
+
+// Garbage left by exited threads. Leaked, threads may exit during static
+// destruction.
+struct orphanage {
+  std::mutex mtx;
+  std::vector<retired> epoch;
+  std::vector<retired> hazard;
+};
+
+orphanage& orphans() {
+  static auto* instance = new orphanage;
+  return *instance;
+}
+
+// Moves what the list may hold on to to its front and runs the deleters of
+// the rest. Deleters may retire again, so they run on a detached list.
+template <typename Keep>
+void free_unless(std::vector<retired>& list, Keep keep) {
+  const auto split = std::partition(list.begin(), list.end(), keep);
+  if (split == list.end()) {
+    return;
+  }
+  std::vector<retired> doomed(std::make_move_iterator(split),
+                              std::make_move_iterator(list.end()));
+  list.erase(split, list.end());
+  for (const retired& r : doomed) {
+    r.deleter(r.p);
+  }
+}
+
+// Takes in the garbage of exited threads, if nobody else is at it
+void adopt(std::vector<retired> orphanage::*kind, std::vector<retired>& list,
+           bool wait) {
+  orphanage& o = orphans();
+  std::unique_lock<std::mutex> lock(o.mtx, std::defer_lock);
+  if (wait) {
+    lock.lock();
+  } else if (!lock.try_lock()) {
+    return;
+  }
+  auto& adopted = o.*kind;
+  list.insert(list.end(), adopted.begin(), adopted.end());
+  adopted.clear();
+}
+
+void abandon(std::vector<retired> orphanage::*kind,
+             std::vector<retired>& list) {
+  if (list.empty()) {
+    return;
+  }
+  orphanage& o = orphans();
+  std::lock_guard<std::mutex> lock(o.mtx);
+  auto& adopted = o.*kind;
+  adopted.insert(adopted.end(), list.begin(), list.end());
+  list.clear();
+}
+
+// Moves the global epoch on when every pinned thread has seen the current
+// one. Returns false when a thread is still pinned to an older epoch.
+bool try_advance() {
+  uint64_t epoch = detail::global_epoch.load(std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  for (auto* record = epoch_records.load(std::memory_order_acquire);
+       record != nullptr; record = record->next) {
+    const uint64_t pinned = record->epoch.load(std::memory_order_relaxed);
+    if (pinned != 0 && pinned != epoch) {
+      return false;
+    }
+  }
+  // Pairs with the release of unpinning, reads by readers happen before
+  // anything freed after this
+  std::atomic_thread_fence(std::memory_order_acquire);
+  detail::global_epoch.compare_exchange_strong(epoch, epoch + 1,
+                                               std::memory_order_seq_cst);
+  return true;
+}
+
+// Anything retired two epochs ago cannot be reached by a pinned thread
+void collect_epoch(std::vector<retired>& list) {
+  try_advance();
+  const uint64_t epoch = detail::global_epoch.load(std::memory_order_acquire);
+  free_unless(list, [epoch](const retired& r) { return r.epoch + 2 > epoch; });
+}
+
+struct epoch_thread {
+  std::vector<retired> garbage;
+
+  ~epoch_thread() {
+    adopt(&orphanage::epoch, garbage, false);
+    collect_epoch(garbage);
+    abandon(&orphanage::epoch, garbage);
+    if (auto* record = detail::current_epoch_record) {
+      record->epoch.store(0, std::memory_order_release);
+      record->in_use.store(false, std::memory_order_release);
+      detail::current_epoch_record = nullptr;
+    }
+  }
+};
+
+thread_local epoch_thread epoch_local;
+
+void collect_hazard(std::vector<retired>& list) {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  std::vector<const void*> protected_now;
+  for (auto* slot = hazard_slots.load(std::memory_order_acquire);
+       slot != nullptr; slot = slot->next) {
+    if (const void* p = slot->pointer.load(std::memory_order_acquire)) {
+      protected_now.push_back(p);
+    }
+  }
+  std::sort(protected_now.begin(), protected_now.end());
+  free_unless(list, [&protected_now](const retired& r) {
+    return std::binary_search(protected_now.begin(), protected_now.end(),
+                              static_cast<const void*>(r.p));
+  });
+}
+
+struct hazard_thread {
+  std::vector<detail::hazard_slot*> spare;  // Owned, cleared slots
+  std::vector<retired> garbage;
+
+  ~hazard_thread() {
+    for (auto* slot : spare) {
+      slot->in_use.store(false, std::memory_order_release);
+    }
+    spare.clear();
+    adopt(&orphanage::hazard, garbage, false);
+    collect_hazard(garbage);
+    abandon(&orphanage::hazard, garbage);
+  }
+};
+
+thread_local hazard_thread hazard_local;
+
+}  // namespace
+
+namespace detail {
+
+epoch_record* register_epoch_thread() {
+  // Registers the destructor that gives the record back
+  (void)epoch_local;
+  epoch_record* record = epoch_records.load(std::memory_order_acquire);
+  for (; record != nullptr; record = record->next) {
+    bool expected = false;
+    if (!record->in_use.load(std::memory_order_relaxed) &&
+        record->in_use.compare_exchange_strong(expected, true,
+                                               std::memory_order_acquire)) {
+      break;
+    }
+  }
+  if (record == nullptr) {
+    record = new epoch_record;
+    record->in_use.store(true, std::memory_order_relaxed);
+    record->next = epoch_records.load(std::memory_order_relaxed);
+    while (!epoch_records.compare_exchange_weak(record->next, record,
+                                                std::memory_order_release,
+                                                std::memory_order_relaxed)) {
+    }
+  }
+  current_epoch_record = record;
+  return record;
+}
+
+hazard_slot* acquire_hazard_slot() {
+  auto& spare = hazard_local.spare;
+  if (!spare.empty()) {
+    hazard_slot* slot = spare.back();
+    spare.pop_back();
+    return slot;
+  }
+  for (auto* slot = hazard_slots.load(std::memory_order_acquire);
+       slot != nullptr; slot = slot->next) {
+    bool expected = false;
+    if (!slot->in_use.load(std::memory_order_relaxed) &&
+        slot->in_use.compare_exchange_strong(expected, true,
+                                             std::memory_order_acquire)) {
+      return slot;
+    }
+  }
+  auto* slot = new hazard_slot;
+  slot->in_use.store(true, std::memory_order_relaxed);
+  slot->next = hazard_slots.load(std::memory_order_relaxed);
+  while (!hazard_slots.compare_exchange_weak(slot->next, slot,
+                                             std::memory_order_release,
+                                             std::memory_order_relaxed)) {
+  }
+  hazard_slot_count.fetch_add(1, std::memory_order_relaxed);
+  return slot;
+}
+
+void release_hazard_slot(hazard_slot* slot) {
+  hazard_local.spare.push_back(slot);
+}
+
+}  // namespace detail
+
+void epoch_retire(void* p, deleter_fn deleter) {
+  auto& garbage = epoch_local.garbage;
+  garbage.push_back(
+      {p, deleter, detail::global_epoch.load(std::memory_order_seq_cst)});
+  if (garbage.size() % epoch_batch == 0) {
+    adopt(&orphanage::epoch, garbage, false);
+    collect_epoch(garbage);
+  }
+}
+
+void epoch_synchronize() {
+  const uint64_t target =
+      detail::global_epoch.load(std::memory_order_seq_cst) + 2;
+  while (detail::global_epoch.load(std::memory_order_acquire) < target) {
+    if (!try_advance()) {
+      std::this_thread::yield();
+    }
+  }
+  auto& garbage = epoch_local.garbage;
+  adopt(&orphanage::epoch, garbage, true);
+  collect_epoch(garbage);
+}
+
+void hazard_retire(void* p, deleter_fn deleter) {
+  auto& garbage = hazard_local.garbage;
+  garbage.push_back({p, deleter, 0});
+  const size_t threshold = std::max(
+      hazard_batch, 2 * hazard_slot_count.load(std::memory_order_relaxed));
+  if (garbage.size() >= threshold) {
+    adopt(&orphanage::hazard, garbage, false);
+    collect_hazard(garbage);
+  }
+}
+
+void hazard_reclaim() {
+  auto& garbage = hazard_local.garbage;
+  adopt(&orphanage::hazard, garbage, true);
+  collect_hazard(garbage);
+}
+
+}  // namespace reclaim
+}  // namespace cpputils
@@ -0,0 +1,565 @@
+#include "cpputils/timezone.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <climits>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace cpputils {
+namespace datetime {
+
+namespace {
+
+constexpr int64_t seconds_per_day = 86400;
+// Rules are expanded up to the end of a nanosecond system_clock
+constexpr int64_t last_rule_year = 2262;
+
+// Transition date of a POSIX TZ rule
+struct rule_date {
+  enum { julian, zero_based, month_week_day } kind = month_week_day;
+  int day = 0;  // Jn / n, or the weekday (0 is Sunday) for Mm.w.d
+  int month = 0;
+  int week = 0;
+  int32_t time = 7200;  // Local seconds after midnight, may be negative
+};
+
+struct posix_rule {
+  std::string std_name;
+  int32_t std_offset = 0;  // Seconds east of UTC, POSIX writes them west
+  bool has_dst = false;
+  std::string dst_name;
+  int32_t dst_offset = 0;
+  rule_date start;
+  rule_date end;
+};
+
+class rule_parser {
+ public:
+  explicit rule_parser(std::string_view text) : text(text) {}
+
+  bool parse(posix_rule& rule) {
+    if (!name(rule.std_name) || !offset(rule.std_offset)) {
+      return false;
+    }
+    rule.std_offset = -rule.std_offset;
+    if (done()) {
+      return true;
+    }
+    rule.has_dst = true;
+    if (!name(rule.dst_name)) {
+      return false;
+    }
+    rule.dst_offset = rule.std_offset + 3600;
+    if (!done() && peek() != ',') {
+      if (!offset(rule.dst_offset)) {
+        return false;
+      }
+      rule.dst_offset = -rule.dst_offset;
+    }
+    if (done()) {
+      // No dates, the US rules are the POSIX default
+      rule.start = {rule_date::month_week_day, 0, 3, 2, 7200};
+      rule.end = {rule_date::month_week_day, 0, 11, 1, 7200};
+      return true;
+    }
+    return consume(',') && date(rule.start) && consume(',') &&
+           date(rule.end) && done();
+  }
+
+ private:
+  std::string_view text;
+  size_t pos = 0;
+
+  bool done() const { return pos == text.size(); }
+  char peek() const { return done() ? '\0' : text[pos]; }
+
+  bool consume(char c) {
+    if (peek() != c) {
+      return false;
+    }
+    ++pos;
+    return true;
+  }
+
+  bool number(int& value, int max) {
+    const size_t start = pos;
+    value = 0;
+    while (!done() && peek() >= '0' && peek() <= '9') {
+      value = value * 10 + (text[pos++] - '0');
+      if (value > max) {
+        return false;
+      }
+    }
+    return pos > start;
+  }
+
+  // Alphabetic, or anything but '>' in angle brackets ("<+0330>")
+  bool name(std::string& out) {
+    const size_t start = pos;
+    if (consume('<')) {
+      while (!done() && peek() != '>') {
+        ++pos;
+      }
+      out.assign(text.substr(start + 1, pos - start - 1));
+      return consume('>') && out.size() >= 3;
+    }
+    while (!done() && ((peek() >= 'A' && peek() <= 'Z') ||
+                       (peek() >= 'a' && peek() <= 'z'))) {
+      ++pos;
+    }
+    out.assign(text.substr(start, pos - start));
+    return out.size() >= 3;
+  }
+
+  // [+-]hh[:mm[:ss]], hours up to 167 for the times of RFC 8536 rules
+  bool offset(int32_t& seconds) {
+    int sign = 1;
+    if (consume('-')) {
+      sign = -1;
+    } else {
+      consume('+');
+    }
+    int hours = 0;
+    int minutes = 0;
+    int secs = 0;
+    if (!number(hours, 167)) {
+      return false;
+    }
+    if (consume(':') && (!number(minutes, 59) ||
+                         (consume(':') && !number(secs, 59)))) {
+      return false;
+    }
+    seconds = sign * (hours * 3600 + minutes * 60 + secs);
+    return true;
+  }
+
+  bool date(rule_date& out) {
+    if (consume('J')) {
+      out.kind = rule_date::julian;
+      if (!number(out.day, 365) || out.day < 1) {
+        return false;
+      }
+    } else if (consume('M')) {
+      out.kind = rule_date::month_week_day;
+      if (!number(out.month, 12) || out.month < 1 || !consume('.') ||
+          !number(out.week, 5) || out.week < 1 || !consume('.') ||
+          !number(out.day, 6)) {
+        return false;
+      }
+    } else {
+      out.kind = rule_date::zero_based;
+      if (!number(out.day, 365)) {
+        return false;
+      }
+    }
+    out.time = 7200;
+    return !consume('/') || offset(out.time);
+  }
+};
+
+// Days since the epoch of a rule date in year
+int64_t rule_day(const rule_date& date, int64_t year) {
+  const int64_t january_first = detail::days_from_civil(year, 1, 1);
+  switch (date.kind) {
+    case rule_date::julian:
+      // 1 ... 365, February 29 is never counted
+      return january_first + date.day - 1 +
+             (detail::is_leap_year(year) && date.day >= 60);
+    case rule_date::zero_based:
+      return january_first + date.day;
+    case rule_date::month_week_day:
+      break;
+  }
+  const auto month = static_cast<unsigned>(date.month);
+  const int64_t first = detail::days_from_civil(year, month, 1);
+  // 1970-01-01 was a Thursday
+  const int64_t weekday = ((first + 4) % 7 + 7) % 7;
+  int64_t day = (date.day - weekday + 7) % 7 + (date.week - 1) * 7;
+  // Week 5 is the last such weekday of the month
+  while (day >= detail::days_in_month(year, month)) {
+    day -= 7;
+  }
+  return first + day;
+}
+
+std::optional<std::string> read_file(const std::filesystem::path& path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return std::nullopt;
+  }
+  std::string data((std::istreambuf_iterator<char>(file)),
+                   std::istreambuf_iterator<char>());
+  if (file.bad()) {
+    return std::nullopt;
+  }
+  return data;
+}
+
+// Bounds-checked big-endian reads over a TZif file
+class tzif_reader {
+ public:
+  explicit tzif_reader(std::string_view data) : data(data) {}
+
+  bool skip(size_t count) {
+    if (data.size() - pos < count) {
+      return false;
+    }
+    pos += count;
+    return true;
+  }
+
+  bool read(uint64_t& value, size_t bytes) {
+    if (data.size() - pos < bytes) {
+      return false;
+    }
+    value = 0;
+    for (size_t i = 0; i < bytes; ++i) {
+      value = value << 8 | static_cast<unsigned char>(data[pos + i]);
+    }
+    pos += bytes;
+    return true;
+  }
+
+  // Two's complement time or offset of bytes width
+  bool read_signed(int64_t& value, size_t bytes) {
+    uint64_t raw = 0;
+    if (!read(raw, bytes)) {
+      return false;
+    }
+    const unsigned shift = static_cast<unsigned>(64 - 8 * bytes);
+    value = static_cast<int64_t>(raw << shift) >> shift;
+    return true;
+  }
+
+  std::string_view rest() const { return data.substr(pos); }
+
+ private:
+  std::string_view data;
+  size_t pos = 0;
+};
+
+struct tzif_header {
+  char version = 0;
+  uint64_t isutcnt = 0;
+  uint64_t isstdcnt = 0;
+  uint64_t leapcnt = 0;
+  uint64_t timecnt = 0;
+  uint64_t typecnt = 0;
+  uint64_t charcnt = 0;
+
+  bool read(tzif_reader& in) {
+    const std::string_view rest = in.rest();
+    if (rest.size() < 44 || rest.substr(0, 4) != "TZif") {
+      return false;
+    }
+    version = rest[4];
+    return in.skip(20) && in.read(isutcnt, 4) && in.read(isstdcnt, 4) &&
+           in.read(leapcnt, 4) && in.read(timecnt, 4) &&
+           in.read(typecnt, 4) && in.read(charcnt, 4) && typecnt > 0 &&
+           typecnt <= 256 && charcnt > 0;
+  }
+
+  uint64_t block_size(size_t time_size) const {
+    return timecnt * (time_size + 1) + typecnt * 6 + charcnt +
+           leapcnt * (time_size + 4) + isstdcnt + isutcnt;
+  }
+};
+
+std::mutex zone_mutex;
+std::atomic<const TimeZone*> current_zone{nullptr};
+
+// Every zone ever installed, leaked so references outlive static
+// destruction as well
+std::vector<std::shared_ptr<const TimeZone>>& installed_zones() {
+  static auto* zones = new std::vector<std::shared_ptr<const TimeZone>>();
+  return *zones;
+}
+
+const TimeZone* install(std::shared_ptr<const TimeZone> zone) {
+  const TimeZone* raw = zone.get();
+  installed_zones().push_back(std::move(zone));
+  current_zone.store(raw, std::memory_order_release);
+  return raw;
+}
+
+std::shared_ptr<const TimeZone> load_local() {
+  const char* tz = std::getenv("TZ");
+  if (tz != nullptr) {
+    return TimeZone::Load(tz);
+  }
+  std::error_code error;
+  std::string name = "localtime";
+  const auto target = std::filesystem::read_symlink("/etc/localtime", error);
+  const std::string linked = target.string();
+  const size_t zoneinfo = linked.find("zoneinfo/");
+  if (!error && zoneinfo != std::string::npos) {
+    name = linked.substr(zoneinfo + 9);
+  }
+  const auto data = read_file("/etc/localtime");
+  return data ? TimeZone::FromTzif(*data, std::move(name)) : nullptr;
+}
+
+inline void write2(char* out, int value) {
+  out[0] = static_cast<char>('0' + value / 10);
+  out[1] = static_cast<char>('0' + value % 10);
+}
+
+}  // namespace
+
+std::shared_ptr<const TimeZone> TimeZone::Load(std::string_view name) {
+  if (!name.empty() && name.front() == ':') {
+    name.remove_prefix(1);
+  }
+  if (name.empty()) {
+    return Utc();
+  }
+
+  std::filesystem::path path(name);
+  if (path.is_relative() && name.find("..") == std::string_view::npos) {
+    const char* tzdir = std::getenv("TZDIR");
+    path = std::filesystem::path(tzdir != nullptr ? tzdir
+                                                  : "/usr/share/zoneinfo") /
+           path;
+  }
+  if (path.is_absolute()) {
+    if (const auto data = read_file(path)) {
+      if (auto zone = FromTzif(*data, std::string(name))) {
+        return zone;
+      }
+    }
+  }
+
+  std::shared_ptr<TimeZone> zone(new TimeZone());
+  zone->name_ = std::string(name);
+  if (!zone->apply_rule(name)) {
+    return nullptr;
+  }
+  return zone;
+}
+
+std::shared_ptr<const TimeZone> TimeZone::LoadLocal() {
+  auto zone = load_local();
+  return zone ? zone : Utc();
+}
+
+std::shared_ptr<const TimeZone> TimeZone::FromTzif(std::string_view data,
+                                                   std::string name) {
+  tzif_reader in(data);
+  tzif_header header;
+  if (!header.read(in)) {
+    return nullptr;
+  }
+  size_t time_size = 4;
+  if (header.version >= '2') {
+    // Skip the 32-bit data, the 64-bit copy follows with its own header
+    if (!in.skip(header.block_size(4)) || !header.read(in)) {
+      return nullptr;
+    }
+    time_size = 8;
+  }
+  if (in.rest().size() < header.block_size(time_size)) {
+    return nullptr;
+  }
+
+  std::shared_ptr<TimeZone> zone(new TimeZone());
+  zone->name_ = std::move(name);
+  zone->transitions.resize(header.timecnt);
+  zone->transition_types.resize(header.timecnt);
+  zone->types.resize(header.typecnt);
+  for (auto& transition : zone->transitions) {
+    in.read_signed(transition, time_size);
+  }
+  for (auto& type : zone->transition_types) {
+    uint64_t index = 0;
+    in.read(index, 1);
+    if (index >= header.typecnt) {
+      return nullptr;
+    }
+    type = static_cast<uint16_t>(index);
+  }
+  std::vector<uint64_t> abbreviations(header.typecnt);
+  for (size_t i = 0; i < header.typecnt; ++i) {
+    int64_t offset = 0;
+    uint64_t dst = 0;
+    in.read_signed(offset, 4);
+    in.read(dst, 1);
+    in.read(abbreviations[i], 1);
+    if (abbreviations[i] >= header.charcnt) {
+      return nullptr;
+    }
+    zone->types[i].offset = static_cast<int32_t>(offset);
+    zone->types[i].dst = dst != 0;
+  }
+  const std::string_view chars = in.rest().substr(0, header.charcnt);
+  for (size_t i = 0; i < header.typecnt; ++i) {
+    const std::string_view abbreviation = chars.substr(abbreviations[i]);
+    zone->types[i].abbreviation =
+        std::string(abbreviation.substr(0, abbreviation.find('\0')));
+  }
+  in.skip(header.charcnt + header.leapcnt * (time_size + 4) +
+          header.isstdcnt + header.isutcnt);
+  if (!std::is_sorted(zone->transitions.begin(), zone->transitions.end())) {
+    return nullptr;
+  }
+
+  // Footer "\n<POSIX TZ>\n" for instants past the table, an invalid one is
+  // ignored
+  const std::string_view footer = in.rest();
+  if (time_size == 8 && footer.size() >= 2 && footer.front() == '\n') {
+    const size_t end = footer.find('\n', 1);
+    if (end != std::string_view::npos && end > 1) {
+      zone->apply_rule(footer.substr(1, end - 1));
+    }
+  }
+  return zone;
+}
+
+std::shared_ptr<const TimeZone> TimeZone::Utc() {
+  static const std::shared_ptr<const TimeZone> utc = [] {
+    std::shared_ptr<TimeZone> zone(new TimeZone());
+    zone->name_ = "UTC";
+    zone->types.push_back({0, false, "UTC"});
+    return zone;
+  }();
+  return utc;
+}
+
+const LocalTimeType& TimeZone::lookup(int64_t unix_seconds) const {
+  const auto it =
+      std::upper_bound(transitions.begin(), transitions.end(), unix_seconds);
+  if (it == transitions.begin()) {
+    return types.front();
+  }
+  return types[transition_types[it - transitions.begin() - 1]];
+}
+
+int32_t TimeZone::offset_at(std::chrono::system_clock::time_point tp) const {
+  using namespace std::chrono;
+  return offset_at(floor<seconds>(tp.time_since_epoch()).count());
+}
+
+bool TimeZone::apply_rule(std::string_view posix) {
+  posix_rule rule;
+  if (!rule_parser(posix).parse(rule)) {
+    return false;
+  }
+
+  const auto type_index = [this](LocalTimeType type) {
+    for (size_t i = 0; i < types.size(); ++i) {
+      if (types[i].offset == type.offset && types[i].dst == type.dst &&
+          types[i].abbreviation == type.abbreviation) {
+        return static_cast<uint16_t>(i);
+      }
+    }
+    types.push_back(std::move(type));
+    return static_cast<uint16_t>(types.size() - 1);
+  };
+  const uint16_t standard =
+      type_index({rule.std_offset, false, rule.std_name});
+  if (!rule.has_dst) {
+    return true;
+  }
+  const uint16_t daylight = type_index({rule.dst_offset, true, rule.dst_name});
+
+  // Start is given in standard time, end in daylight time
+  const auto changes_in = [&](int64_t year) {
+    std::array<std::pair<int64_t, uint16_t>, 2> changes = {{
+        {rule_day(rule.start, year) * seconds_per_day + rule.start.time -
+             rule.std_offset,
+         daylight},
+        {rule_day(rule.end, year) * seconds_per_day + rule.end.time -
+             rule.dst_offset,
+         standard},
+    }};
+    if (changes[1].first < changes[0].first) {
+      std::swap(changes[0], changes[1]);
+    }
+    return changes;
+  };
+
+  int64_t first_year = 1970;
+  if (transitions.empty()) {
+    // A bare rule holds at all times: before 1970 the zone is in whatever
+    // the first change of 1970 switches away from (daylight time south of
+    // the equator)
+    transitions.push_back(INT64_MIN);
+    transition_types.push_back(changes_in(first_year)[0].second == daylight
+                                   ? standard
+                                   : daylight);
+  } else {
+    first_year =
+        detail::civil_from_days(transitions.back() / seconds_per_day).year;
+  }
+  for (int64_t year = first_year; year <= last_rule_year; ++year) {
+    for (const auto& [at, type] : changes_in(year)) {
+      if (!transitions.empty() &&
+          (at <= transitions.back() || type == transition_types.back())) {
+        continue;
+      }
+      transitions.push_back(at);
+      transition_types.push_back(type);
+    }
+  }
+  return true;
+}
+
+const TimeZone& local_zone() {
+  const TimeZone* zone = current_zone.load(std::memory_order_acquire);
+  if (zone != nullptr) {
+    return *zone;
+  }
+  std::lock_guard<std::mutex> lock(zone_mutex);
+  zone = current_zone.load(std::memory_order_relaxed);
+  return zone != nullptr ? *zone : *install(TimeZone::LoadLocal());
+}
+
+bool reload_local_zone() {
+  auto zone = load_local();
+  if (!zone) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(zone_mutex);
+  install(std::move(zone));
+  return true;
+}
+
+void set_local_zone(std::shared_ptr<const TimeZone> zone) {
+  if (!zone) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(zone_mutex);
+  install(std::move(zone));
+}
+
+size_t format_rfc3339_local(char* buf, std::chrono::system_clock::time_point tp,
+                            precision digits, const TimeZone& zone) {
+  const int32_t offset = zone.offset_at(tp);
+  // Rounded to whole minutes, so the time written agrees with the offset
+  int32_t minutes = (offset + (offset < 0 ? -30 : 30)) / 60;
+  // Drops the 'Z'
+  size_t length =
+      format_rfc3339(buf, tp + std::chrono::minutes(minutes), digits) - 1;
+  buf[length] = minutes < 0 ? '-' : '+';
+  minutes = minutes < 0 ? -minutes : minutes;
+  write2(buf + length + 1, minutes / 60 % 100);
+  buf[length + 3] = ':';
+  write2(buf + length + 4, minutes % 60);
+  return length + 6;
+}
+
+std::string print_iso8601_local(std::chrono::system_clock::time_point tp) {
+  char buf[rfc3339_local_max_length];
+  format_rfc3339_local(buf, tp, precision::seconds);
+  // Without the offset, as before
+  return std::string(buf, 19);
+}
+
+}  // namespace datetime
+}  // namespace cpputils
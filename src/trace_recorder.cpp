@@ -0,0 +1,281 @@
+#include "cpputils/trace_recorder.h"
+#include <unistd.h>
+#include <condition_variable>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cpputils {
+namespace trace {
+
+namespace {
+
+struct registered_buffer {
+  std::unique_ptr<detail::thread_buffer> buffer;
+  std::atomic<bool> exited{false};
+  bool named = false;  // thread_name metadata already written
+};
+
+struct registry {
+  std::mutex mtx;
+  std::vector<std::unique_ptr<registered_buffer>> buffers;
+  uint32_t next_tid = 1;
+  std::atomic<uint64_t> dropped_by_exited{0};
+  // Timestamps are written relative to this, starting the timeline at 0
+  const int64_t base_ns = clocks::tsc::now_ns();
+  const int pid = static_cast<int>(::getpid());
+  // Serializes consumers, buffers only support one at a time
+  std::mutex flush_mtx;
+};
+
+// Leaked, so threads exiting during static destruction can still use it
+registry& get_registry() {
+  static registry* instance = new registry();
+  return *instance;
+}
+
+// Set once the thread destroyed its exit_guard, later events (say from
+// other thread_local destructors) are dropped instead of registering again
+thread_local bool exiting = false;
+
+// Marks the buffer of an exiting thread, its events stay until flushed
+struct exit_guard {
+  registered_buffer* entry = nullptr;
+  ~exit_guard() {
+    detail::current_buffer = nullptr;
+    exiting = true;
+    if (entry != nullptr) {
+      entry->exited.store(true, std::memory_order_release);
+    }
+  }
+};
+
+thread_local exit_guard guard;
+
+void write_escaped(std::ostream& out, const char* text) {
+  for (const char* c = text; *c != '\0'; ++c) {
+    switch (*c) {
+      case '"':
+        out << "\\\"";
+        break;
+      case '\\':
+        out << "\\\\";
+        break;
+      case '\n':
+        out << "\\n";
+        break;
+      default:
+        if (static_cast<unsigned char>(*c) < 0x20) {
+          out << ' ';
+        } else {
+          out << *c;
+        }
+    }
+  }
+}
+
+class json_writer {
+ public:
+  explicit json_writer(std::ostream& out, bool first = true)
+      : out_(out), first_(first) {}
+
+  void thread_name(uint32_t tid) {
+    separator();
+    out_ << R"({"name":"thread_name","ph":"M","pid":)"
+         << get_registry().pid << R"(,"tid":)" << tid
+         << R"(,"args":{"name":"thread )" << tid << R"("}})";
+  }
+
+  void write(const event& e, uint32_t tid) {
+    static constexpr const char* phases[] = {"B", "E", "i"};
+    // Microseconds with nanosecond decimals
+    const int64_t ts = e.ts_ns - get_registry().base_ns;
+    const int64_t us = ts / 1000;
+    const int64_t frac = ts < 0 ? -(ts % 1000) : ts % 1000;
+
+    separator();
+    out_ << R"({"name":")";
+    write_escaped(out_, e.name);
+    out_ << R"(","cat":")";
+    write_escaped(out_, e.category);
+    out_ << R"(","ph":")" << phases[static_cast<int>(e.type)]
+         << R"(","ts":)" << us << '.' << static_cast<char>('0' + frac / 100)
+         << static_cast<char>('0' + frac / 10 % 10)
+         << static_cast<char>('0' + frac % 10) << R"(,"pid":)"
+         << get_registry().pid << R"(,"tid":)" << tid;
+    if (e.type == phase::instant) {
+      out_ << R"(,"s":"t")";
+    }
+    if (e.arg != 0) {
+      out_ << R"(,"args":{"arg":)" << e.arg << '}';
+    }
+    out_ << '}';
+  }
+
+  bool first() const { return first_; }
+
+ private:
+  std::ostream& out_;
+  bool first_;
+
+  void separator() {
+    if (!first_) {
+      out_ << ",\n";
+    }
+    first_ = false;
+  }
+};
+
+// Drains every buffer into the writer and forgets exited threads once they
+// are empty. Callers hold flush_mtx.
+void drain_all(json_writer& writer) {
+  auto& reg = get_registry();
+  std::vector<registered_buffer*> entries;
+  {
+    std::lock_guard<std::mutex> lock(reg.mtx);
+    entries.reserve(reg.buffers.size());
+    for (const auto& entry : reg.buffers) {
+      entries.push_back(entry.get());
+    }
+  }
+
+  for (auto* entry : entries) {
+    // Read before draining, so everything the thread pushed is included
+    const bool exited = entry->exited.load(std::memory_order_acquire);
+    const uint32_t tid = entry->buffer->tid();
+    if (!entry->named) {
+      writer.thread_name(tid);
+      entry->named = true;
+    }
+    entry->buffer->drain([&](const event& e) { writer.write(e, tid); });
+    if (exited) {
+      std::lock_guard<std::mutex> lock(reg.mtx);
+      reg.dropped_by_exited.fetch_add(entry->buffer->dropped(),
+                                      std::memory_order_relaxed);
+      for (auto it = reg.buffers.begin(); it != reg.buffers.end(); ++it) {
+        if (it->get() == entry) {
+          reg.buffers.erase(it);
+          break;
+        }
+      }
+    }
+  }
+}
+
+struct background_flusher {
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::thread worker;
+  std::ofstream file;
+  bool running = false;
+  bool stopping = false;
+};
+
+background_flusher& get_flusher() {
+  static background_flusher* instance = new background_flusher();
+  return *instance;
+}
+
+}  // namespace
+
+namespace detail {
+
+thread_buffer* register_thread() {
+  if (exiting) {
+    return nullptr;
+  }
+  auto& reg = get_registry();
+  auto entry = std::make_unique<registered_buffer>();
+  registered_buffer* raw = entry.get();
+  {
+    std::lock_guard<std::mutex> lock(reg.mtx);
+    entry->buffer = std::make_unique<thread_buffer>(reg.next_tid++);
+    reg.buffers.push_back(std::move(entry));
+  }
+  guard.entry = raw;
+  current_buffer = raw->buffer.get();
+  return current_buffer;
+}
+
+}  // namespace detail
+
+void write_chrome_trace(std::ostream& out) {
+  auto& reg = get_registry();
+  std::lock_guard<std::mutex> lock(reg.flush_mtx);
+  out << "[\n";
+  json_writer writer(out);
+  drain_all(writer);
+  out << "\n]\n";
+}
+
+bool start_background_flush(const std::string& path,
+                            std::chrono::milliseconds interval) {
+  auto& flusher = get_flusher();
+  std::lock_guard<std::mutex> lock(flusher.mtx);
+  if (flusher.running) {
+    return false;
+  }
+  flusher.file.open(path, std::ios::out | std::ios::trunc);
+  if (!flusher.file) {
+    return false;
+  }
+  flusher.file << "[\n";
+  flusher.running = true;
+  flusher.stopping = false;
+
+  flusher.worker = std::thread([&flusher, interval]() {
+    auto& reg = get_registry();
+    bool first = true;
+    std::unique_lock<std::mutex> lock(flusher.mtx);
+    while (true) {
+      const bool stop = flusher.cv.wait_for(
+          lock, interval, [&flusher]() { return flusher.stopping; });
+      lock.unlock();
+      {
+        std::lock_guard<std::mutex> flush_lock(reg.flush_mtx);
+        json_writer writer(flusher.file, first);
+        drain_all(writer);
+        first = writer.first();
+      }
+      flusher.file.flush();
+      lock.lock();
+      if (stop) {
+        return;
+      }
+    }
+  });
+  return true;
+}
+
+void stop_background_flush() {
+  auto& flusher = get_flusher();
+  {
+    std::lock_guard<std::mutex> lock(flusher.mtx);
+    if (!flusher.running) {
+      return;
+    }
+    flusher.stopping = true;
+  }
+  flusher.cv.notify_all();
+  flusher.worker.join();
+
+  std::lock_guard<std::mutex> lock(flusher.mtx);
+  flusher.file << "\n]\n";
+  flusher.file.close();
+  flusher.running = false;
+}
+
+uint64_t dropped_events() {
+  auto& reg = get_registry();
+  std::lock_guard<std::mutex> lock(reg.mtx);
+  uint64_t dropped = reg.dropped_by_exited.load(std::memory_order_relaxed);
+  for (const auto& entry : reg.buffers) {
+    dropped += entry->buffer->dropped();
+  }
+  return dropped;
+}
+
+}  // namespace trace
+}  // namespace cpputils
@@ -1,100 +1,192 @@
 #include "cpputils/uuid.h"
+#include <atomic>
 #include <cstdint>
-#include <cstdio>
+#include <cstring>
 #include <string>
-#include "cpputils/datetime.h"
 
-using cpputils::uuid::V4;
-using cpputils::uuid::V7;
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
-std::string cpputils::uuid::uuidToString(const std::array<uint8_t, 16>& uuid) {
-  char buffer[37];
-  constexpr int dash_positions[] = {8, 13, 18, 23};
-  int j = 0;
+namespace cpputils {
+namespace uuid {
+
+namespace {
+
+#ifndef __SSE2__
+// Hex digit pairs of every byte value
+constexpr auto hex_pairs = []() {
+  std::array<char, 512> table{};
+  constexpr char digits[] = "0123456789abcdef";
+  for (size_t i = 0; i < 256; ++i) {
+    table[2 * i] = digits[i >> 4];
+    table[2 * i + 1] = digits[i & 0xF];
+  }
+  return table;
+}();
+
+// Nibble value of every char, -1 when it is not a hex digit
+constexpr auto hex_values = []() {
+  std::array<int8_t, 256> table{};
+  for (size_t i = 0; i < 256; ++i) {
+    table[i] = -1;
+  }
+  for (int i = 0; i < 10; ++i) {
+    table['0' + i] = static_cast<int8_t>(i);
+  }
+  for (int i = 0; i < 6; ++i) {
+    table['a' + i] = static_cast<int8_t>(10 + i);
+    table['A' + i] = static_cast<int8_t>(10 + i);
+  }
+  return table;
+}();
+#endif
+
+// 32 hex digits of the 16 bytes
+inline void encode_hex(const uint8_t* bytes, char* out) {
+#ifdef __SSE2__
+  const __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes));
+  const __m128i mask = _mm_set1_epi8(0x0F);
+  const __m128i high = _mm_and_si128(_mm_srli_epi16(input, 4), mask);
+  const __m128i low = _mm_and_si128(input, mask);
+  // Interleaved so each byte becomes its two digits in order
+  __m128i first = _mm_unpacklo_epi8(high, low);
+  __m128i second = _mm_unpackhi_epi8(high, low);
+  // '0' + n, plus 'a' - '0' - 10 for n > 9
+  const __m128i nine = _mm_set1_epi8(9);
+  const __m128i zero = _mm_set1_epi8('0');
+  const __m128i letters = _mm_set1_epi8('a' - '0' - 10);
+  first = _mm_add_epi8(
+      _mm_add_epi8(first, zero),
+      _mm_and_si128(_mm_cmpgt_epi8(first, nine), letters));
+  second = _mm_add_epi8(
+      _mm_add_epi8(second, zero),
+      _mm_and_si128(_mm_cmpgt_epi8(second, nine), letters));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(out), first);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16), second);
+#else
   for (size_t i = 0; i < 16; ++i) {
-    // Convert each byte to hex
-    sprintf(&buffer[j], "%02x", uuid[i]);
-    j += 2;
-
-    for (int dash : dash_positions) {
-      if (j == dash) {
-        buffer[j++] = '-';
-        break;
-      }
-    }
+    std::memcpy(out + 2 * i, &hex_pairs[2 * bytes[i]], 2);
   }
-  return std::string(buffer, 36);
+#endif
 }
 
-std::array<uint8_t, 16> V4::generate() {
-  std::array<uint8_t, 16> uuid{};
-  uint64_t rand_a = random64();
-  uint64_t rand_b = random64();
-  uint64_t rand_c = random64();
-  // First 48 bits
-  uuid[0] = (rand_a >> 40) & 0xFF;  // 0-7
-  uuid[1] = (rand_a >> 32) & 0xFF;  // 8-15
-  uuid[2] = (rand_a >> 24) & 0xFF;  // 16-23
-  uuid[3] = (rand_a >> 16) & 0xFF;  // 24-31
-  uuid[4] = (rand_a >> 8) & 0xFF;   // 32-39
-  uuid[5] = rand_a & 0xFF;          // 40-47
-
-  uuid[6] = (rand_b) & 0x0F;  // fill lower 4 bits with random
-  uuid[6] |= 0x40;            // set top 4 bits to 0100
-  uuid[7] = (rand_b >> 8) & 0xFF;
-
-  uuid[8] = (rand_b >> 16) & 0xFF;
-  uuid[8] |= (0b10 << 6);
-
-  uuid[9] = (rand_c) & 0xFF;
-  uuid[10] = (rand_c >> 8) & 0xFF;
-  uuid[11] = (rand_c >> 16) & 0xFF;
-  uuid[12] = (rand_c >> 24) & 0xFF;
-  uuid[13] = (rand_c >> 32) & 0xFF;
-  uuid[14] = (rand_c >> 40) & 0xFF;
-  uuid[15] = (rand_c >> 48) & 0xFF;
+// 16 bytes from 32 hex digits, false on any other char
+inline bool decode_hex(const char* text, uint8_t* out) {
+#ifdef __SSE2__
+  __m128i halves[2];
+  for (int h = 0; h < 2; ++h) {
+    const __m128i c =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + 16 * h));
+    // Signed compares, so bytes >= 0x80 fail every range
+    const __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)),
+                                        _mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+    const __m128i lower = _mm_or_si128(c, _mm_set1_epi8(0x20));
+    const __m128i letter =
+        _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                      _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+    if (_mm_movemask_epi8(_mm_or_si128(digit, letter)) != 0xFFFF) {
+      return false;
+    }
+    const __m128i nibbles = _mm_or_si128(
+        _mm_and_si128(digit, _mm_sub_epi8(c, _mm_set1_epi8('0'))),
+        _mm_and_si128(letter,
+                      _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+    // Each 16-bit lane holds the high nibble in its low byte
+    halves[h] = _mm_or_si128(
+        _mm_slli_epi16(_mm_and_si128(nibbles, _mm_set1_epi16(0x00FF)), 4),
+        _mm_srli_epi16(nibbles, 8));
+  }
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(out),
+                   _mm_packus_epi16(halves[0], halves[1]));
+  return true;
+#else
+  for (size_t i = 0; i < 16; ++i) {
+    const int8_t high = hex_values[static_cast<uint8_t>(text[2 * i])];
+    const int8_t low = hex_values[static_cast<uint8_t>(text[2 * i + 1])];
+    if ((high | low) < 0) {
+      return false;
+    }
+    out[i] = static_cast<uint8_t>(high << 4 | low);
+  }
+  return true;
+#endif
+}
 
-  return uuid;
+}  // namespace
+
+void to_chars(const std::array<uint8_t, 16>& uuid, char* out) {
+  char hex[compact_length];
+  encode_hex(uuid.data(), hex);
+  std::memcpy(out, hex, 8);
+  out[8] = '-';
+  std::memcpy(out + 9, hex + 8, 4);
+  out[13] = '-';
+  std::memcpy(out + 14, hex + 12, 4);
+  out[18] = '-';
+  std::memcpy(out + 19, hex + 16, 4);
+  out[23] = '-';
+  std::memcpy(out + 24, hex + 20, 12);
 }
 
-uint8_t V7::next_sequence(int64_t current_timestamp) {
-  uint64_t prev_timestamp = last_timestamp.load(std::memory_order_relaxed);
+void to_chars_compact(const std::array<uint8_t, 16>& uuid, char* out) {
+  encode_hex(uuid.data(), out);
+}
 
-  if (current_timestamp > prev_timestamp) {
-    last_timestamp.store(current_timestamp, std::memory_order_relaxed);
-    sequence.store(0, std::memory_order_relaxed);
-    return 0;
-  } else {
-    return sequence.fetch_add(1, std::memory_order_relaxed) & 0xFF;
+void to_chars_n(const std::array<uint8_t, 16>* uuids, size_t count,
+                char* out) {
+  for (size_t i = 0; i < count; ++i) {
+    to_chars(uuids[i], out + i * string_length);
   }
 }
 
-std::array<uint8_t, 16> V7::generate() {
-  std::array<uint8_t, 16> uuid{};
-  int64_t timestamp = cpputils::datetime::now();
-  uint8_t seq = next_sequence(timestamp);
-  uint64_t rand_a = random64();
-  uint64_t rand_b = random64();
-
-  // Encode timestamp (big-endian)
-  uuid[0] = (timestamp >> 40) & 0xFF;
-  uuid[1] = (timestamp >> 32) & 0xFF;
-  uuid[2] = (timestamp >> 24) & 0xFF;
-  uuid[3] = (timestamp >> 16) & 0xFF;
-  uuid[4] = (timestamp >> 8) & 0xFF;
-  uuid[5] = timestamp & 0xFF;
-
-  // Version 7 (UUIDv7)
-  uuid[6] = ((timestamp >> 4) & 0x0F) | 0x70;
-  uuid[7] = ((timestamp << 4) & 0xF0) | ((seq >> 8) & 0x0F);
-
-  // Variant 1 (RFC 4122 standard)
-  uuid[8] = (seq & 0xFF) | 0x80;
-
-  // Fill remaining bytes with randomness
-  for (size_t i = 9; i < 16; i++) {
-    uuid[i] = (rand_b >> ((15 - i) * 8)) & 0xFF;
+std::optional<std::array<uint8_t, 16>> from_chars(std::string_view text) {
+  std::array<uint8_t, 16> uuid;
+  if (text.size() == compact_length) {
+    if (!decode_hex(text.data(), uuid.data())) {
+      return std::nullopt;
+    }
+    return uuid;
   }
 
+  if (text.size() != string_length || text[8] != '-' || text[13] != '-' ||
+      text[18] != '-' || text[23] != '-') {
+    return std::nullopt;
+  }
+  char hex[compact_length];
+  std::memcpy(hex, text.data(), 8);
+  std::memcpy(hex + 8, text.data() + 9, 4);
+  std::memcpy(hex + 12, text.data() + 14, 4);
+  std::memcpy(hex + 16, text.data() + 19, 4);
+  std::memcpy(hex + 20, text.data() + 24, 12);
+  if (!decode_hex(hex, uuid.data())) {
+    return std::nullopt;
+  }
   return uuid;
 }
+
+std::string uuidToString(const std::array<uint8_t, 16>& uuid) {
+  std::string result(string_length, '\0');
+  to_chars(uuid, result.data());
+  return result;
+}
+
+}  // namespace uuid
+}  // namespace cpputils
+
+uint64_t cpputils::uuid::detail::v7_reserve(int64_t timestamp_ms,
+                                            uint64_t count) {
+  // unix_ts_ms << 12 | rand_a counter of the next ID
+  static std::atomic<uint64_t> state{0};
+
+  const uint64_t floor = static_cast<uint64_t>(timestamp_ms) << 12;
+  uint64_t prev = state.load(std::memory_order_relaxed);
+  uint64_t first;
+  do {
+    // Within the same millisecond (or with the clock stepping back) the
+    // counter is bumped, overflowing into the timestamp
+    first = prev < floor ? floor : prev;
+  } while (!state.compare_exchange_weak(prev, first + count,
+                                        std::memory_order_relaxed));
+  return first;
+}
@@ -0,0 +1,118 @@
+#include "cpputils/broadcast_ring.h"
+
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+
+using namespace cpputils;
+
+namespace {
+
+// Two consumers and a third depending on both see every item in order,
+// the dependent one only after the others are done with it. The ring is
+// small so the producer wraps and waits on the slowest consumer.
+void test_fan_out(WaitStrategy wait, bool batched) {
+  constexpr long items = 200000;
+  BroadcastRing<long> ring(64, wait);
+  auto& first = ring.add_consumer();
+  auto& second = ring.add_consumer();
+  auto& last = ring.add_consumer({&first, &second});
+  BroadcastRing<long>::Consumer* consumers[] = {&first, &second, &last};
+
+  std::vector<std::thread> threads;
+  for (auto* consumer : consumers) {
+    threads.emplace_back([&, consumer] {
+      long expected = 0;
+      while (consumer->consume([&](const long& item, int64_t sequence, bool) {
+        CHECK(item == expected && sequence == expected);
+        if (consumer == &last) {
+          CHECK(first.position() >= sequence && second.position() >= sequence);
+        }
+        ++expected;
+      }) != 0) {
+      }
+      CHECK(expected == items);
+    });
+  }
+
+  if (batched) {
+    for (long i = 0; i < items; i += 50) {
+      CHECK(ring.publish_batch(50, [i](long& slot, size_t index) {
+        slot = i + static_cast<long>(index);
+      }) == 50);
+    }
+  } else {
+    for (long i = 0; i < items; ++i) {
+      CHECK(ring.publish(i));
+    }
+  }
+  ring.close();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  CHECK(ring.last_published() == items - 1);
+}
+
+// try_consume with a limit, and an exception ending a batch
+void test_try_consume() {
+  BroadcastRing<std::string> ring(4);
+  auto& consumer = ring.add_consumer();
+  auto ignore = [](const std::string&, int64_t, bool) {};
+  CHECK(consumer.try_consume(ignore) == 0);
+  for (int i = 0; i < 4; ++i) {
+    CHECK(ring.publish(std::to_string(i)));
+  }
+  CHECK(consumer.try_consume(ignore, 2) == 2);
+  CHECK(consumer.position() == 1);
+
+  bool thrown = false;
+  try {
+    consumer.try_consume([](const std::string& item, int64_t, bool) {
+      if (item == "2") {
+        throw std::runtime_error("consumer failed");
+      }
+    });
+  } catch (const std::runtime_error&) {
+    thrown = true;
+  }
+  CHECK(thrown);
+  // The item thrown for counts as consumed, the rest is still there
+  CHECK(consumer.position() == 2);
+  CHECK(consumer.try_consume(ignore) == 1);
+  CHECK(consumer.position() == 3);
+}
+
+// close() lets a producer waiting for room give up, consumers still get
+// what was published and then see the end
+void test_close() {
+  BroadcastRing<int> ring(4);
+  auto& consumer = ring.add_consumer();
+  for (int i = 0; i < 4; ++i) {
+    CHECK(ring.publish(i));
+  }
+  std::thread closer([&] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ring.close();
+  });
+  CHECK(!ring.publish(4));
+  closer.join();
+  CHECK(!ring.publish(5));
+  auto ignore = [](const int&, int64_t, bool) {};
+  CHECK(consumer.consume(ignore) == 4);
+  CHECK(consumer.consume(ignore) == 0);
+}
+
+}  // namespace
+
+int main() {
+  test_fan_out(WaitStrategy::Park, false);
+  test_fan_out(WaitStrategy::Park, true);
+  test_fan_out(WaitStrategy::Yield, false);
+  test_try_consume();
+  test_close();
+  return 0;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+
+// assert() that stays on in release builds
+#define CHECK(condition)                                              \
+  do {                                                                \
+    if (!(condition)) {                                               \
+      std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__,     \
+                   __LINE__, #condition);                             \
+      std::abort();                                                   \
+    }                                                                 \
+  } while (false)
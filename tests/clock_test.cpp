@@ -0,0 +1,128 @@
+#include "cpputils/clock.h"
+
+#include <dirent.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+
+#include "cpputils/instrumented_mutex.h"
+#include "check.h"
+
+using namespace cpputils;
+
+namespace {
+
+// Threads of the process before the tests, sanitizers may add their own
+size_t base_threads = 0;
+
+size_t thread_count() {
+  size_t count = 0;
+  DIR* dir = ::opendir("/proc/self/task");
+  CHECK(dir != nullptr);
+  while (const dirent* entry = ::readdir(dir)) {
+    count += entry->d_name[0] != '.';
+  }
+  ::closedir(dir);
+  return count;
+}
+
+// Calibrates within a few milliseconds of reads, on the reading thread,
+// and stays monotonic and close to steady_clock
+void test_tsc_calibrates_inline() {
+  int64_t last = clocks::tsc::now_ns();
+  const int64_t deadline = clocks::steady_ns() + 1'000'000'000;
+  while (!clocks::tsc::available() && clocks::steady_ns() < deadline) {
+    const int64_t now = clocks::tsc::now_ns();
+    CHECK(now >= last);
+    last = now;
+  }
+#ifdef CPPUTILS_HAS_TSC
+  if (!clocks::tsc::available()) {
+    return;  // No invariant TSC, now_ns() is steady_ns()
+  }
+  // Past a drift correction or two
+  const int64_t end = clocks::steady_ns() + 2'500'000'000;
+  while (clocks::steady_ns() < end) {
+    const int64_t before = clocks::steady_ns();
+    const int64_t now = clocks::tsc::now_ns();
+    const int64_t after = clocks::steady_ns();
+    CHECK(now >= last);
+    CHECK(now > before - 1'000'000 && now < after + 1'000'000);
+    last = now;
+  }
+#endif
+  CHECK(thread_count() == base_threads);
+}
+
+// Sampled locks time themselves with the TSC, which starts no thread
+void test_mutex_starts_no_thread() {
+  instrumented_mutex mtx("clock_test");
+  for (int i = 0; i < 1000; ++i) {
+    std::lock_guard<instrumented_mutex> lock(mtx);
+  }
+  CHECK(thread_count() == base_threads);
+}
+
+void sleep_ms(int ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+// The cached clocks follow the coarse ones with or without the ticker,
+// without going backwards when it starts or stops
+void test_ticker_start_stop() {
+  CHECK(thread_count() == base_threads);
+  int64_t steady = clocks::cached_steady_ms();
+  CHECK(std::abs(clocks::cached_unix_ms() - clocks::system_ms()) < 100);
+
+  clocks::start_ticker();
+  clocks::start_ticker();
+  CHECK(thread_count() == base_threads + 1);
+  for (int i = 0; i < 3; ++i) {
+    CHECK(clocks::cached_steady_ms() >= steady);
+    steady = clocks::cached_steady_ms();
+    CHECK(std::abs(clocks::cached_unix_ms() - clocks::system_ms()) < 100);
+    sleep_ms(20);
+  }
+  CHECK(clocks::cached_steady_ms() > steady);
+
+  clocks::stop_ticker();
+  CHECK(thread_count() == base_threads);
+  CHECK(clocks::cached_steady_ms() >= steady);
+  clocks::stop_ticker();
+}
+
+// A child starts without the ticker and can run its own
+void test_ticker_after_fork() {
+  clocks::start_ticker();
+  const pid_t child = ::fork();
+  CHECK(child >= 0);
+  if (child == 0) {
+    CHECK(thread_count() <= base_threads);
+    const int64_t steady = clocks::cached_steady_ms();
+    clocks::start_ticker();
+    sleep_ms(20);
+    CHECK(clocks::cached_steady_ms() > steady);
+    clocks::stop_ticker();
+    std::_Exit(thread_count() <= base_threads ? 0 : 1);
+  }
+  int status = 0;
+  CHECK(::waitpid(child, &status, 0) == child);
+  CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  clocks::stop_ticker();
+}
+
+}  // namespace
+
+int main() {
+  base_threads = thread_count();
+  test_mutex_starts_no_thread();
+  test_tsc_calibrates_inline();
+  test_ticker_start_stop();
+  test_ticker_after_fork();
+  // Still running at exit, joined there
+  clocks::start_ticker();
+  return 0;
+}
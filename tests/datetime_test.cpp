@@ -0,0 +1,137 @@
+#include "cpputils/datetime.h"
+
+#include <time.h>
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+
+#include "check.h"
+
+using namespace cpputils;
+using namespace std::chrono;
+
+namespace {
+
+std::string format(system_clock::time_point tp, datetime::precision digits) {
+  char buf[datetime::rfc3339_max_length];
+  return std::string(buf, datetime::format_rfc3339(buf, tp, digits));
+}
+
+system_clock::time_point at_ns(int64_t ns) {
+  return system_clock::time_point(
+      duration_cast<system_clock::duration>(nanoseconds(ns)));
+}
+
+// gmtime_r and the fraction digits, for comparison
+std::string reference(int64_t ns) {
+  int64_t seconds = ns / 1000000000;
+  int64_t fraction = ns % 1000000000;
+  if (fraction < 0) {
+    --seconds;
+    fraction += 1000000000;
+  }
+  const auto time = static_cast<time_t>(seconds);
+  struct tm parts;
+  CHECK(::gmtime_r(&time, &parts) != nullptr);
+  char buf[64];
+  std::snprintf(buf, sizeof(buf), "%04d-%02d-%02dT%02d:%02d:%02d.%09lldZ",
+                parts.tm_year + 1900, parts.tm_mon + 1, parts.tm_mday,
+                parts.tm_hour, parts.tm_min, parts.tm_sec,
+                static_cast<long long>(fraction));
+  return buf;
+}
+
+void test_format() {
+  const auto tp = at_ns(1747594426123456789);
+  CHECK(format(tp, datetime::precision::seconds) == "2025-05-18T18:53:46Z");
+  CHECK(format(tp, datetime::precision::milliseconds) ==
+        "2025-05-18T18:53:46.123Z");
+  CHECK(format(tp, datetime::precision::microseconds) ==
+        "2025-05-18T18:53:46.123456Z");
+  CHECK(format(tp, datetime::precision::nanoseconds) ==
+        "2025-05-18T18:53:46.123456789Z");
+  CHECK(datetime::print_iso8601_utc(tp) == "2025-05-18T18:53:46Z");
+
+  CHECK(format(at_ns(0), datetime::precision::milliseconds) ==
+        "1970-01-01T00:00:00.000Z");
+  // Truncated towards the past, also before the epoch
+  CHECK(format(at_ns(-1000000), datetime::precision::milliseconds) ==
+        "1969-12-31T23:59:59.999Z");
+  CHECK(format(at_ns(-1), datetime::precision::seconds) ==
+        "1969-12-31T23:59:59Z");
+  CHECK(format(at_ns(951782400000000000), datetime::precision::seconds) ==
+        "2000-02-29T00:00:00Z");
+}
+
+// Runs of nearby times, forwards and backwards across seconds, days and
+// years, so the cached second is both reused and replaced
+void test_format_matches_gmtime() {
+  std::mt19937_64 random(3);
+  for (int run = 0; run < 2000; ++run) {
+    // 1906 to 2160
+    int64_t ns = static_cast<int64_t>(random() % 8000000000000000000) -
+                 2000000000000000000;
+    for (int step = 0; step < 50; ++step) {
+      ns += static_cast<int64_t>(random() % 600000000000) - 300000000000;
+      CHECK(format(at_ns(ns), datetime::precision::nanoseconds) ==
+            reference(ns));
+    }
+  }
+}
+
+void test_parse() {
+  const auto parse = datetime::parse_rfc3339;
+  const auto tp = at_ns(1747594426123456789);
+  CHECK(parse("2025-05-18T18:53:46.123456789Z") == tp);
+  CHECK(parse("2025-05-18t18:53:46.1234567891234z") == tp);
+  CHECK(parse("2025-05-18 20:53:46.123456789+02:00") == tp);
+  CHECK(parse("2025-05-18T17:23:46.123456789-01:30") == tp);
+  CHECK(parse("2025-05-18T18:53:46Z") == at_ns(1747594426000000000));
+  CHECK(parse("2025-05-18T18:53:46.5Z") == at_ns(1747594426500000000));
+  CHECK(parse("1969-12-31T23:59:59.999Z") == at_ns(-1000000));
+  CHECK(parse("2000-02-29T00:00:00Z") == at_ns(951782400000000000));
+
+  for (const char* bad : {
+           "",
+           "2025-05-18T18:53:46",
+           "2025-05-18T18:53:46.Z",
+           "2025-05-18T18:53:46.123",
+           "2025-05-18T18:53:46ZZ",
+           "2025-05-18X18:53:46Z",
+           "2025/05/18T18:53:46Z",
+           "2025-13-18T18:53:46Z",
+           "2025-00-18T18:53:46Z",
+           "2025-02-29T18:53:46Z",
+           "2025-04-31T18:53:46Z",
+           "2025-05-18T24:00:00Z",
+           "2025-05-18T18:60:46Z",
+           "2025-05-18T18:53:60Z",
+           "2025-05-18T18:53:46+24:00",
+           "2025-05-18T18:53:46+02:60",
+           "2025-05-18T18:53:46+0200",
+           "2025-05-18T18:53:46+02:00x",
+           "2025-5-18T18:53:46Z",
+           "20x5-05-18T18:53:46Z",
+       }) {
+    CHECK(!parse(bad));
+  }
+
+  // What is formatted parses back
+  std::mt19937_64 random(5);
+  for (int n = 0; n < 10000; ++n) {
+    const auto ns = static_cast<int64_t>(random() % 4000000000000000000);
+    CHECK(parse(format(at_ns(ns), datetime::precision::nanoseconds)) ==
+          at_ns(ns));
+  }
+}
+
+}  // namespace
+
+int main() {
+  test_format();
+  test_format_matches_gmtime();
+  test_parse();
+  return 0;
+}
@@ -0,0 +1,99 @@
+#include "cpputils/distributed_rw_lock.h"
+
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+
+using namespace cpputils;
+
+namespace {
+
+// Readers never overlap a writer and never see half of a write, whichever
+// of the blocking and try paths each side takes
+void test_exclusion() {
+  DistributedRWLock lock(4);
+  std::atomic<int> readers{0};
+  std::atomic<int> writers{0};
+  uint64_t first = 0;
+  uint64_t second = 0;
+  std::atomic<bool> stop{false};
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&, t] {
+      while (!stop.load(std::memory_order_relaxed)) {
+        const bool locked =
+            t % 2 == 0 ? (lock.lock_shared(), true) : lock.try_lock_shared();
+        if (!locked) {
+          continue;
+        }
+        ++readers;
+        CHECK(writers.load() == 0);
+        CHECK(first == second);
+        --readers;
+        lock.unlock_shared();
+        std::this_thread::yield();
+      }
+    });
+  }
+  for (int t = 0; t < 2; ++t) {
+    threads.emplace_back([&, t] {
+      for (int i = 0; i < 500; ++i) {
+        if (t == 0) {
+          lock.lock();
+        } else if (!lock.try_lock()) {
+          continue;
+        }
+        CHECK(++writers == 1);
+        CHECK(readers.load() == 0);
+        ++first;
+        std::this_thread::yield();
+        ++second;
+        --writers;
+        lock.unlock();
+      }
+    });
+  }
+  threads[4].join();
+  threads[5].join();
+  stop = true;
+  for (size_t t = 0; t < 4; ++t) {
+    threads[t].join();
+  }
+  CHECK(first == second && first >= 500);
+}
+
+void test_try_and_guards() {
+  DistributedRWLock lock;
+  CHECK(lock.slot_count() >= 1);
+  CHECK((lock.slot_count() & (lock.slot_count() - 1)) == 0);
+  {
+    std::shared_lock<DistributedRWLock> read(lock);
+    CHECK(!lock.try_lock());
+    std::thread([&] {
+      std::shared_lock<DistributedRWLock> other(lock, std::try_to_lock);
+      CHECK(other.owns_lock());
+    }).join();
+  }
+  {
+    std::unique_lock<DistributedRWLock> write(lock);
+    std::thread([&] { CHECK(!lock.try_lock_shared()); }).join();
+    std::thread([&] { CHECK(!lock.try_lock()); }).join();
+  }
+  CHECK(lock.try_lock_shared());
+  lock.unlock_shared();
+  CHECK(lock.try_lock());
+  lock.unlock();
+}
+
+}  // namespace
+
+int main() {
+  test_exclusion();
+  test_try_and_guards();
+  return 0;
+}
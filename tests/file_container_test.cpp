@@ -0,0 +1,450 @@
+#include "cpputils/file_container.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+
+using namespace cpputils;
+namespace fs = std::filesystem;
+
+namespace {
+
+// Fresh directory below the system temp directory, removed with the object
+class TempDir {
+ public:
+  TempDir() {
+    std::string pattern = (fs::temp_directory_path() / "fc_test_XXXXXX");
+    CHECK(::mkdtemp(pattern.data()) != nullptr);
+    path_ = pattern;
+  }
+  ~TempDir() {
+    std::error_code ec;
+    fs::remove_all(path_, ec);
+  }
+
+  const fs::path& path() const { return path_; }
+  std::string str() const { return path_.string(); }
+
+  void write(const std::string& name, const std::string& content) const {
+    fs::create_directories((path_ / name).parent_path());
+    std::ofstream(path_ / name, std::ios::binary | std::ios::trunc) << content;
+  }
+
+ private:
+  fs::path path_;
+};
+
+void wait_for(const std::function<bool()>& done) {
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (!done()) {
+    CHECK(std::chrono::steady_clock::now() < deadline);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+FileContainerOptions watching(FileWatchMode mode) {
+  FileContainerOptions options;
+  options.watch = mode;
+  options.poll_interval = std::chrono::milliseconds(10);
+  return options;
+}
+
+// Mapped files are shared between hits instead of copied, and a view keeps
+// its contents when the entry is replaced
+void test_mmap_views() {
+  TempDir dir;
+  dir.write("a.txt", std::string(10000, 'a'));
+  dir.write("empty.txt", "");
+  FileContainer container(dir.str(), FileLoadMode::Mmap);
+
+  const FileView first = container.GetFileView("a.txt");
+  CHECK(first.buffer()->mapped());
+  CHECK(first.view() == std::string(10000, 'a'));
+  // Looked up by a view that is not null-terminated
+  const FileView second =
+      container.GetFileView(std::string_view("a.txt.unused", 5));
+  CHECK(second.buffer() == first.buffer());
+  CHECK(second.data() == first.data());
+
+  const FileView empty = container.GetFileView("empty.txt");
+  CHECK(empty.empty() && !empty.buffer()->mapped());
+  CHECK(container.GetFileView("missing.txt").empty());
+
+  container.SetFileContent("a.txt", "replaced");
+  CHECK(first.view() == std::string(10000, 'a'));
+  CHECK(container.GetFileView("a.txt").view() == "replaced");
+  CHECK(container.GetFileContent("a.txt") == "replaced");
+
+  const auto stats = container.GetStats();
+  CHECK(stats.hits == 3 && stats.misses == 3);
+}
+
+// Misses on one file wait for a single read, which blocks neither hits nor
+// misses on other files. A FIFO only hands its data to one reader, every
+// thread sees it only when they share that read.
+void test_single_flight() {
+  TempDir dir;
+  dir.write("other.txt", "other");
+  const auto fifo = dir.path() / "slow";
+  CHECK(::mkfifo(fifo.c_str(), 0600) == 0);
+  FileContainer container(dir.str());
+  CHECK(container.GetFileContent("other.txt") == "other");
+
+  constexpr int readers = 8;
+  std::vector<std::string> seen(readers);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < readers; ++t) {
+    threads.emplace_back(
+        [&, t] { seen[t] = container.GetFileContent("slow"); });
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  CHECK(container.GetFileContent("other.txt") == "other");
+  dir.write("new.txt", "new");
+  CHECK(container.GetFileContent("new.txt") == "new");
+
+  const int fd = ::open(fifo.c_str(), O_WRONLY);
+  CHECK(fd >= 0);
+  CHECK(::write(fd, "data", 4) == 4);
+  ::close(fd);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (const auto& content : seen) {
+    CHECK(content == "data");
+  }
+  const auto stats = container.GetStats();
+  CHECK(stats.entries == 3);
+  CHECK(stats.misses == readers + 2);
+  CHECK(stats.hits == 1);
+}
+
+FileContainerOptions bounded(EvictionPolicy policy, size_t max_entries,
+                             size_t max_bytes = 0) {
+  FileContainerOptions options;
+  options.eviction = policy;
+  options.max_entries = max_entries;
+  options.max_bytes = max_bytes;
+  return options;
+}
+
+// Entry and byte budgets hold whatever is read, files larger than a shard's
+// byte budget are served uncached, and views outlive their eviction
+void test_budgets() {
+  TempDir dir;
+  for (int i = 0; i < 200; ++i) {
+    dir.write(std::to_string(i), std::string(40, 'a' + i % 26));
+  }
+  dir.write("large", std::string(1000, 'l'));
+
+  for (auto policy : {EvictionPolicy::LRU, EvictionPolicy::S3FIFO}) {
+    FileContainer by_count(dir.str(), bounded(policy, 32));
+    const FileView kept = by_count.GetFileView("0");
+    for (int i = 0; i < 200; ++i) {
+      CHECK(by_count.GetFileContent(std::to_string(i)) ==
+            std::string(40, 'a' + i % 26));
+      CHECK(by_count.GetStats().entries <= 32);
+    }
+    const auto stats = by_count.GetStats();
+    CHECK(stats.misses == 200 && stats.hits == 1);
+    CHECK(stats.evictions == 200 - stats.entries);
+    CHECK(kept.view() == std::string(40, 'a'));
+
+    // 100 bytes for each of the 16 shards
+    FileContainer by_size(dir.str(), bounded(policy, 0, 1600));
+    for (int i = 0; i < 200; ++i) {
+      by_size.GetFileView(std::to_string(i));
+      CHECK(by_size.GetStats().bytes <= 1600);
+    }
+    const size_t entries = by_size.GetStats().entries;
+    CHECK(by_size.GetFileContent("large") == std::string(1000, 'l'));
+    CHECK(by_size.GetFileContent("large") == std::string(1000, 'l'));
+    CHECK(by_size.GetStats().entries == entries);
+  }
+}
+
+// Hits on a hot set read twice before, after a scan of files read once.
+// LRU loses the hot set to the scan, S3-FIFO keeps the scanned files in its
+// small queue.
+uint64_t hot_hits_after_scan(const TempDir& dir, EvictionPolicy policy) {
+  // 20 entries for each of the 16 shards
+  FileContainer container(dir.str(), bounded(policy, 320));
+  for (int round = 0; round < 2; ++round) {
+    for (int i = 0; i < 32; ++i) {
+      container.GetFileView("hot/" + std::to_string(i));
+    }
+  }
+  for (int i = 0; i < 1000; ++i) {
+    container.GetFileView("scan/" + std::to_string(i));
+  }
+  const uint64_t before = container.GetStats().hits;
+  for (int i = 0; i < 32; ++i) {
+    container.GetFileView("hot/" + std::to_string(i));
+  }
+  return container.GetStats().hits - before;
+}
+
+void test_scan_resistance() {
+  TempDir dir;
+  for (int i = 0; i < 32; ++i) {
+    dir.write("hot/" + std::to_string(i), "hot");
+  }
+  for (int i = 0; i < 1000; ++i) {
+    dir.write("scan/" + std::to_string(i), "scan");
+  }
+  CHECK(hot_hits_after_scan(dir, EvictionPolicy::LRU) == 0);
+  CHECK(hot_hits_after_scan(dir, EvictionPolicy::S3FIFO) == 32);
+}
+
+// Written and renamed files are reloaded, deleted ones dropped
+void test_inotify_reload() {
+  TempDir dir;
+  dir.write("a.txt", "one");
+  FileContainer container(dir.str(), watching(FileWatchMode::Inotify));
+  CHECK(container.GetFileContent("a.txt") == "one");
+
+  dir.write("a.txt", "two");
+  wait_for([&] { return container.GetFileContent("a.txt") == "two"; });
+
+  dir.write("b.tmp", "three");
+  fs::rename(dir.path() / "b.tmp", dir.path() / "a.txt");
+  wait_for([&] { return container.GetFileContent("a.txt") == "three"; });
+
+  fs::remove(dir.path() / "a.txt");
+  wait_for([&] { return container.GetStats().entries == 0; });
+  CHECK(container.GetFileContent("a.txt").empty());
+}
+
+void test_poll_reload() {
+  TempDir dir;
+  dir.write("a.txt", "one");
+  FileContainer container(dir.str(), watching(FileWatchMode::Poll));
+  CHECK(container.GetFileContent("a.txt") == "one");
+  dir.write("a.txt", "changed");  // Different size, whatever the mtime
+  wait_for([&] { return container.GetFileContent("a.txt") == "changed"; });
+}
+
+// A change reported while the miss for the same file is still reading
+// makes the miss read again instead of caching what it read before. The
+// miss blocks opening a FIFO until it is written through a second link,
+// after the name was replaced by a regular file.
+void test_change_during_miss() {
+  TempDir dir;
+  const auto fifo = dir.path() / "f";
+  CHECK(::mkfifo(fifo.c_str(), 0600) == 0);
+  fs::create_hard_link(fifo, dir.path() / "fifo_link");
+  FileContainer container(dir.str(), watching(FileWatchMode::Inotify));
+
+  std::string seen;
+  std::thread reader([&] { seen = container.GetFileContent("f"); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  dir.write("f.new", "new");
+  fs::rename(dir.path() / "f.new", fifo);
+  // Lets the watcher see the rename while the read is in flight
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+  const int fd = ::open((dir.path() / "fifo_link").c_str(), O_WRONLY);
+  CHECK(fd >= 0);
+  CHECK(::write(fd, "old", 3) == 3);
+  ::close(fd);
+  reader.join();
+
+  CHECK(seen == "new");
+  CHECK(container.GetFileContent("f") == "new");
+}
+
+// Files below a directory moved away are dropped, and the directory's
+// watch no longer reports them under the old name
+void test_directory_moved_away() {
+  TempDir dir;
+  dir.write("sub/a.txt", "a");
+  dir.write("sub/deep/b.txt", "b");
+  dir.write("subway.txt", "c");
+  FileContainer container(dir.str(), watching(FileWatchMode::Inotify));
+  CHECK(container.GetFileContent("sub/a.txt") == "a");
+  CHECK(container.GetFileContent("sub/deep/b.txt") == "b");
+  CHECK(container.GetFileContent("subway.txt") == "c");
+
+  fs::rename(dir.path() / "sub", dir.path() / "moved");
+  wait_for([&] { return container.GetStats().entries == 1; });
+  CHECK(container.GetFileContent("sub/a.txt").empty());
+  CHECK(container.GetFileContent("subway.txt") == "c");
+  CHECK(container.GetFileContent("moved/a.txt") == "a");
+
+  dir.write("moved/a.txt", "changed");
+  wait_for(
+      [&] { return container.GetFileContent("moved/a.txt") == "changed"; });
+}
+
+// progress runs on the I/O pool and may read through the container, batched
+// reads from there run inline instead of waiting on the busy pool
+void test_preload_reentrant_progress() {
+  TempDir dir;
+  constexpr size_t files = 40;
+  uint64_t expected_bytes = 0;
+  for (size_t i = 0; i < files; ++i) {
+    dir.write("pre/" + std::to_string(i), std::string(i + 1, 'x'));
+    expected_bytes += i + 1;
+    dir.write("side/" + std::to_string(i), std::to_string(i));
+  }
+  FileContainerOptions options;
+  options.io_threads = 2;
+  FileContainer container(dir.str(), options);
+
+  std::atomic<size_t> calls{0};
+  std::atomic<size_t> max_done{0};
+  std::atomic<bool> finished{false};
+  PreloadResult result;
+  std::thread preloading([&] {
+    result = container.Preload(
+        "pre", nullptr, [&](size_t done, size_t total, uint64_t) {
+          CHECK(total == files);
+          ++calls;
+          size_t seen = max_done;
+          while (done > seen && !max_done.compare_exchange_weak(seen, done)) {
+          }
+          const std::string a = "side/" + std::to_string(done - 1);
+          const std::string b = "side/" + std::to_string(files - done);
+          const auto views = container.GetFileViews(std::vector{a, b});
+          CHECK(views[0].view() == std::to_string(done - 1));
+          CHECK(views[1].view() == std::to_string(files - done));
+        });
+    finished = true;
+  });
+  wait_for([&] { return finished.load(); });
+  preloading.join();
+
+  CHECK(result.files == files);
+  CHECK(result.bytes == expected_bytes);
+  CHECK(calls == files);
+  CHECK(max_done == files);
+  CHECK(container.GetStats().entries == 2 * files);
+}
+
+// zlib's CRC-32, as used in the pack
+uint32_t crc32(const char* data, size_t size) {
+  uint32_t crc = ~0u;
+  for (size_t i = 0; i < size; ++i) {
+    crc ^= static_cast<uint8_t>(data[i]);
+    for (int k = 0; k < 8; ++k) {
+      crc = (crc & 1) ? 0xEDB88320u ^ (crc >> 1) : crc >> 1;
+    }
+  }
+  return ~crc;
+}
+
+std::string read_file(const fs::path& path) {
+  std::ifstream in(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(in), {});
+}
+
+size_t files_in(const fs::path& directory) {
+  return static_cast<size_t>(std::distance(fs::directory_iterator(directory),
+                                           fs::directory_iterator()));
+}
+
+// Saves running at the same time each write a file of their own, and
+// leave only the pack behind
+void test_snapshot_save() {
+  TempDir dir;
+  TempDir packs;
+  for (int i = 0; i < 20; ++i) {
+    dir.write("f" + std::to_string(i), std::string(100 * i, 'a' + i % 26));
+  }
+  FileContainer container(dir.str());
+  CHECK(container.Preload().files == 20);
+
+  const auto pack = packs.path() / "cache.pack";
+  std::vector<std::thread> savers;
+  std::atomic<int> saved{0};
+  for (int t = 0; t < 4; ++t) {
+    savers.emplace_back([&] { saved += container.SaveSnapshot(pack); });
+  }
+  for (auto& saver : savers) {
+    saver.join();
+  }
+  CHECK(saved == 4);
+  CHECK(files_in(packs.path()) == 1);
+
+  fs::remove_all(dir.path());
+  fs::create_directories(dir.path());
+  FileContainerOptions options;
+  options.snapshot = pack;
+  FileContainer restored(dir.str(), options);
+  CHECK(restored.HasSnapshot());
+  for (int i = 0; i < 20; ++i) {
+    CHECK(restored.GetFileContent("f" + std::to_string(i)) ==
+          std::string(100 * i, 'a' + i % 26));
+  }
+  CHECK(!container.SaveSnapshot(packs.path() / "missing" / "cache.pack"));
+  CHECK(files_in(packs.path()) == 1);
+}
+
+// A name range whose end wraps around is rejected when opening, not read
+// out of bounds on lookups
+void test_snapshot_name_overflow() {
+  TempDir dir;
+  dir.write("a", "folder");
+  const auto pack = dir.path() / "cache.pack";
+  {
+    FileContainer container(dir.str());
+    container.SetFileContent("a", "packed");
+    CHECK(container.SaveSnapshot(pack));
+  }
+
+  std::string bytes = read_file(pack);
+  const auto put64 = [&](size_t at, uint64_t value) {
+    std::memcpy(&bytes[at], &value, sizeof(value));
+  };
+  const auto put32 = [&](size_t at, uint32_t value) {
+    std::memcpy(&bytes[at], &value, sizeof(value));
+  };
+  uint64_t data_offset;
+  std::memcpy(&data_offset, &bytes[32], sizeof(data_offset));
+  // Header: index_crc at 48, header_crc at 52. Entry 0 at 64: name_offset
+  // at +0, name_size at +32.
+  put64(64, ~uint64_t{0} - 1);
+  put32(64 + 32, 4);
+  put32(48, crc32(&bytes[64], data_offset - 64));
+  put32(52, 0);
+  put32(52, crc32(bytes.data(), 64));
+  std::ofstream(pack, std::ios::binary | std::ios::trunc) << bytes;
+
+  FileContainerOptions options;
+  options.snapshot = pack;
+  FileContainer container(dir.str(), options);
+  CHECK(!container.HasSnapshot());
+  CHECK(container.GetFileContent("a") == "folder");
+}
+
+}  // namespace
+
+int main() {
+  test_mmap_views();
+  test_single_flight();
+  test_budgets();
+  test_scan_resistance();
+  test_inotify_reload();
+  test_poll_reload();
+  test_change_during_miss();
+  test_directory_moved_away();
+  test_preload_reentrant_progress();
+  test_snapshot_save();
+  test_snapshot_name_overflow();
+  return 0;
+}
@@ -0,0 +1,256 @@
+#include "cpputils/io_reactor.h"
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+
+using namespace cpputils;
+
+namespace {
+
+void wait_for(const std::function<bool()>& done) {
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (!done()) {
+    CHECK(std::chrono::steady_clock::now() < deadline);
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+}
+
+std::array<int, 2> make_socketpair() {
+  int sv[2];
+  CHECK(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv) == 0);
+  return {sv[0], sv[1]};
+}
+
+// Many socketpairs echoing through callbacks on a pool, half of them
+// edge-triggered
+void test_echo(TaskScheduler<void>& pool) {
+  auto reactor = IoReactor::Create(&pool, 64);
+  CHECK(reactor);
+  constexpr int connections = 200;
+  constexpr int rounds = 10;
+  std::vector<std::array<int, 2>> pairs;
+  for (int i = 0; i < connections; ++i) {
+    pairs.push_back(make_socketpair());
+    const auto trigger = i % 2 ? IoTrigger::Edge : IoTrigger::Level;
+    CHECK(reactor->add(
+        pairs.back()[1], IoEvents::Read,
+        [](int fd, IoEvents) {
+          char buf[256];
+          ssize_t n;
+          while ((n = ::read(fd, buf, sizeof(buf))) > 0) {
+            CHECK(::write(fd, buf, n) == n);
+          }
+        },
+        trigger));
+  }
+  CHECK(!reactor->add(pairs[0][1], IoEvents::Read, [](int, IoEvents) {}));
+  CHECK(errno == EEXIST);
+  CHECK(reactor->watched() == connections);
+
+  for (int round = 0; round < rounds; ++round) {
+    for (const auto& pair : pairs) {
+      CHECK(::write(pair[0], "ping", 4) == 4);
+    }
+    for (const auto& pair : pairs) {
+      char buf[4];
+      size_t got = 0;
+      wait_for([&] {
+        const ssize_t n = ::read(pair[0], buf + got, sizeof(buf) - got);
+        if (n > 0) {
+          got += static_cast<size_t>(n);
+        }
+        return got == sizeof(buf);
+      });
+      CHECK(std::memcmp(buf, "ping", 4) == 0);
+    }
+  }
+  for (const auto& pair : pairs) {
+    CHECK(reactor->remove(pair[1]));
+  }
+  reactor.reset();
+  for (const auto& pair : pairs) {
+    ::close(pair[0]);
+    ::close(pair[1]);
+  }
+}
+
+// modify() racing with the one-shot firing must not start a second
+// callback for the same fd
+void test_modify_never_overlaps(TaskScheduler<void>& pool) {
+  auto reactor = IoReactor::Create(&pool);
+  CHECK(reactor);
+  const auto pair = make_socketpair();
+  CHECK(::write(pair[0], "x", 1) == 1);  // Stays readable, never drained
+  std::atomic<int> inside{0};
+  std::atomic<int> max_inside{0};
+  std::atomic<int> calls{0};
+  CHECK(reactor->add(pair[1], IoEvents::Read, [&](int, IoEvents) {
+    const int now = inside.fetch_add(1) + 1;
+    int seen = max_inside.load();
+    while (now > seen && !max_inside.compare_exchange_weak(seen, now)) {
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+    inside.fetch_sub(1);
+    calls.fetch_add(1);
+  }));
+  std::atomic<bool> stop{false};
+  std::thread modifier([&] {
+    while (!stop.load()) {
+      reactor->modify(pair[1], IoEvents::Read);
+    }
+  });
+  wait_for([&] { return calls.load() >= 500; });
+  stop = true;
+  modifier.join();
+  reactor.reset();
+  CHECK(max_inside.load() == 1);
+  ::close(pair[0]);
+  ::close(pair[1]);
+}
+
+// Hangup reported to a callback that removes its own fd
+void test_hangup_and_remove(TaskScheduler<void>& pool) {
+  auto reactor = IoReactor::Create(&pool);
+  CHECK(reactor);
+  const auto pair = make_socketpair();
+  std::atomic<bool> hangup{false};
+  IoReactor* self = reactor.get();
+  CHECK(reactor->add(pair[1], IoEvents::Read, [&, self](int fd, IoEvents ev) {
+    char buf[16];
+    while (::read(fd, buf, sizeof(buf)) > 0) {
+    }
+    if (has_event(ev, IoEvents::Hangup)) {
+      self->remove(fd);
+      hangup = true;
+    }
+  }));
+  CHECK(::write(pair[0], "data", 4) == 4);
+  ::close(pair[0]);
+  wait_for([&] { return hangup.load(); });
+  CHECK(!reactor->remove(pair[1]));
+  CHECK(reactor->watched() == 0);
+  ::close(pair[1]);
+}
+
+// Write readiness on a pipe, switched on and off with modify()
+void test_pipe_write(TaskScheduler<void>& pool) {
+  auto reactor = IoReactor::Create(&pool);
+  CHECK(reactor);
+  int fds[2];
+  CHECK(::pipe2(fds, O_NONBLOCK) == 0);
+  std::atomic<int> writable{0};
+  IoReactor* self = reactor.get();
+  CHECK(reactor->add(fds[1], IoEvents::None, [&, self](int fd, IoEvents ev) {
+    if (has_event(ev, IoEvents::Write)) {
+      writable.fetch_add(1);
+    }
+    self->modify(fd, IoEvents::None);
+  }));
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  CHECK(writable.load() == 0);
+  CHECK(reactor->modify(fds[1], IoEvents::Write));
+  wait_for([&] { return writable.load() == 1; });
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  CHECK(writable.load() == 1);
+  CHECK(reactor->remove(fds[1]));
+  ::close(fds[0]);
+  ::close(fds[1]);
+}
+
+// post() from several threads wakes the loop through the eventfd
+void test_post(TaskScheduler<void>& pool) {
+  auto reactor = IoReactor::Create(&pool);
+  CHECK(reactor);
+  std::atomic<int> ran{0};
+  std::vector<std::thread> posters;
+  for (int t = 0; t < 4; ++t) {
+    posters.emplace_back([&] {
+      for (int i = 0; i < 1000; ++i) {
+        reactor->post([&] { ran.fetch_add(1); });
+      }
+    });
+  }
+  for (auto& poster : posters) {
+    poster.join();
+  }
+  wait_for([&] { return ran.load() == 4000; });
+}
+
+// Two threads each posting a task and waiting for it before the next. A
+// post landing while the loop handles another wakeup must not lose its
+// own, or its poster waits forever once the other one is done.
+void test_post_ping_pong() {
+  auto reactor = IoReactor::Create(nullptr);
+  CHECK(reactor);
+  constexpr int rounds = 20000;
+  std::vector<std::thread> posters;
+  for (int t = 0; t < 2; ++t) {
+    posters.emplace_back([&] {
+      for (int i = 0; i < rounds; ++i) {
+        std::atomic<bool> done{false};
+        reactor->post([&] { done = true; });
+        const auto deadline =
+            std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (!done.load()) {
+          CHECK(std::chrono::steady_clock::now() < deadline);
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  for (auto& poster : posters) {
+    poster.join();
+  }
+}
+
+// Without a scheduler callbacks run on the reactor thread, a throwing one
+// is still re-armed
+void test_inline_rearm_after_throw() {
+  auto reactor = IoReactor::Create(nullptr);
+  CHECK(reactor);
+  const auto pair = make_socketpair();
+  std::atomic<int> calls{0};
+  CHECK(reactor->add(pair[1], IoEvents::Read, [&](int fd, IoEvents) {
+    char buf[8];
+    while (::read(fd, buf, sizeof(buf)) > 0) {
+    }
+    if (calls.fetch_add(1) == 0) {
+      throw std::runtime_error("first callback fails");
+    }
+  }));
+  CHECK(::write(pair[0], "a", 1) == 1);
+  wait_for([&] { return calls.load() == 1; });
+  CHECK(::write(pair[0], "b", 1) == 1);
+  wait_for([&] { return calls.load() == 2; });
+  reactor.reset();
+  ::close(pair[0]);
+  ::close(pair[1]);
+}
+
+}  // namespace
+
+int main() {
+  TaskScheduler<void> pool(4, 4096);
+  test_echo(pool);
+  test_modify_never_overlaps(pool);
+  test_hangup_and_remove(pool);
+  test_pipe_write(pool);
+  test_post(pool);
+  test_post_ping_pong();
+  test_inline_rearm_after_throw();
+  pool.stop();
+  return 0;
+}
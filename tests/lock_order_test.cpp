@@ -0,0 +1,84 @@
+#include "cpputils/lock_order.h"
+
+#include <string>
+#include <thread>
+
+#include "cpputils/instrumented_mutex.h"
+#include "check.h"
+
+using namespace cpputils;
+
+namespace {
+
+bool contains(const std::string& text, const std::string& part) {
+  return text.find(part) != std::string::npos;
+}
+
+// Nesting in one order from several threads, and locks taken one after the
+// other, never look like a cycle
+void test_consistent_order() {
+  instrumented_mutex outer("order.outer");
+  instrumented_mutex inner("order.inner");
+  for (int t = 0; t < 2; ++t) {
+    std::thread([&] {
+      std::lock_guard<instrumented_mutex> first(outer);
+      std::lock_guard<instrumented_mutex> second(inner);
+    }).join();
+  }
+  // A released lock is not held anymore, taking outer after it is no
+  // inner -> outer edge
+  inner.lock();
+  inner.unlock();
+  outer.lock();
+  outer.unlock();
+  // Unlock order does not have to match lock order
+  outer.lock();
+  inner.lock();
+  outer.unlock();
+  inner.unlock();
+  CHECK(lockdep::first_report().empty());
+}
+
+// a -> b and b -> c in different threads, then c -> a closes the cycle.
+// The check runs before blocking, the threads never overlap here.
+void test_inversion_reported() {
+  instrumented_mutex a("order.a");
+  instrumented_mutex b("order.b");
+  instrumented_mutex c("order.c");
+  std::thread([&] {
+    std::lock_guard<instrumented_mutex> first(a);
+    std::lock_guard<instrumented_mutex> second(b);
+  }).join();
+  std::thread([&] {
+    std::lock_guard<instrumented_mutex> first(b);
+    std::lock_guard<instrumented_mutex> second(c);
+  }).join();
+  CHECK(lockdep::first_report().empty());
+
+  {
+    std::lock_guard<instrumented_mutex> first(c);
+    std::lock_guard<instrumented_mutex> second(a);
+  }
+  const std::string report = lockdep::first_report();
+  CHECK(contains(report, "lock order inversion between \"order.c\" and "
+                         "\"order.a\""));
+  CHECK(contains(report, "holding \"order.a\" then acquiring \"order.b\""));
+  CHECK(contains(report, "holding \"order.b\" then acquiring \"order.c\""));
+
+  // Only the first cycle is kept
+  {
+    std::lock_guard<instrumented_mutex> first(b);
+    std::lock_guard<instrumented_mutex> second(a);
+  }
+  CHECK(lockdep::first_report() == report);
+}
+
+}  // namespace
+
+int main() {
+  lockdep::enable();
+  CHECK(lockdep::enabled());
+  test_consistent_order();
+  test_inversion_reported();
+  return 0;
+}
@@ -0,0 +1,126 @@
+#include "cpputils/lock_profiler.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "cpputils/instrumented_mutex.h"
+#include "check.h"
+
+using namespace cpputils;
+
+namespace {
+
+lock_profiler::lock_snapshot snapshot_of(const std::string& name) {
+  for (auto& lock : lock_profiler::snapshot()) {
+    if (lock.name == name) {
+      return lock;
+    }
+  }
+  CHECK(false);
+  return lock_profiler::lock_snapshot(lock_profiler::register_lock(name));
+}
+
+uint64_t site_waits(const lock_profiler::lock_snapshot& lock) {
+  uint64_t waits = lock.other_site_waits;
+  for (const auto& site : lock.top_sites) {
+    waits += site.waits;
+  }
+  return waits;
+}
+
+// One thread waits rounds times for the lock held by the caller
+void contend(instrumented_mutex& mtx, int rounds) {
+  std::atomic<int> held{-1};
+  std::atomic<int> done{-1};
+  std::thread waiter([&] {
+    for (int round = 0; round < rounds; ++round) {
+      while (held.load() != round) {
+        std::this_thread::yield();
+      }
+      mtx.lock();
+      mtx.unlock();
+      done.store(round);
+    }
+  });
+  for (int round = 0; round < rounds; ++round) {
+    mtx.lock();
+    held.store(round);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    mtx.unlock();
+    while (done.load() != round) {
+      std::this_thread::yield();
+    }
+  }
+  waiter.join();
+}
+
+// Every wait is counted, 1 in the stack period per thread is attributed to
+// a call site with the period as its weight, none with period 0
+void test_stack_sampling() {
+  instrumented_mutex::set_stack_sample_period(4);
+  instrumented_mutex sampled("profiler_test_sampled");
+  contend(sampled, 8);
+  auto lock = snapshot_of("profiler_test_sampled");
+  CHECK(lock.contentions == 8);
+  CHECK(!lock.top_sites.empty());
+  CHECK(site_waits(lock) == 8);
+
+  instrumented_mutex::set_stack_sample_period(0);
+  instrumented_mutex unsampled("profiler_test_unsampled");
+  contend(unsampled, 3);
+  lock = snapshot_of("profiler_test_unsampled");
+  CHECK(lock.contentions == 3);
+  CHECK(site_waits(lock) == 0);
+  instrumented_mutex::set_stack_sample_period(MUTEX_STACK_SAMPLE_PERIOD);
+}
+
+// Call sites claimed concurrently are only seen with their frames, and no
+// attributed wait is lost
+void test_concurrent_sites() {
+  auto& stats = lock_profiler::register_lock("profiler_test_sites");
+  constexpr int threads = 4;
+  constexpr int waits = 20000;
+  std::atomic<bool> stop{false};
+  std::thread reader([&] {
+    while (!stop.load()) {
+      lock_profiler::lock_snapshot lock(stats);
+      for (const auto& site : lock.top_sites) {
+        // Each stack is all frames equal to its 1-based index
+        CHECK(site.stack[0] != 0);
+        for (auto frame : site.stack) {
+          CHECK(frame == site.stack[0]);
+        }
+      }
+    }
+  });
+  std::vector<std::thread> writers;
+  for (int t = 0; t < threads; ++t) {
+    writers.emplace_back([&stats, t] {
+      for (int i = 0; i < waits; ++i) {
+        lock_profiler::call_stack stack;
+        stack.fill(static_cast<uintptr_t>(1 + (i * threads + t) % 24));
+        stats.record_wait(100, &stack, 2);
+      }
+    });
+  }
+  for (auto& writer : writers) {
+    writer.join();
+  }
+  stop.store(true);
+  reader.join();
+
+  lock_profiler::lock_snapshot lock(stats);
+  CHECK(lock.contentions == threads * waits);
+  CHECK(lock.top_sites.size() == lock_profiler::max_call_sites);
+  CHECK(site_waits(lock) == 2 * threads * waits);
+}
+
+}  // namespace
+
+int main() {
+  test_stack_sampling();
+  test_concurrent_sites();
+  return 0;
+}
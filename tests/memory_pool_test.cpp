@@ -0,0 +1,184 @@
+#include "cpputils/memory_pool.h"
+
+#include <cstring>
+#include <list>
+#include <memory_resource>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "cpputils/safe_queue.h"
+#include "check.h"
+
+using namespace cpputils;
+using namespace cpputils::memory;
+
+namespace {
+
+// Blocks of a fresh size class all come from one 64KiB chunk. A thread
+// that only frees them hands them back when it exits, so the next
+// allocations get exactly the same blocks and no second chunk.
+void test_free_only_thread_returns_blocks() {
+  constexpr size_t size = 64;  // Class unused by the other tests
+  constexpr size_t count = 64 * 1024 / size;
+  std::vector<void*> blocks;
+  for (size_t i = 0; i < count; ++i) {
+    blocks.push_back(ThreadCachingPool::allocate(size));
+  }
+  const std::set<void*> first(blocks.begin(), blocks.end());
+  CHECK(first.size() == count);
+  ThreadCachingPool::flush_thread_cache();
+
+  std::thread([&] {
+    for (void* block : blocks) {
+      ThreadCachingPool::deallocate(block, size);
+    }
+  }).join();
+
+  std::set<void*> second;
+  for (size_t i = 0; i < count; ++i) {
+    second.insert(ThreadCachingPool::allocate(size));
+  }
+  CHECK(second == first);
+  for (void* block : second) {
+    ThreadCachingPool::deallocate(block, size);
+  }
+}
+
+// Blocks freed on other threads join their caches, which stay bounded
+void test_cross_thread_churn() {
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([t] {
+      std::vector<std::pair<void*, size_t>> live;
+      for (int i = 0; i < 50000; ++i) {
+        const size_t size = 1 + static_cast<size_t>(i * 7919 + t) % 1024;
+        void* p = ThreadCachingPool::allocate(size);
+        std::memset(p, t, size);
+        live.emplace_back(p, size);
+        if (live.size() == 500) {
+          for (auto [block, bytes] : live) {
+            ThreadCachingPool::deallocate(block, bytes);
+          }
+          live.clear();
+        }
+        for (size_t c = 0; c < detail::size_class_count; ++c) {
+          CHECK(detail::caches[c].count <= 2 * detail::batch_size(c));
+        }
+      }
+      for (auto [block, bytes] : live) {
+        ThreadCachingPool::deallocate(block, bytes);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+void test_unpooled_sizes() {
+  void* large = ThreadCachingPool::allocate(4096);
+  std::memset(large, 1, 4096);
+  ThreadCachingPool::deallocate(large, 4096);
+  void* aligned = ThreadCachingPool::allocate(64, 64);
+  CHECK(reinterpret_cast<uintptr_t>(aligned) % 64 == 0);
+  ThreadCachingPool::deallocate(aligned, 64, 64);
+}
+
+struct Throws {
+  explicit Throws(bool fail) {
+    if (fail) {
+      throw std::runtime_error("constructor failed");
+    }
+  }
+};
+
+void test_object_pool() {
+  auto object = ObjectPool<std::string>::make("pooled");
+  CHECK(*object == "pooled");
+  bool thrown = false;
+  try {
+    ObjectPool<Throws>::create(true);
+  } catch (const std::runtime_error&) {
+    thrown = true;
+  }
+  CHECK(thrown);
+  ObjectPool<Throws>::destroy(ObjectPool<Throws>::create(false));
+}
+
+void test_pool_allocator() {
+  std::list<int, PoolAllocator<int>> list;
+  for (int i = 0; i < 1000; ++i) {
+    list.push_back(i);
+  }
+  long sum = 0;
+  for (int value : list) {
+    sum += value;
+  }
+  CHECK(sum == 999 * 1000 / 2);
+
+  SafeQueue<int, PoolAllocator<int>> queue(100);
+  for (int i = 0; i < 100; ++i) {
+    CHECK(queue.push(i));
+  }
+  queue.close();
+  int expected = 0;
+  while (auto item = queue.popsafe()) {
+    CHECK(*item == expected++);
+  }
+  CHECK(expected == 100);
+}
+
+void test_arena() {
+  MonotonicArena arena(256);
+  CHECK(arena.allocate(10, 1) != nullptr);
+  auto* aligned = arena.allocate(8, 64);
+  CHECK(reinterpret_cast<uintptr_t>(aligned) % 64 == 0);
+  void* big = arena.allocate(100000);  // Gets a chunk of its own
+  std::memset(big, 0, 100000);
+  CHECK(arena.bytes_allocated() == 10 + 8 + 100000);
+  arena.reset();
+  CHECK(arena.bytes_allocated() == 0);
+  arena.release();
+
+  alignas(16) char buffer[512];
+  MonotonicArena in_buffer(buffer, sizeof(buffer));
+  void* p = in_buffer.allocate(100);
+  CHECK(p >= buffer && p < buffer + sizeof(buffer));
+  in_buffer.reset();
+  CHECK(in_buffer.allocate(100) == p);
+  in_buffer.allocate(1000);  // Spills over to the heap
+  in_buffer.release();
+  CHECK(in_buffer.allocate(100) == p);
+}
+
+void test_resources() {
+  ArenaResource arena;
+  std::pmr::vector<int> numbers(&arena);
+  for (int i = 0; i < 1000; ++i) {
+    numbers.push_back(i);
+  }
+  CHECK(numbers[999] == 999);
+  CHECK(arena.get().bytes_allocated() > 1000 * sizeof(int));
+
+  PoolResource pool;
+  CHECK(pool.is_equal(*pool_resource()));
+  CHECK(!arena.is_equal(*pool_resource()));
+  std::pmr::list<std::pmr::string> names(pool_resource());
+  names.emplace_back("a string long enough to leave the SSO buffer");
+  CHECK(names.front().size() > 40);
+}
+
+}  // namespace
+
+int main() {
+  test_free_only_thread_returns_blocks();
+  test_cross_thread_churn();
+  test_unpooled_sizes();
+  test_object_pool();
+  test_pool_allocator();
+  test_arena();
+  test_resources();
+  return 0;
+}
@@ -0,0 +1,184 @@
+#include "cpputils/reclamation.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+
+using namespace cpputils::reclaim;
+
+namespace {
+
+std::atomic<long> live{0};
+
+struct Node {
+  explicit Node(long Value) : value(Value) { live.fetch_add(1); }
+  ~Node() {
+    value = -1;  // Readers of a freed node see it, ASan reports it
+    live.fetch_sub(1);
+  }
+
+  long value;
+  std::atomic<Node*> next{nullptr};
+};
+
+// Treiber stack, the textbook ABA and use-after-free case
+class Stack {
+ public:
+  void push(long value) {
+    Node* node = new Node(value);
+    Node* head = top.load();
+    do {
+      node->next.store(head);
+    } while (!top.compare_exchange_weak(head, node));
+  }
+
+  bool pop_epoch(long& out) {
+    EpochGuard guard;
+    Node* head = top.load(std::memory_order_acquire);
+    while (head != nullptr &&
+           !top.compare_exchange_weak(head, head->next.load())) {
+    }
+    if (head == nullptr) {
+      return false;
+    }
+    out = head->value;
+    CHECK(out >= 0);
+    epoch_retire(head);
+    return true;
+  }
+
+  bool pop_hazard(long& out) {
+    HazardPointer hp;
+    while (true) {
+      Node* head = hp.protect(top);
+      if (head == nullptr) {
+        return false;
+      }
+      CHECK(head->value >= 0);
+      Node* next = head->next.load();
+      if (top.compare_exchange_strong(head, next)) {
+        out = head->value;
+        hp.reset();
+        hazard_retire(head);
+        return true;
+      }
+    }
+  }
+
+ private:
+  std::atomic<Node*> top{nullptr};
+};
+
+// Threads pushing and popping one stack, every value comes out once and
+// every node is freed
+void test_stack(bool epoch) {
+  constexpr int threads = 4;
+  constexpr long per_thread = 20000;
+  Stack stack;
+  std::atomic<long> sum{0};
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&] {
+      long local = 0;
+      for (long i = 0; i < per_thread; ++i) {
+        stack.push(i);
+        long value;
+        if (epoch ? stack.pop_epoch(value) : stack.pop_hazard(value)) {
+          local += value;
+        }
+      }
+      sum.fetch_add(local);
+    });
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  long value;
+  while (epoch ? stack.pop_epoch(value) : stack.pop_hazard(value)) {
+    sum.fetch_add(value);
+  }
+  if (epoch) {
+    epoch_synchronize();
+  } else {
+    hazard_reclaim();
+  }
+  CHECK(sum.load() == threads * (per_thread - 1) * per_thread / 2);
+  CHECK(live.load() == 0);
+}
+
+void test_nested_guards() {
+  EpochGuard outer;
+  {
+    EpochGuard inner;
+  }
+  EpochGuard again;
+}
+
+// A pinned reader holds back epoch garbage until it unpins
+void test_stalled_reader() {
+  std::atomic<bool> pinned{false};
+  std::atomic<bool> release{false};
+  std::thread reader([&] {
+    EpochGuard guard;
+    pinned = true;
+    while (!release.load()) {
+      std::this_thread::yield();
+    }
+  });
+  while (!pinned.load()) {
+    std::this_thread::yield();
+  }
+  for (long i = 0; i < 1000; ++i) {
+    epoch_retire(new Node(i));
+  }
+  CHECK(live.load() == 1000);
+  release = true;
+  reader.join();
+  epoch_synchronize();
+  CHECK(live.load() == 0);
+}
+
+// Hazard garbage stays bounded without ever reclaiming by hand, and a
+// protected node survives scans
+void test_hazard_bounded() {
+  std::atomic<Node*> shared{new Node(42)};
+  HazardPointer hp;
+  Node* held = hp.protect(shared);
+  shared.store(nullptr);
+  hazard_retire(held);
+  for (long i = 0; i < 100000; ++i) {
+    hazard_retire(new Node(i));
+  }
+  CHECK(live.load() < 1000);
+  CHECK(held->value == 42);
+  hp.reset();
+  hazard_reclaim();
+  CHECK(live.load() == 0);
+}
+
+// Garbage of exited threads is adopted by the next collection
+void test_orphans() {
+  std::thread([] {
+    for (long i = 0; i < 10; ++i) {
+      epoch_retire(new Node(i));
+      hazard_retire(new Node(i));
+    }
+  }).join();
+  epoch_synchronize();
+  hazard_reclaim();
+  CHECK(live.load() == 0);
+}
+
+}  // namespace
+
+int main() {
+  test_stack(true);
+  test_stack(false);
+  test_nested_guards();
+  test_stalled_reader();
+  test_hazard_bounded();
+  test_orphans();
+  return 0;
+}
@@ -0,0 +1,241 @@
+#include "cpputils/result.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+
+#include "check.h"
+
+namespace {
+
+struct Base {
+  virtual ~Base() = default;
+  int tag = 1;
+};
+struct Other {
+  virtual ~Other() = default;
+  int other = 2;
+};
+// Base is not at offset 0, catches adjust the pointer
+struct Derived : Other, Base {};
+
+// Counts how often payloads are copied and moved
+struct Tracked {
+  static inline int copies = 0;
+  static inline int moves = 0;
+
+  Tracked(int v, int w) : value(v + w) {}
+  Tracked(const Tracked& other) : value(other.value) { ++copies; }
+  Tracked(Tracked&& other) noexcept : value(other.value) { ++moves; }
+  Tracked& operator=(const Tracked&) = delete;
+  Tracked& operator=(Tracked&&) = delete;
+
+  int value;
+};
+
+struct alignas(8) Node {
+  int id;
+};
+enum class Errc : int { missing = -3, busy = 5 };
+
+}  // namespace
+
+// Results of Node* and Errc are a single tagged pointer
+template <>
+struct result_niche<Node*, Errc> : result_pointer_niche<Node*, Errc> {};
+
+namespace {
+
+template <typename Exc>
+ExceptionError thrown(Exc exc) {
+  return ExceptionError(std::make_exception_ptr(exc));
+}
+
+// Classification matches what catch would do, including the base class
+// adjustment, without rethrowing
+void test_classification() {
+  auto error = thrown(std::system_error(
+      std::make_error_code(std::errc::timed_out), "waiting"));
+  CHECK(error.is<std::system_error>());
+  CHECK(error.is<std::runtime_error>());
+  CHECK(error.is<const std::exception>());
+  CHECK(!error.is<std::logic_error>());
+  CHECK(error.get<std::runtime_error>() != nullptr);
+  CHECK(error.get<std::logic_error>() == nullptr);
+  CHECK(std::strstr(error.what(), "waiting") != nullptr);
+
+  auto derived = thrown(Derived{});
+  const Base* base = derived.get<Base>();
+  CHECK(base != nullptr && base->tag == 1);
+  CHECK(derived.get<Derived>() != nullptr);
+  CHECK(static_cast<const Base*>(derived.get<Derived>()) == base);
+  CHECK(std::strcmp(derived.what(), "unknown exception") == 0);
+
+  auto integer = thrown(42);
+  CHECK(integer.is<int>());
+  CHECK(!integer.is<long>());
+  CHECK(!integer.is<int*>());
+  CHECK(!integer.is<std::exception>());
+
+  ExceptionError empty(nullptr);
+  CHECK(!empty.is<std::exception>());
+  CHECK(std::strcmp(empty.what(), "no exception") == 0);
+}
+
+// Thrown pointers are matched by the pointer value, other thrown types are
+// never read as pointers
+void test_pointer_catches() {
+  static Derived object;
+  const auto ept = std::make_exception_ptr(&object);
+  void* caught = nullptr;
+  CHECK(result_detail::catches<Base*>(ept, result_detail::inspect(ept),
+                                      caught));
+  CHECK(static_cast<Base*>(caught) == static_cast<Base*>(&object));
+  CHECK(result_detail::catches<const Derived*>(ept));
+  CHECK(!result_detail::catches<Derived>(ept));
+
+  const auto null = std::make_exception_ptr(nullptr);
+  CHECK(result_detail::catches<int*>(null));
+  CHECK(!result_detail::catches<long>(null));
+
+  const auto number = std::make_exception_ptr(7L);
+  CHECK(!result_detail::catches<long*>(number));
+}
+
+// The exception_ptr is read-only, assigning a whole ExceptionError
+// classifies the new exception
+void test_reassignment() {
+  static_assert(!std::is_assignable_v<decltype((thrown(1).err())),
+                                      std::exception_ptr>);
+  auto error = thrown(std::runtime_error("first"));
+  error = thrown(std::logic_error("second"));
+  CHECK(error.is<std::logic_error>());
+  CHECK(!error.is<std::runtime_error>());
+  CHECK(std::strcmp(error.what(), "second") == 0);
+  CHECK(error.type() == &typeid(std::logic_error));
+
+  Result<int> result = Err(thrown(std::out_of_range("range")));
+  CHECK(result.contains_exception<std::logic_error>());
+  result.unwrap_err() = thrown(std::runtime_error("replaced"));
+  CHECK(!result.contains_exception<std::logic_error>());
+  CHECK(result.contains_exception<std::runtime_error>());
+  bool rethrown = false;
+  try {
+    result.unwrap_err().rethrow();
+  } catch (const std::runtime_error& e) {
+    rethrown = std::strcmp(e.what(), "replaced") == 0;
+  }
+  CHECK(rethrown);
+}
+
+template <typename R>
+bool unwrap_throws(const R& result) {
+  try {
+    result.unwrap();
+  } catch (const std::runtime_error&) {
+    return true;
+  }
+  return false;
+}
+
+// Payloads move through chains of && combinators, built in place, and are
+// never copied
+void test_combinators() {
+  using R = Result<Tracked, std::string>;
+  using Sized = Result<Tracked, size_t>;
+  Tracked::copies = 0;
+  Tracked::moves = 0;
+  const auto chain = [](R start) {
+    return std::move(start)
+        .map([](Tracked&& t) { return Tracked(t.value, 10); })
+        .and_then([](Tracked&& t) { return R(in_place_ok, t.value, 100); })
+        .map_err([](std::string&& error) { return error.size(); })
+        .or_else([](size_t size) { return Sized(in_place_ok, 1000, size); });
+  };
+  CHECK(chain(R(in_place_ok, 1, 2)).unwrap().value == 113);
+  CHECK(chain(R(in_place_err, "four")).unwrap().value == 1004);
+  CHECK(Tracked::copies == 0);
+
+  const R kept(in_place_ok, 3, 4);
+  const auto doubled = kept.map([](const Tracked& t) { return 2 * t.value; });
+  CHECK(doubled.unwrap() == 14 && kept.unwrap().value == 7);
+  CHECK(Tracked::copies == 0);
+  CHECK(R(in_place_err, "x").value_or(Tracked(5, 0)).value == 5);
+  CHECK(R(in_place_ok, 6, 0).value_or(Tracked(5, 0)).value == 6);
+  CHECK(Tracked::copies == 0);
+
+  int calls = 0;
+  const R failed(in_place_err, "failed");
+  CHECK(failed.map([&](const Tracked&) { return ++calls; }).unwrap_err() ==
+        "failed");
+  CHECK(calls == 0);
+  CHECK(unwrap_throws(failed));
+}
+
+void test_void_and_reference() {
+  Result<void, std::string> done;
+  CHECK(done.is_ok() && !unwrap_throws(done));
+  CHECK(done.map([] { return 7; }).unwrap() == 7);
+  CHECK(done.and_then([] { return Result<int, std::string>(8); }).unwrap() ==
+        8);
+
+  Result<void, std::string> failed = Err(std::string("no"));
+  Result<void, std::string> direct = std::string("direct");
+  CHECK(failed.is_err() && direct.unwrap_err() == "direct");
+  CHECK(unwrap_throws(failed));
+  CHECK(failed.map([] { return 7; }).unwrap_err() == "no");
+  CHECK(failed.or_else([](const std::string&) {
+                return Result<void, int>();
+              }).is_ok());
+  CHECK(*failed.take_error() == "no");
+
+  int x = 1;
+  Result<int&, std::string> ref(x);
+  ref.unwrap() = 2;
+  CHECK(x == 2);
+  CHECK(ref.map([](int& v) { return v + 1; }).unwrap() == 3);
+  auto same = ref.map([](int& v) -> int& { return v; });
+  static_assert(std::is_same_v<decltype(same), Result<int&, std::string>>);
+  CHECK(&same.unwrap() == &x);
+  Result<int&, std::string> missing(std::string("gone"));
+  CHECK(missing.has_error() && missing.unwrap_err() == "gone");
+  CHECK(unwrap_throws(missing));
+  CHECK(missing.value_or(x) == 2);
+}
+
+// A niche Result is the size of the pointer and keeps negative errors
+void test_niche() {
+  static_assert(sizeof(Result<Node*, Errc>) == sizeof(Node*));
+  Node node{4};
+  Result<Node*, Errc> found = &node;
+  Result<Node*, Errc> missing = Errc::missing;
+  Result<Node*, Errc> busy(in_place_err, Errc::busy);
+  Result<Node*, Errc> null = static_cast<Node*>(nullptr);
+  CHECK(found.is_ok() && found.value() == &node);
+  CHECK(missing.is_err() && missing.error() == Errc::missing);
+  CHECK(busy.unwrap_err() == Errc::busy);
+  CHECK(null.is_ok() && null.unwrap() == nullptr);
+  CHECK(unwrap_throws(missing));
+
+  CHECK(found.map([](Node* n) { return n->id; }).unwrap() == 4);
+  CHECK(missing.map([](Node* n) { return n->id; }).unwrap_err() ==
+        Errc::missing);
+  const auto recovered = missing.or_else(
+      [&](Errc) { return Result<Node*, Errc>(&node); });
+  CHECK(recovered.unwrap() == &node);
+  CHECK(missing.value_or(&node) == &node);
+}
+
+}  // namespace
+
+int main() {
+  test_classification();
+  test_pointer_catches();
+  test_reassignment();
+  test_combinators();
+  test_void_and_reference();
+  test_niche();
+  return 0;
+}
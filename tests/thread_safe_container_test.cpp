@@ -0,0 +1,126 @@
+#include "cpputils/thread_safe_container.h"
+
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+
+using namespace cpputils;
+using namespace std::chrono_literals;
+
+namespace {
+
+template <typename Container, typename Call>
+void check_throws(Container& container, Call call) {
+  bool thrown = false;
+  try {
+    call(container);
+  } catch (const std::runtime_error&) {
+    thrown = true;
+  }
+  CHECK(thrown);
+}
+
+// Nothing holds the lock, the exclusive attempts all succeed right away
+template <typename Container>
+void check_unlocked(Container& container) {
+  CHECK(container.try_write([](int& value) { ++value; }));
+  CHECK(container.write_for(0ms, [](int& value) { --value; }));
+  CHECK(container.upgradable_read([](const int&, auto& upgrade) {
+    return upgrade([](int& value) { return value; });
+  }) == 0);
+}
+
+// A callback that throws releases the lock it ran under, whichever way
+// it was acquired
+void test_throwing_callbacks() {
+  ThreadSafeContainer<int, FairRWLock> container(0);
+  const auto fail = [](const int&) -> int {
+    throw std::runtime_error("read");
+  };
+  const auto fail_write = [](int&) { throw std::runtime_error("write"); };
+
+  check_throws(container, [&](auto& c) { c.read(fail); });
+  check_throws(container, [&](auto& c) { c.write(fail_write); });
+  check_throws(container, [&](auto& c) { c.try_read(fail); });
+  check_throws(container, [&](auto& c) { c.try_write(fail_write); });
+  check_throws(container, [&](auto& c) { c.read_for(1s, fail); });
+  check_throws(container, [&](auto& c) { c.write_for(1s, fail_write); });
+  // Before and after switching to the write lock
+  check_throws(container, [&](auto& c) {
+    c.upgradable_read([](const int&, auto&) -> void {
+      throw std::runtime_error("upgradable");
+    });
+  });
+  check_throws(container, [&](auto& c) {
+    c.upgradable_read(
+        [&](const int&, auto& upgrade) { upgrade(fail_write); });
+  });
+  check_unlocked(container);
+}
+
+// Checks made before upgrading still hold in the mutator, so concurrent
+// check-then-increment never overshoots
+void test_upgradable_read() {
+  ThreadSafeContainer<int, FairRWLock> counter(0);
+  constexpr int limit = 1000;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&counter] {
+      for (int i = 0; i < limit; ++i) {
+        counter.upgradable_read([](const int& value, auto& upgrade) {
+          if (value < limit) {
+            upgrade([](int& v) { ++v; });
+            upgrade([](int& v) { CHECK(v <= limit); });
+          }
+        });
+        CHECK(counter.read([](const int& value) { return value; }) <= limit);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  CHECK(counter.read([](const int& value) { return value; }) == limit);
+}
+
+// The timed and try variants give up while a writer holds the lock
+void test_timeouts() {
+  ThreadSafeContainer<int, FairRWLock> container(1);
+  std::thread writer([&] {
+    container.write([](int&) { std::this_thread::sleep_for(200ms); });
+  });
+  std::this_thread::sleep_for(50ms);
+  CHECK(!container.try_read([](const int& value) { return value; }));
+  CHECK(!container.read_for(10ms, [](const int& value) { return value; }));
+  CHECK(!container.write_for(10ms, [](int&) {}));
+  writer.join();
+  CHECK(container.try_read([](const int& value) { return value; }) == 1);
+}
+
+template <typename Lock>
+void test_plain_lock() {
+  ThreadSafeContainer<int, Lock> container(1);
+  CHECK(container.read([](const int& value) { return value; }) == 1);
+  container.write([](int& value) { value = 2; });
+  CHECK(container.try_read([](const int& value) { return value; }) == 2);
+  CHECK(container.try_write([](int& value) { value = 3; }));
+  check_throws(container, [](auto& c) {
+    c.write([](int&) { throw std::runtime_error("write"); });
+  });
+  CHECK(container.try_write([](int& value) { return value; }) == 3);
+}
+
+}  // namespace
+
+int main() {
+  test_throwing_callbacks();
+  test_upgradable_read();
+  test_timeouts();
+  test_plain_lock<std::shared_mutex>();
+  test_plain_lock<std::mutex>();
+  test_plain_lock<DistributedRWLock>();
+  return 0;
+}
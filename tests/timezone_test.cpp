@@ -0,0 +1,189 @@
+#include "cpputils/timezone.h"
+
+#include <time.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <string>
+
+#include "check.h"
+
+using namespace cpputils;
+using namespace cpputils::datetime;
+
+namespace {
+
+// Unix seconds of a UTC date and time
+int64_t utc(int64_t year, unsigned month, unsigned day, int hour = 0,
+            int minute = 0, int second = 0) {
+  return detail::days_from_civil(year, month, day) * 86400 + hour * 3600 +
+         minute * 60 + second;
+}
+
+std::string format_local(int64_t unix_seconds, const TimeZone& zone) {
+  char buf[rfc3339_local_max_length];
+  const auto tp =
+      std::chrono::system_clock::time_point(std::chrono::seconds(unix_seconds));
+  return std::string(buf,
+                     format_rfc3339_local(buf, tp, precision::seconds, zone));
+}
+
+void put_big_endian(std::string& out, uint64_t value, int bytes) {
+  for (int i = bytes - 1; i >= 0; --i) {
+    out += static_cast<char>(value >> (8 * i));
+  }
+}
+
+// "TZif", version, 15 reserved bytes, then isutcnt, isstdcnt, leapcnt,
+// timecnt, typecnt and charcnt
+std::string tzif_header(uint32_t timecnt, uint32_t typecnt,
+                        uint32_t charcnt) {
+  std::string out = "TZif2";
+  out.append(15, '\0');
+  for (uint32_t count : {0u, 0u, 0u, timecnt, typecnt, charcnt}) {
+    put_big_endian(out, count, 4);
+  }
+  return out;
+}
+
+// Local mean time +00:53:28 until 1892, then CET with the current EU rule
+// from the footer. The 32-bit block holds only the first type.
+std::string tzif_file() {
+  std::string out = tzif_header(0, 1, 4);
+  put_big_endian(out, 3208, 4);
+  out += std::string("\0\0LMT\0", 6);
+
+  out += tzif_header(1, 2, 8);
+  put_big_endian(out, static_cast<uint64_t>(utc(1892, 5, 1)), 8);
+  out += '\1';
+  put_big_endian(out, 3208, 4);
+  out += std::string("\0\0", 2);
+  put_big_endian(out, 3600, 4);
+  out += std::string("\0\4", 2);
+  out += std::string("LMT\0CET\0", 8);
+  out += "\nCET-1CEST,M3.5.0,M10.5.0/3\n";
+  return out;
+}
+
+// The EU rule: last Sunday of March 01:00 UTC to last Sunday of October
+void check_central_europe(const TimeZone& zone) {
+  CHECK(zone.offset_at(utc(2025, 1, 15)) == 3600);
+  CHECK(zone.lookup(utc(2025, 1, 15)).abbreviation == "CET");
+  CHECK(!zone.lookup(utc(2025, 1, 15)).dst);
+  CHECK(zone.offset_at(utc(2025, 3, 30, 0, 59, 59)) == 3600);
+  CHECK(zone.offset_at(utc(2025, 3, 30, 1)) == 7200);
+  CHECK(zone.lookup(utc(2025, 7, 1)).abbreviation == "CEST");
+  CHECK(zone.lookup(utc(2025, 7, 1)).dst);
+  CHECK(zone.offset_at(utc(2025, 10, 26, 0, 59, 59)) == 7200);
+  CHECK(zone.offset_at(utc(2025, 10, 26, 1)) == 3600);
+  // Far past any table, from the rule
+  CHECK(zone.offset_at(utc(2200, 3, 30, 1)) == 7200);
+  CHECK(zone.offset_at(utc(2200, 3, 30, 0, 59, 59)) == 3600);
+}
+
+void test_posix_rules() {
+  const auto cet = TimeZone::Load("CET-1CEST,M3.5.0,M10.5.0/3");
+  CHECK(cet != nullptr);
+  check_central_europe(*cet);
+  CHECK(format_local(utc(2025, 5, 18, 18, 53, 46), *cet) ==
+        "2025-05-18T20:53:46+02:00");
+
+  // Southern hemisphere, daylight time across the new year
+  const auto sydney = TimeZone::Load("AEST-10AEDT,M10.1.0,M4.1.0/3");
+  CHECK(sydney != nullptr);
+  CHECK(sydney->offset_at(utc(2025, 1, 1)) == 11 * 3600);
+  CHECK(sydney->offset_at(utc(2025, 7, 1)) == 10 * 3600);
+
+  const auto newfoundland = TimeZone::Load("NST3:30NDT,M3.2.0,M11.1.0");
+  CHECK(newfoundland != nullptr);
+  CHECK(format_local(utc(2025, 1, 1), *newfoundland) ==
+        "2024-12-31T20:30:00-03:30");
+
+  const auto fixed = TimeZone::Load("<+0545>-5:45");
+  CHECK(fixed != nullptr && fixed->offset_at(0) == 5 * 3600 + 45 * 60);
+
+  CHECK(format_local(0, *TimeZone::Utc()) == "1970-01-01T00:00:00+00:00");
+  CHECK(TimeZone::Load("not a zone") == nullptr);
+  CHECK(TimeZone::Load("CET-1CEST,M3.5.0") == nullptr);
+}
+
+void test_tzif() {
+  const std::string file = tzif_file();
+  const auto zone = TimeZone::FromTzif(file, "Test/Zone");
+  CHECK(zone != nullptr && zone->name() == "Test/Zone");
+  CHECK(zone->lookup(utc(1850, 1, 1)).abbreviation == "LMT");
+  CHECK(zone->offset_at(utc(1892, 4, 30, 23, 59, 59)) == 3208);
+  CHECK(zone->offset_at(utc(1892, 5, 1)) == 3600);
+  check_central_europe(*zone);
+  // +00:53:28 is written rounded to the minute, with a matching time
+  CHECK(format_local(utc(1850, 1, 1), *zone) == "1850-01-01T00:53:00+00:53");
+
+  // Up to the footer, which is optional
+  const size_t footer = file.find('\n');
+  for (size_t size = 0; size < footer; ++size) {
+    CHECK(TimeZone::FromTzif(file.substr(0, size), "truncated") == nullptr);
+  }
+  CHECK(TimeZone::FromTzif(file.substr(0, footer), "no footer")
+            ->offset_at(utc(2025, 7, 1)) == 3600);
+  // Header, 32-bit block, header, then the transition's 8 bytes and type
+  std::string bad_type = file;
+  CHECK(bad_type[44 + 10 + 44 + 8] == '\1');
+  bad_type[44 + 10 + 44 + 8] = '\2';
+  CHECK(TimeZone::FromTzif(bad_type, "bad") == nullptr);
+}
+
+// Installed TZif files agree with glibc, where the tz database is present
+void test_system_zones() {
+  for (const char* name :
+       {"Europe/Berlin", "America/New_York", "Australia/Sydney",
+        "Asia/Kolkata", "America/St_Johns"}) {
+    const auto zone = TimeZone::Load(name);
+    if (zone == nullptr) {
+      continue;
+    }
+    CHECK(::setenv("TZ", name, 1) == 0);
+    ::tzset();
+    // Every 10 days and 7 hours from 1900 to 2100
+    for (int64_t t = utc(1900, 1, 1); t < utc(2100, 1, 1);
+         t += 10 * 86400 + 7 * 3600) {
+      const auto time = static_cast<time_t>(t);
+      struct tm parts;
+      CHECK(::localtime_r(&time, &parts) != nullptr);
+      CHECK(zone->offset_at(t) == parts.tm_gmtoff);
+      CHECK(zone->lookup(t).dst == (parts.tm_isdst > 0));
+    }
+  }
+  CHECK(::unsetenv("TZ") == 0);
+  ::tzset();
+}
+
+// Installed zones serve local_zone() and the default of the formatter
+void test_local_zone() {
+  set_local_zone(TimeZone::Load("CET-1CEST,M3.5.0,M10.5.0/3"));
+  const TimeZone& previous = local_zone();
+  CHECK(previous.offset_at(utc(2025, 7, 1)) == 7200);
+  CHECK(print_iso8601_local(std::chrono::system_clock::time_point(
+            std::chrono::seconds(utc(2025, 7, 1)))) == "2025-07-01T02:00:00");
+
+  CHECK(::setenv("TZ", "EST5EDT,M3.2.0,M11.1.0", 1) == 0);
+  CHECK(reload_local_zone());
+  CHECK(local_zone().offset_at(utc(2025, 7, 1)) == -4 * 3600);
+  // References from before a reload stay usable
+  CHECK(previous.offset_at(utc(2025, 7, 1)) == 7200);
+
+  CHECK(::setenv("TZ", "not a zone", 1) == 0);
+  CHECK(!reload_local_zone());
+  CHECK(local_zone().offset_at(utc(2025, 7, 1)) == -4 * 3600);
+  set_local_zone(nullptr);
+  CHECK(local_zone().offset_at(utc(2025, 7, 1)) == -4 * 3600);
+}
+
+}  // namespace
+
+int main() {
+  test_posix_rules();
+  test_tzif();
+  test_system_zones();
+  test_local_zone();
+  return 0;
+}
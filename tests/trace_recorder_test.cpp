@@ -0,0 +1,112 @@
+#include "cpputils/trace_recorder.h"
+
+#include <unistd.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "check.h"
+
+using namespace cpputils;
+
+namespace {
+
+std::string chrome_trace() {
+  std::ostringstream out;
+  trace::write_chrome_trace(out);
+  return out.str();
+}
+
+size_t count(const std::string& text, const std::string& part) {
+  size_t found = 0;
+  for (size_t pos = text.find(part); pos != std::string::npos;
+       pos = text.find(part, pos + 1)) {
+    ++found;
+  }
+  return found;
+}
+
+// Nothing is recorded before start()
+void test_disabled() {
+  CHECK(!trace::enabled());
+  CPPUTILS_TRACE(instant, "ignored", "test", 0);
+  CHECK(chrome_trace() == "[\n\n]\n");
+}
+
+// Spans and instants of live and exited threads are exported once, with
+// names escaped and the argument attached
+void test_export() {
+  trace::start();
+  CPPUTILS_TRACE(begin, "outer \"span\"", "test", 0);
+  CPPUTILS_TRACE(instant, "mark", "test", 42);
+  CPPUTILS_TRACE(end, "outer \"span\"", "test", 0);
+  std::thread([] { CPPUTILS_TRACE(instant, "exited", "worker", 0); }).join();
+  trace::stop();
+  CPPUTILS_TRACE(instant, "after stop", "test", 0);
+
+  const std::string json = chrome_trace();
+  CHECK(json.front() == '[' && json.substr(json.size() - 3) == "\n]\n");
+  CHECK(count(json, R"("name":"outer \"span\"","cat":"test","ph":"B")") == 1);
+  CHECK(count(json, R"("name":"outer \"span\"","cat":"test","ph":"E")") == 1);
+  CHECK(count(json, R"("name":"mark","cat":"test","ph":"i")") == 1);
+  CHECK(count(json, R"("args":{"arg":42})") == 1);
+  CHECK(count(json, R"("name":"exited","cat":"worker")") == 1);
+  CHECK(count(json, R"("name":"thread_name")") == 2);
+  CHECK(count(json, "after stop") == 0);
+
+  // Drained events are not written again
+  CHECK(count(chrome_trace(), "\"mark\"") == 0);
+}
+
+// A full buffer drops new events and counts them
+void test_dropped() {
+  const uint64_t before = trace::dropped_events();
+  trace::start();
+  std::thread([] {
+    for (size_t i = 0; i < trace::buffer_events + 10; ++i) {
+      CPPUTILS_TRACE(instant, "flood", "test", 0);
+    }
+  }).join();
+  trace::stop();
+  CHECK(trace::dropped_events() == before + 10);
+  CHECK(count(chrome_trace(), "\"flood\"") == trace::buffer_events);
+  CHECK(trace::dropped_events() == before + 10);
+}
+
+// The background flusher writes a complete document once stopped
+void test_background_flush() {
+  char path[] = "/tmp/cpputils_trace_XXXXXX";
+  const int fd = ::mkstemp(path);
+  CHECK(fd >= 0);
+  ::close(fd);
+
+  CHECK(trace::start_background_flush(path, std::chrono::milliseconds(10)));
+  CHECK(!trace::start_background_flush(path));
+  trace::start();
+  CPPUTILS_TRACE(instant, "flushed", "test", 0);
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  CPPUTILS_TRACE(instant, "flushed", "test", 0);
+  trace::stop();
+  trace::stop_background_flush();
+
+  std::ifstream file(path);
+  const std::string json((std::istreambuf_iterator<char>(file)),
+                         std::istreambuf_iterator<char>());
+  CHECK(json.substr(0, 2) == "[\n" && json.substr(json.size() - 3) == "\n]\n");
+  CHECK(count(json, "\"flushed\"") == 2);
+  ::unlink(path);
+}
+
+}  // namespace
+
+int main() {
+  test_disabled();
+  test_export();
+  test_dropped();
+  test_background_flush();
+  return 0;
+}
@@ -0,0 +1,211 @@
+#include "cpputils/uuid.h"
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdio>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+
+using namespace cpputils;
+using namespace cpputils::uuid;
+
+namespace {
+
+using Id = std::array<uint8_t, 16>;
+
+// IDs generated in a child, read back over a pipe
+std::vector<Id> generate_in_child(SecureV4& generator, size_t count) {
+  int fds[2];
+  CHECK(::pipe(fds) == 0);
+  const pid_t child = ::fork();
+  CHECK(child >= 0);
+  if (child == 0) {
+    ::close(fds[0]);
+    std::vector<Id> ids(count);
+    generator.generate_n(ids.data(), count);
+    const auto size = static_cast<ssize_t>(count * sizeof(Id));
+    std::_Exit(::write(fds[1], ids.data(), count * sizeof(Id)) == size ? 0
+                                                                        : 1);
+  }
+  ::close(fds[1]);
+  std::vector<Id> ids(count);
+  auto* out = reinterpret_cast<char*>(ids.data());
+  size_t left = count * sizeof(Id);
+  while (left > 0) {
+    const ssize_t n = ::read(fds[0], out, left);
+    CHECK(n > 0);
+    out += n;
+    left -= static_cast<size_t>(n);
+  }
+  ::close(fds[0]);
+  int status = 0;
+  CHECK(::waitpid(child, &status, 0) == child);
+  CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  return ids;
+}
+
+// A child continues with a fresh key instead of the parent's stream,
+// including the rest of the block the parent already computed
+void test_secure_v4_after_fork() {
+  SecureV4 generator;
+  generator.generate();  // Leaves most of a block buffered
+  const auto in_child = generate_in_child(generator, 64);
+  std::vector<Id> in_parent(64);
+  generator.generate_n(in_parent.data(), in_parent.size());
+
+  std::set<Id> seen(in_parent.begin(), in_parent.end());
+  for (const auto& id : in_child) {
+    CHECK(seen.insert(id).second);
+    CHECK((id[6] >> 4) == 4 && (id[8] >> 6) == 2);
+  }
+}
+
+// Explicitly keyed streams stay reproducible, also in a child
+void test_keyed_chacha20() {
+  const std::array<uint32_t, 8> key{1, 2, 3, 4, 5, 6, 7, 8};
+  SecureV4 first{rng::chacha20(key, 9)};
+  SecureV4 second{rng::chacha20(key, 9)};
+  CHECK(first.generate() == second.generate());
+  const auto in_child = generate_in_child(first, 4);
+  for (const auto& id : in_child) {
+    CHECK(id == second.generate());
+  }
+}
+
+// IDs from every thread are unique and ordered within each thread, also
+// across batches
+void test_v7_monotonic() {
+  constexpr size_t per_thread = 20000;
+  std::vector<std::vector<Uuid>> results(4);
+  std::vector<std::thread> threads;
+  for (auto& result : results) {
+    threads.emplace_back([&result] {
+      V7 generator;
+      std::array<Id, 10> batch;
+      while (result.size() < per_thread) {
+        result.emplace_back(generator.generate());
+        generator.generate_n(batch.data(), batch.size());
+        for (const auto& id : batch) {
+          result.emplace_back(id);
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  std::set<Uuid> all;
+  for (const auto& result : results) {
+    for (size_t i = 0; i < result.size(); ++i) {
+      CHECK(result[i].version() == 7);
+      CHECK(i == 0 || result[i - 1] < result[i]);
+      CHECK(all.insert(result[i]).second);
+    }
+  }
+  const auto now = static_cast<uint64_t>(datetime::now());
+  CHECK(all.rbegin()->timestamp_ms() <= now + 1000);
+  CHECK(all.begin()->timestamp_ms() + 60000 > now);
+}
+
+void test_text_forms() {
+  const auto id = Uuid(V4().generate());
+  const std::string text = id.str();
+  CHECK(text.size() == string_length);
+  CHECK(Uuid::parse(text) == id);
+  CHECK(from_chars(text) == id.bytes());
+
+  char compact[compact_length];
+  to_chars_compact(id.bytes(), compact);
+  CHECK(Uuid::parse(std::string_view(compact, compact_length)) == id);
+
+  CHECK(!Uuid::parse("not-a-uuid"));
+  CHECK(!from_chars("0123456789abcdef0123456789abcdeg"));
+  static_assert(Uuid::parse("00000000-0000-7000-8000-000000000001")
+                    ->version() == 7);
+}
+
+// Scalar reference for the vectorized encoder
+std::string reference_text(const Id& id) {
+  std::string text;
+  char digits[3];
+  for (size_t i = 0; i < id.size(); ++i) {
+    if (i == 4 || i == 6 || i == 8 || i == 10) {
+      text += '-';
+    }
+    std::snprintf(digits, sizeof(digits), "%02x", id[i]);
+    text += digits;
+  }
+  return text;
+}
+
+// Every byte value in every position encodes like the reference, one at a
+// time and in batches, and parses back in either case
+void test_encoding() {
+  std::vector<Id> ids(256);
+  for (size_t value = 0; value < ids.size(); ++value) {
+    for (size_t i = 0; i < 16; ++i) {
+      ids[value][i] = static_cast<uint8_t>(value + i * 17);
+    }
+  }
+  std::vector<char> batch(ids.size() * string_length);
+  to_chars_n(ids.data(), ids.size(), batch.data());
+
+  for (size_t n = 0; n < ids.size(); ++n) {
+    const std::string expected = reference_text(ids[n]);
+    char text[string_length];
+    to_chars(ids[n], text);
+    CHECK(std::string(text, string_length) == expected);
+    CHECK(std::string(&batch[n * string_length], string_length) == expected);
+    CHECK(uuidToString(ids[n]) == expected);
+
+    std::string upper = expected;
+    for (auto& c : upper) {
+      c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    }
+    CHECK(from_chars(upper) == ids[n]);
+  }
+}
+
+// Each character is validated, by the runtime and the constexpr parser alike
+void test_parse_rejects() {
+  const std::string valid = "0123abcd-ef45-6789-ABCD-ef0123456789";
+  CHECK(from_chars(valid) && Uuid::parse(valid));
+  for (size_t i = 0; i < valid.size(); ++i) {
+    for (int c = 0; c < 256; ++c) {
+      std::string text = valid;
+      text[i] = static_cast<char>(c);
+      const bool dash = i == 8 || i == 13 || i == 18 || i == 23;
+      const bool ok = dash ? c == '-' : std::isxdigit(c) != 0;
+      CHECK(from_chars(text).has_value() == ok);
+      CHECK(Uuid::parse(text).has_value() == ok);
+    }
+  }
+  std::string compact = valid;
+  compact.erase(std::remove(compact.begin(), compact.end(), '-'),
+                compact.end());
+  CHECK(from_chars(compact) == from_chars(valid));
+  CHECK(!from_chars(compact + "0"));
+  CHECK(!from_chars(valid.substr(1)));
+  CHECK(!from_chars("0123abcd-ef45-6789-ABCDef-0123456789"));
+  CHECK(!from_chars(""));
+}
+
+}  // namespace
+
+int main() {
+  test_secure_v4_after_fork();
+  test_keyed_chacha20();
+  test_v7_monotonic();
+  test_text_forms();
+  test_encoding();
+  test_parse_rejects();
+  return 0;
+}
@@ -0,0 +1,117 @@
+#include "cpputils/v7_index.h"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <random>
+#include <unordered_set>
+#include <vector>
+
+#include "check.h"
+
+using namespace cpputils;
+using namespace cpputils::uuid;
+
+namespace {
+
+// V7 layout: 48-bit timestamp, version, then anything
+Uuid make_v7(uint64_t timestamp_ms, uint64_t tail) {
+  std::array<uint8_t, 16> bytes{};
+  for (int i = 0; i < 6; ++i) {
+    bytes[i] = static_cast<uint8_t>(timestamp_ms >> (40 - 8 * i));
+  }
+  for (int i = 0; i < 8; ++i) {
+    bytes[8 + i] = static_cast<uint8_t>(tail >> (56 - 8 * i));
+  }
+  bytes[6] = 0x70;
+  return Uuid(bytes);
+}
+
+// Comparisons agree with the byte order, equal values hash alike
+void test_value_type() {
+  static_assert(alignof(Uuid) == 16 && sizeof(Uuid) == 16);
+  std::mt19937_64 random(7);
+  std::unordered_set<Uuid> set;
+  for (int n = 0; n < 1000; ++n) {
+    std::array<uint8_t, 16> a;
+    std::array<uint8_t, 16> b;
+    for (size_t i = 0; i < 16; ++i) {
+      a[i] = static_cast<uint8_t>(random());
+      // Mostly equal prefixes, so every byte gets compared
+      b[i] = i < static_cast<size_t>(n % 17) ? a[i]
+                                              : static_cast<uint8_t>(random());
+    }
+    const int order = std::memcmp(a.data(), b.data(), 16);
+    CHECK((Uuid(a) < Uuid(b)) == (order < 0));
+    CHECK((Uuid(a) == Uuid(b)) == (order == 0));
+    CHECK(Uuid(a).hash() == Uuid(a).hash());
+    set.insert(Uuid(a));
+  }
+  CHECK(set.size() == 1000);
+
+  const Uuid id = make_v7(1234, 99);
+  CHECK(id.version() == 7 && id.timestamp_ms() == 1234);
+  CHECK(Uuid::min_v7(1234) <= id && id <= Uuid::max_v7(1234));
+  CHECK(Uuid::max_v7(1233) < id && id < Uuid::min_v7(1235));
+}
+
+// Mostly ordered inserts with late arrivals, checked against std::map
+// through block splits, range scans and pruning
+void test_index() {
+  std::mt19937_64 random(11);
+  V7Index<uint64_t> index(4);
+  std::map<Uuid, uint64_t> expected;
+  for (uint64_t n = 0; n < 2000; ++n) {
+    // Every 5th key is up to 50 ms late
+    const uint64_t ts = 1000 + n / 3 - (n % 5 == 0 ? random() % 50 : 0);
+    const Uuid key = make_v7(ts, random());
+    CHECK(index.insert(key, n) == expected.emplace(key, n).second);
+  }
+  const Uuid present = expected.begin()->first;
+  CHECK(!index.insert(present, 0));
+  CHECK(index.size() == expected.size());
+
+  for (const auto& [key, value] : expected) {
+    const uint64_t* found = index.find(key);
+    CHECK(found != nullptr && *found == value);
+  }
+  CHECK(!index.contains(make_v7(1100, 0)));
+  CHECK(!index.contains(make_v7(5000, 0)));
+
+  const auto check_range = [&](uint64_t from_ms, uint64_t to_ms) {
+    auto it = expected.lower_bound(Uuid::min_v7(from_ms));
+    const size_t matched = index.for_each_in_range(
+        from_ms, to_ms, [&](const Uuid& key, const uint64_t& value) {
+          CHECK(it != expected.end() && key == it->first &&
+                value == it->second);
+          ++it;
+        });
+    CHECK(it == expected.upper_bound(Uuid::max_v7(to_ms)));
+    return matched;
+  };
+  CHECK(check_range(0, ~uint64_t{0} >> 16) == expected.size());
+  CHECK(check_range(1200, 1300) > 0);
+  CHECK(check_range(1250, 1250) > 0);
+  CHECK(check_range(2000, 3000) == 0);
+  CHECK(index.for_each_in_range(1300, 1200,
+                                [](const Uuid&, const uint64_t&) {}) == 0);
+
+  const size_t before = expected.size();
+  expected.erase(expected.begin(), expected.lower_bound(Uuid::min_v7(1400)));
+  CHECK(index.erase_before(1400) == before - expected.size());
+  CHECK(index.size() == expected.size());
+  CHECK(!index.contains(present));
+  CHECK(check_range(0, 2000) == expected.size());
+
+  index.clear();
+  CHECK(index.empty() && index.find(present) == nullptr);
+  CHECK(index.insert(present, 1) && *index.find(present) == 1);
+}
+
+}  // namespace
+
+int main() {
+  test_value_type();
+  test_index();
+  return 0;
+}